@@ -0,0 +1,61 @@
+#!/usr/bin/env python
+
+# Runs freebayes on the same data with and without skipping ahead to candidate
+# positions, and reports any difference in what they write.  Skipping only
+# passes over positions at which nothing can be called, so the two outputs
+# should be byte-identical apart from the ##commandline header line.
+#
+# usage: compare_candidate_skipping.py bin/freebayes [freebayes arguments]
+#
+# e.g.
+#
+#     compare_candidate_skipping.py bin/freebayes -f ref.fa -r 20:1-2000000 aln.bam
+#
+# skipping is disabled with --no-candidate-skipping.
+
+import sys
+import subprocess
+
+if len(sys.argv) < 3:
+    sys.stderr.write("usage: " + sys.argv[0] + " [freebayes] [freebayes arguments]\n")
+    sys.stderr.write("Runs freebayes with the given arguments, with and without --no-candidate-skipping,\n")
+    sys.stderr.write("and reports the records which differ.  Exits non-zero unless the outputs are\n")
+    sys.stderr.write("byte-identical apart from ##commandline.\n")
+    exit(1)
+
+def run(binary, args):
+    """runs freebayes, returning its output without the ##commandline line"""
+    out = subprocess.Popen([binary] + args, stdout=subprocess.PIPE).communicate()[0]
+    return [line for line in out.split(b"\n") if not line.startswith(b"##commandline")]
+
+def records(output):
+    return [line.decode() for line in output if line and not line.startswith(b"#")]
+
+binary = sys.argv[1]
+args = sys.argv[2:]
+skipping_output = run(binary, args)
+stepping_output = run(binary, ["--no-candidate-skipping"] + args)
+skipping = records(skipping_output)
+stepping = records(stepping_output)
+
+skipping_set = set(skipping)
+stepping_set = set(stepping)
+only_skipping = [r for r in skipping if r not in stepping_set]
+only_stepping = [r for r in stepping if r not in skipping_set]
+
+def site(record):
+    fields = record.split("\t")
+    return fields[0] + ":" + fields[1] + " " + fields[3] + ">" + fields[4]
+
+print("records when skipping\t" + str(len(skipping)))
+print("records when stepping\t" + str(len(stepping)))
+print("records only when skipping\t" + str(len(only_skipping)))
+print("records only when stepping\t" + str(len(only_stepping)))
+print("byte-identical\t" + str(skipping_output == stepping_output).lower())
+for record in only_skipping[:10]:
+    print("only when skipping\t" + site(record))
+for record in only_stepping[:10]:
+    print("only when stepping\t" + site(record))
+
+if skipping_output != stepping_output:
+    exit(1)
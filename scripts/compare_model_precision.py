@@ -0,0 +1,88 @@
+#!/usr/bin/env python
+
+# Runs the default (long double) and double-precision builds of freebayes on the
+# same data and reports how far their QUAL, GQ and GL values diverge.
+#
+# usage: compare_model_precision.py bin/freebayes bin/freebayes-double [freebayes arguments]
+#
+# e.g.
+#
+#     compare_model_precision.py bin/freebayes bin/freebayes-double -f ref.fa -r 20:1-2000000 aln.bam
+#
+# bin/freebayes-double is built by `make double`.
+
+import sys
+import subprocess
+
+if len(sys.argv) < 4:
+    sys.stderr.write("usage: " + sys.argv[0] + " [freebayes] [freebayes-double] [freebayes arguments]\n")
+    sys.stderr.write("Runs both builds with the given arguments and reports the maximum divergence in\n")
+    sys.stderr.write("QUAL, GQ and GL, and any sites or genotypes which are called by only one build.\n")
+    exit(1)
+
+def run(binary, args):
+    """runs freebayes, returning a map from (chrom, pos, ref, alt) to (qual, {sample: {field: value}})"""
+    out = subprocess.Popen([binary] + args, stdout=subprocess.PIPE).communicate()[0]
+    records = {}
+    samples = []
+    for line in out.decode().split("\n"):
+        if not line or line.startswith("##"):
+            continue
+        fields = line.split("\t")
+        if line.startswith("#"):
+            samples = fields[9:]
+            continue
+        key = (fields[0], int(fields[1]), fields[3], fields[4])
+        calls = {}
+        if len(fields) > 9:
+            format = fields[8].split(":")
+            for sample, data in zip(samples, fields[9:]):
+                calls[sample] = dict(zip(format, data.split(":")))
+        records[key] = (float(fields[5]), calls)
+    return records
+
+def to_floats(value):
+    try:
+        return [float(v) for v in value.split(",")]
+    except ValueError:
+        return []
+
+args = sys.argv[3:]
+reference = run(sys.argv[1], args)
+double = run(sys.argv[2], args)
+
+shared = [k for k in reference if k in double]
+only_reference = [k for k in reference if k not in double]
+only_double = [k for k in double if k not in reference]
+
+# field -> (max absolute divergence, site at which it occurs)
+divergence = {"QUAL": (0, None), "GQ": (0, None), "GL": (0, None)}
+discordant_genotypes = 0
+
+def update(field, x, y, key):
+    if abs(x - y) > divergence[field][0]:
+        divergence[field] = (abs(x - y), key)
+
+for key in shared:
+    qual, calls = reference[key]
+    dqual, dcalls = double[key]
+    update("QUAL", qual, dqual, key)
+    for sample, call in calls.items():
+        dcall = dcalls.get(sample, {})
+        if call.get("GT") != dcall.get("GT"):
+            discordant_genotypes += 1
+        for field in ("GQ", "GL"):
+            for x, y in zip(to_floats(call.get(field, ".")), to_floats(dcall.get(field, "."))):
+                update(field, x, y, key)
+
+def site(key):
+    if key is None:
+        return ""
+    return "\t" + key[0] + ":" + str(key[1]) + " " + key[2] + ">" + key[3]
+
+print("sites in both builds\t" + str(len(shared)))
+print("sites only in " + sys.argv[1] + "\t" + str(len(only_reference)))
+print("sites only in " + sys.argv[2] + "\t" + str(len(only_double)))
+print("discordant genotypes\t" + str(discordant_genotypes))
+for field in ("QUAL", "GQ", "GL"):
+    print("max " + field + " divergence\t" + str(divergence[field][0]) + site(divergence[field][1]))
@@ -52,7 +52,7 @@ const int Allele::subquality(int startpos, int len) const {
 }
 
 // quality of subsequence of allele
-const long double Allele::lnsubquality(int startpos, int len) const {
+const ModelFloat Allele::lnsubquality(int startpos, int len) const {
     return phred2ln(subquality(startpos, len));
 }
 
@@ -126,7 +126,7 @@ const int Allele::subquality(const Allele &a) const {
     return sum * (l / L);
 }
 
-const long double Allele::lnsubquality(const Allele& a) const {
+const ModelFloat Allele::lnsubquality(const Allele& a) const {
     return phred2ln(subquality(a));
 }
 
@@ -182,7 +182,7 @@ const short Allele::currentQuality(void) const {
     }
 }
 
-const long double Allele::lncurrentQuality(void) const {
+const ModelFloat Allele::lncurrentQuality(void) const {
     return phred2ln(currentQuality());
 }
 
@@ -119,11 +119,11 @@ public:
     string readGroupID;     // read group membership
     string readID;          // id of the read which the allele is drawn from
     vector<short> baseQualities;
-    long double quality;          // base quality score associated with this allele, updated every position in the case of reference alleles
-    long double lnquality;  // log version of above
+    ModelFloat quality;          // base quality score associated with this allele, updated every position in the case of reference alleles
+    ModelFloat lnquality;  // log version of above
     string currentBase;       // current base, meant to be updated every position
     short mapQuality;       // map quality for the originating read
-    long double lnmapQuality;       // map quality for the originating read
+    ModelFloat lnmapQuality;       // map quality for the originating read
     double readMismatchRate; // per-base mismatch rate for the read
     double readIndelRate;  // only considering gaps
     double readSNPRate;    // only considering snps/mnps
@@ -153,7 +153,7 @@ public:
            string& readgroupid,
            string& sqtech,
            bool strnd, 
-           long double qual,
+           ModelFloat qual,
            string qstr, 
            short mapqual,
            bool ispair,
@@ -244,11 +244,11 @@ public:
     bool isNull(void) const; // true if type == ALLELE_NULL
     int referenceOffset(void) const;
     const short currentQuality(void) const;  // for getting the quality of a given position in multi-bp alleles
-    const long double lncurrentQuality(void) const;
+    const ModelFloat lncurrentQuality(void) const;
     const int subquality(int startpos, int len) const;
-    const long double lnsubquality(int startpos, int len) const;
+    const ModelFloat lnsubquality(int startpos, int len) const;
     const int subquality(const Allele &a) const;
-    const long double lnsubquality(const Allele &a) const;
+    const ModelFloat lnsubquality(const Allele &a) const;
     //const int basesLeft(void) const; // returns the bases left within the read of the current position within the allele
     //const int basesRight(void) const; // returns the bases right within the read of the current position within the allele
     bool sameSample(Allele &other);  // if the other allele has the same sample as this one
@@ -456,6 +456,14 @@ string AlleleParser::vcfHeader() {
         headerss << "##INFO=<ID=REPEAT,Number=1,Type=String,Description=\"Description of the local repeat structures flanking the current position\">" << endl;
     }
 
+    if (parameters.genotypingMaxWork > 0) {
+        headerss << "##INFO=<ID=GTA,Number=1,Type=String,Description=\"Genotyping search used at the site, either exhaustive, banded, or approximate (a single iteration of the exhaustive search), chosen under --genotyping-max-work\">" << endl;
+    }
+
+    if (parameters.maxCoverage > 0) {
+        headerss << "##INFO=<ID=DS,Number=0,Type=Flag,Description=\"Reads overlapping the site were dropped to hold the coverage of a sample to " << parameters.maxCoverage << " (--max-coverage)\">" << endl;
+    }
+
         // format fields for genotypes
     headerss << "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">" << endl
         << "##FORMAT=<ID=GQ,Number=1,Type=Float,Description=\"Genotype Quality, the Phred-scaled marginal (or unconditional) probability of the called genotype\">" << endl
@@ -466,7 +474,7 @@ string AlleleParser::vcfHeader() {
         << "##FORMAT=<ID=RO,Number=1,Type=Integer,Description=\"Reference allele observation count\">" << endl
         << "##FORMAT=<ID=QR,Number=1,Type=Integer,Description=\"Sum of quality of the reference observations\">" << endl
         << "##FORMAT=<ID=AO,Number=A,Type=Integer,Description=\"Alternate allele observation count\">" << endl
-        << "##FORMAT=<ID=QA,Number=A,Type=Integer,Description=\"Sum of quality of the alternate observations\">" << endl
+        << "##FORMAT=<ID=QA,Number=A,Type=Integer,Description=\"Sum of quality of the alternate observations\">" << endl;
         //<< "##FORMAT=<ID=SRF,Number=1,Type=Integer,Description=\"Number of reference observations on the forward strand\">" << endl
         //<< "##FORMAT=<ID=SRR,Number=1,Type=Integer,Description=\"Number of reference observations on the reverse strand\">" << endl
         //<< "##FORMAT=<ID=SAF,Number=1,Type=Integer,Description=\"Number of alternate observations on the forward strand\">" << endl
@@ -475,7 +483,12 @@ string AlleleParser::vcfHeader() {
         //<< "##FORMAT=<ID=LA,Number=1,Type=Integer,Description=\"Number of alternate observations placed left of the loci\">" << endl
         //<< "##FORMAT=<ID=ER,Number=1,Type=Integer,Description=\"Number of reference observations overlapping the loci in their '3 end\">" << endl
         //<< "##FORMAT=<ID=EA,Number=1,Type=Integer,Description=\"Number of alternate observations overlapping the loci in their '3 end\">" << endl
-        << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\t"
+
+    if (parameters.pooledFrequencies) {
+        headerss << "##FORMAT=<ID=AF,Number=A,Type=Float,Description=\"Estimated alternate allele frequency in the sample, with --pooled-frequencies\">" << endl;
+    }
+
+    headerss << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\t"
         << join(sampleList, "\t") << endl;
 
     return headerss.str();
@@ -550,6 +563,28 @@ void AlleleParser::loadFastaReference(void) {
 
 }
 
+// the repeat structure of the reference, precomputed by repeatindex
+void AlleleParser::loadRepeatIndex(void) {
+
+    if (parameters.repeatIndexFile.empty()) {
+        return;
+    }
+
+    DEBUG("loading repeat index " << parameters.repeatIndexFile);
+
+    if (!repeatIndex.open(parameters.repeatIndexFile)) {
+        ERROR("could not open repeat index " << parameters.repeatIndexFile);
+        exit(1);
+    }
+    if (repeatIndex.minLength > parameters.minRepeatSize) {
+        ERROR("repeat index " << parameters.repeatIndexFile << " omits repeats shorter than "
+              << repeatIndex.minLength << "bp, but --min-repeat-size is " << parameters.minRepeatSize);
+        exit(1);
+    }
+    usingRepeatIndex = true;
+
+}
+
 // alignment-based method for loading the first bit of our reference sequence
 void AlleleParser::loadReferenceSequence(BamAlignment& alignment) {
     DEBUG2("loading reference sequence overlapping first alignment");
@@ -558,7 +593,7 @@ void AlleleParser::loadReferenceSequence(BamAlignment& alignment) {
     currentSequenceStart = alignment.Position;
     currentSequenceName = referenceIDToName[alignment.RefID];
     currentRefID = alignment.RefID;
-    DEBUG2("reference.getSubSequence("<< currentSequenceName << ", " << currentSequenceStart << ", " << alignment.AlignedBases.length() << ")");
+    DEBUG2("reference.getSubSequence("<< currentSequenceName << ", " << currentSequenceStart << ", " << alignedBasesLength(alignment) << ")");
     currentSequence = uppercase(reference.getSubSequence(currentSequenceName, currentSequenceStart, alignment.Length));
 }
 
@@ -626,7 +661,7 @@ void AlleleParser::extendReferenceSequence(BamAlignment& alignment) {
     }
 
     int rightdiff =
-        (alignment.Position + alignment.AlignedBases.size())
+        (alignment.Position + alignedBasesLength(alignment))
         - (currentSequenceStart + currentSequence.size());
     if (rightdiff > 0) {
         currentSequence += uppercase(reference.getSubSequence(
@@ -842,6 +877,7 @@ AlleleParser::AlleleParser(int argc, char** argv) : parameters(Parameters(argc,
     lastHaplotypeLength = 1;
     usingHaplotypeBasisAlleles = false;
     usingVariantInputAlleles = false;
+    usingRepeatIndex = false;
     rightmostHaplotypeBasisAllelePosition = 0;
     rightmostInputAllelePosition = 0;
     nullSample = new Sample();
@@ -853,6 +889,7 @@ AlleleParser::AlleleParser(int argc, char** argv) : parameters(Parameters(argc,
     openOutputFile();
 
     loadFastaReference();
+    loadRepeatIndex();
     // when we open the bam files we can use the number of targets to decide if
     // we should load the indexes
     openBams();
@@ -938,6 +975,17 @@ bool AlleleParser::isCpG(string& altbase) {
     }
 }
 
+int alignedBasesLength(BamAlignment& alignment) {
+    int length = 0;
+    for (vector<CigarOp>::iterator c = alignment.CigarData.begin(); c != alignment.CigarData.end(); ++c) {
+        // hard clips are the only operations bamtools leaves out of AlignedBases
+        if (c->Type != 'H') {
+            length += c->Length;
+        }
+    }
+    return length;
+}
+
 void capBaseQuality(BamAlignment& alignment, int baseQualityCap) {
     string& rQual = alignment.Qualities;
     char qualcap = qualityInt2Char(baseQualityCap);
@@ -1164,7 +1212,7 @@ Allele AlleleParser::makeAllele(RegisteredAlignment& ra,
                                 string& sampleName,
                                 BamAlignment& alignment,
                                 string& sequencingTech,
-                                long double qual,
+                                ModelFloat qual,
                                 string& qualstr
     ) {
 
@@ -1229,26 +1277,30 @@ Allele AlleleParser::makeAllele(RegisteredAlignment& ra,
         } else if (type == ALLELE_DELETION) {
             alleleseq = refSequence;
         }
-        map<long int, map<string, int> >::iterator rc = cachedRepeatCounts.find(pos);
-        if (rc == cachedRepeatCounts.end()) {
-            cachedRepeatCounts[pos] = repeatCounts(pos - currentSequenceStart, currentSequence, 12);
-            rc = cachedRepeatCounts.find(pos);
-        }
-        map<string, int>& matchedRepeatCounts = rc->second;
+        RepeatAnnotation& annotation = repeatAnnotation(pos);
+        map<string, int>& matchedRepeatCounts = annotation.counts;
         for (map<string, int>::iterator r = matchedRepeatCounts.begin(); r != matchedRepeatCounts.end(); ++r) {
             const string& repeatunit = r->first;
             int rptcount = r->second;
-            string repeatstr = repeatunit * rptcount;
             // assumption of left-alignment may be problematic... so this should be updated
-            if (repeatstr.size() >= parameters.minRepeatSize && isRepeatUnit(alleleseq, repeatunit)) {
-                // determine the boundaries of the repeat
-                long int p = pos - currentSequenceStart;
-                // adjust to ensure we hit the first of the repeatstr
-                size_t startpos = currentSequence.find(repeatstr, max((long int) 0, p - (long int) repeatstr.size() - 1));
-                long int leftbound = startpos + currentSequenceStart;
-                if (startpos == string::npos) {
+            if (repeatunit.size() * rptcount >= parameters.minRepeatSize && isRepeatUnit(alleleseq, repeatunit)) {
+                // determine the boundaries of the repeat, once per position
+                map<string, long int>::iterator b = annotation.rightBoundaries.find(repeatunit);
+                if (b == annotation.rightBoundaries.end()) {
+                    string repeatstr = repeatunit * rptcount;
+                    long int p = pos - currentSequenceStart;
+                    // adjust to ensure we hit the first of the repeatstr
+                    size_t startpos = currentSequence.find(repeatstr, max((long int) 0, p - (long int) repeatstr.size() - 1));
+                    long int rightbound = -1;
+                    if (startpos != string::npos) {
+                        long int leftbound = startpos + currentSequenceStart;
+                        rightbound = leftbound + repeatstr.size() + 1; // 1 past edge of repeat
+                    }
+                    b = annotation.rightBoundaries.insert(make_pair(repeatunit, rightbound)).first;
+                }
+                if (b->second < 0) {
                     cerr << "could not find repeat sequence?" << endl;
-                    cerr << "repeat sequence: " << repeatstr << endl;
+                    cerr << "repeat sequence: " << repeatunit * rptcount << endl;
                     cerr << "currentsequence start: " << currentSequenceStart << endl;
                     cerr << currentSequence << endl;
                     cerr << "matched repeats:" << endl;
@@ -1258,26 +1310,40 @@ Allele AlleleParser::makeAllele(RegisteredAlignment& ra,
                     }
                     break; // ignore right-repeat boundary in this case
                 }
-                repeatRightBoundary = leftbound + repeatstr.size() + 1; // 1 past edge of repeat
+                repeatRightBoundary = b->second;
             }
         }
 
         // a dangerous game
-        int start = pos - currentSequenceStart;
+        // extend the boundary until the sequence from pos to it reaches the
+        // minimum entropy.  the entropy is updated as each base is added.
         double minEntropy = parameters.minRepeatEntropy;
         // check first that' wer'e actually ina repeat... TODO
-        //cerr << "entropy of " << entropy(currentSequence.substr(start, repeatRightBoundary - pos)) << " is too low, " << endl;
-        while (minEntropy > 0 && // ignore if turned off
-               repeatRightBoundary - currentSequenceStart < currentSequence.size() && //guard
-               entropy(currentSequence.substr(start, repeatRightBoundary - pos)) < minEntropy) {
-            //cerr << "entropy of " << entropy(currentSequence.substr(start, repeatRightBoundary - pos)) << " is too low, "; 
-            //cerr << "increasing rought boundary to ";
-            ++repeatRightBoundary;
-            //cerr << repeatRightBoundary << endl;
+        if (minEntropy > 0 && // ignore if turned off
+            repeatRightBoundary - currentSequenceStart < currentSequence.size()) {
+            map<long int, long int>::iterator e = annotation.entropyBoundaries.find(repeatRightBoundary);
+            if (e != annotation.entropyBoundaries.end()) {
+                repeatRightBoundary = e->second;
+            } else {
+                long int repeatBoundary = repeatRightBoundary;
+                RollingEntropy repeatEntropy;
+                for (long int i = pos; i < repeatRightBoundary; ++i) {
+                    repeatEntropy.add(currentSequence.at(i - currentSequenceStart));
+                }
+                while (repeatRightBoundary - currentSequenceStart < currentSequence.size() && //guard
+                       repeatEntropy.value() < minEntropy) {
+                    repeatEntropy.add(currentSequence.at(repeatRightBoundary - currentSequenceStart));
+                    ++repeatRightBoundary;
+                }
+                // only cache boundaries which did not run into the end of the
+                // cached sequence, as it may later be extended
+                if (repeatRightBoundary - currentSequenceStart < currentSequence.size()) {
+                    annotation.entropyBoundaries[repeatBoundary] = repeatRightBoundary;
+                }
+            }
         }
 
         // now we
-        //cachedRepeatCounts[pos] = repeatCounts(pos - currentSequenceStart, currentSequence, 12);
         // edge case, the indel is an insertion and matches the reference to the right
         // this means there is a repeat structure in the read, but not the ref
         if (currentSequence.substr(pos - currentSequenceStart, length) == readSequence) {
@@ -1300,7 +1366,7 @@ Allele AlleleParser::makeAllele(RegisteredAlignment& ra,
                   ra.readgroup,
                   sequencingTech,
                   !alignment.IsReverseStrand(),
-                  max(qual, (long double) 0), // ensure qual is at least 0
+                  max(qual, (ModelFloat) 0), // ensure qual is at least 0
                   qualstr,
                   alignment.MapQuality,
                   alignment.IsPaired(),
@@ -1315,8 +1381,8 @@ Allele AlleleParser::makeAllele(RegisteredAlignment& ra,
 
 RegisteredAlignment& AlleleParser::registerAlignment(BamAlignment& alignment, RegisteredAlignment& ra, string& sampleName, string& sequencingTech) {
 
-    string rDna = alignment.QueryBases;
-    string rQual = alignment.Qualities;
+    const string& rDna = alignment.QueryBases;
+    const string& rQual = alignment.Qualities;
     int rp = 0;  // read position, 0-based relative to read
     int csp = currentSequencePosition(alignment); // current sequence position, 0-based relative to currentSequence
     int sp = alignment.Position;  // sequence position
@@ -1405,6 +1471,23 @@ RegisteredAlignment& AlleleParser::registerAlignment(BamAlignment& alignment, Re
 
             for (int i=0; i<l; i++) {
 
+                // bases matching the reference need nothing but a step of
+                // the positions, so skip runs of them.  the scalar path below
+                // still handles mismatches and the ends of the cached sequences
+                if (!inMismatch) {
+                    int available = min(l - i, min((int) rDna.size() - rp, (int) currentSequence.size() - csp));
+                    if (available > 0 && csp >= 0) {
+                        int run = matchingPrefixLength(rDna.data() + rp, currentSequence.data() + csp, available);
+                        i += run;
+                        sp += run;
+                        csp += run;
+                        rp += run;
+                        if (i == l) {
+                            break;
+                        }
+                    }
+                }
+
                 // extract aligned base
                 string b;
                 try {
@@ -1418,7 +1501,7 @@ RegisteredAlignment& AlleleParser::registerAlignment(BamAlignment& alignment, Re
                 }
 
                 // convert base quality value into short int
-                long double qual = qualityChar2LongDouble(rQual.at(rp));
+                ModelFloat qual = qualityChar2LongDouble(rQual.at(rp));
 
                 // get reference allele
                 string sb;
@@ -1482,7 +1565,7 @@ RegisteredAlignment& AlleleParser::registerAlignment(BamAlignment& alignment, Re
                     string readSequence = rDna.substr(rp - length, length);
                     string qualstr = rQual.substr(rp - length, length);
                     for (int j = 0; j < length; ++j) {
-                        long double lqual = qualityChar2LongDouble(qualstr.at(j));
+                        ModelFloat lqual = qualityChar2LongDouble(qualstr.at(j));
                         string qualp = qualstr.substr(j, 1);
                         string rs = readSequence.substr(j, 1);
                         if (allATGC(rs)) {
@@ -1532,7 +1615,7 @@ RegisteredAlignment& AlleleParser::registerAlignment(BamAlignment& alignment, Re
                 string readSequence = rDna.substr(rp - length, length);
                 string qualstr = rQual.substr(rp - length, length);
                 for (int j = 0; j < length; ++j) {
-                    long double lqual = qualityChar2LongDouble(qualstr.at(j));
+                    ModelFloat lqual = qualityChar2LongDouble(qualstr.at(j));
                     string qualp = qualstr.substr(j, 1);
                     string rs = readSequence.substr(j, 1);
                     if (allATGC(rs)) {
@@ -1623,7 +1706,7 @@ RegisteredAlignment& AlleleParser::registerAlignment(BamAlignment& alignment, Re
 
             string qualstr = rQual.substr(spanstart, L);
 
-            long double qual;
+            ModelFloat qual;
             if (parameters.useMinIndelQuality) {
                 qual = minQuality(qualstr);
                 //qual = averageQuality(qualstr);
@@ -1636,8 +1719,8 @@ RegisteredAlignment& AlleleParser::registerAlignment(BamAlignment& alignment, Re
                 // the quality string X a scaling constant derived from the ratio
                 // between the length of the quality string and the length of the
                 // allele
-                //qual += ln2phred(log((long double) l / (long double) L));
-                qual += ln2phred(log((long double) L / (long double) l));
+                //qual += ln2phred(log((ModelFloat) l / (ModelFloat) L));
+                qual += ln2phred(log((ModelFloat) L / (ModelFloat) l));
                 qual /= harmonicSum(l);
             }
 
@@ -1704,7 +1787,7 @@ RegisteredAlignment& AlleleParser::registerAlignment(BamAlignment& alignment, Re
 
             string qualstr = rQual.substr(spanstart, L);
 
-            long double qual;
+            ModelFloat qual;
             if (parameters.useMinIndelQuality) {
                 qual = minQuality(qualstr);
                 //qual = averageQuality(qualstr); // does not work as well as the min
@@ -1717,8 +1800,8 @@ RegisteredAlignment& AlleleParser::registerAlignment(BamAlignment& alignment, Re
                 // the quality string X a scaling constant derived from the ratio
                 // between the length of the quality string and the length of the
                 // allele
-                //qual += ln2phred(log((long double) l / (long double) L));
-                qual += ln2phred(log((long double) L / (long double) l));
+                //qual += ln2phred(log((ModelFloat) l / (ModelFloat) L));
+                qual += ln2phred(log((ModelFloat) L / (ModelFloat) l));
                 qual /= harmonicSum(l);
             }
 
@@ -1892,7 +1975,8 @@ RegisteredAlignment& AlleleParser::registerAlignment(BamAlignment& alignment, Re
 
 void AlleleParser::updateAlignmentQueue(long int position,
                                         vector<Allele*>& newAlleles,
-                                        bool gettingPartials) {
+                                        bool gettingPartials,
+                                        bool deferring) {
 
     DEBUG2("updating alignment queue");
     DEBUG2("currentPosition = " << position 
@@ -1906,7 +1990,7 @@ void AlleleParser::updateAlignmentQueue(long int position,
     // current position or we reach the end of available alignments
     // filter input reads; only allow mapped reads with a certain quality
     DEBUG2("currentAlignment.Position == " << currentAlignment.Position 
-           << ", currentAlignment.AlignedBases.size() == " << currentAlignment.AlignedBases.size()
+           << ", alignedBasesLength(currentAlignment) == " << alignedBasesLength(currentAlignment)
            << ", currentPosition == " << position
            << ", currentSequenceStart == " << currentSequenceStart
            << " .. + currentSequence.size() == " << currentSequenceStart + currentSequence.size()
@@ -1917,7 +2001,46 @@ void AlleleParser::updateAlignmentQueue(long int position,
         && currentAlignment.RefID == currentRefID) {
         do {
             DEBUG2("top of alignment parsing loop");
+
+            // alignments are read with GetNextAlignmentCore, so only the core
+            // fields are available.  apply the filters which use them first, and
+            // only decode the name, bases, qualities and tags of reads which pass
+
+            // report reads out of order before filtering any, so that the input
+            // is checked whatever the filters.  unmapped reads have no end.
+            if (!gettingPartials && currentAlignment.IsMapped() && currentAlignment.GetEndPosition() < position) {
+                currentAlignment.BuildCharData();
+                cerr << currentAlignment.Name << " at " << currentSequenceName << ":" << currentAlignment.Position << " is out of order!"
+                     << " expected after " << position << endl;
+                continue;
+            }
+
+            // skip this alignment if we are not using duplicate reads (we remove them by default)
+            if (currentAlignment.IsDuplicate() && !parameters.useDuplicateReads) {
+                //DEBUG("skipping alignment " << currentAlignment.Name << " because it is a duplicate read");
+                continue;
+            }
+
+            // skip unmapped alignments, as they cannot be used in the algorithm
+            if (!currentAlignment.IsMapped()) {
+                //DEBUG("skipping alignment " << currentAlignment.Name << " because it is not mapped");
+                continue;
+            }
+
+            // skip alignments which are non-primary
+            if (!currentAlignment.IsPrimaryAlignment()) {
+                //DEBUG("skipping alignment " << currentAlignment.Name << " because it is not marked primary");
+                continue;
+            }
+
+            // initially skip reads with low mapping quality (what happens if MapQuality is not in the file)
+            if (currentAlignment.MapQuality < parameters.MQL0) {
+                continue;
+            }
+
+            currentAlignment.BuildCharData();
             DEBUG2("currentAlignment.Name == " << currentAlignment.Name);
+
             // get read group, and map back to a sample name
             string readGroup;
             if (!currentAlignment.GetTag("RG", readGroup)) {
@@ -1944,84 +2067,48 @@ void AlleleParser::updateAlignmentQueue(long int position,
                 continue;
             }
 
-            // skip this alignment if we are not using duplicate reads (we remove them by default)
-            if (currentAlignment.IsDuplicate() && !parameters.useDuplicateReads) {
-                //DEBUG("skipping alignment " << currentAlignment.Name << " because it is a duplicate read");
-                continue;
-            }
-
-            // skip unmapped alignments, as they cannot be used in the algorithm
-            if (!currentAlignment.IsMapped()) {
-                //DEBUG("skipping alignment " << currentAlignment.Name << " because it is not mapped");
-                continue;
-            }
-
             // skip alignments which have no aligned bases
             if (currentAlignment.AlignedBases.size() == 0) {
                 //DEBUG("skipping alignment " << currentAlignment.Name << " because it has no aligned bases");
                 continue;
             }
 
-            // skip alignments which are non-primary
-            if (!currentAlignment.IsPrimaryAlignment()) {
-                //DEBUG("skipping alignment " << currentAlignment.Name << " because it is not marked primary");
-                continue;
-            }
-
-            if (!gettingPartials && currentAlignment.GetEndPosition() < position) {
-                cerr << currentAlignment.Name << " at " << currentSequenceName << ":" << currentAlignment.Position << " is out of order!"
-                     << " expected after " << position << endl;
-                continue;
-            }
-
             // otherwise, get the sample name and register the alignment to generate a sequence of alleles
             // we have to register the alignment to acquire some information required by filters
             // such as mismatches
-
-            // initially skip reads with low mapping quality (what happens if MapQuality is not in the file)
-            if (currentAlignment.MapQuality >= parameters.MQL0) {
-                // extend our cached reference sequence to allow processing of this alignment
-                extendReferenceSequence(currentAlignment);
-                // left realign indels
-                if (parameters.leftAlignIndels) {
-                    int length = currentAlignment.GetEndPosition() - currentAlignment.Position + 1;
-                    stablyLeftAlign(currentAlignment,
-                                    currentSequence.substr(currentSequencePosition(currentAlignment), length));
-                }
-                // get sample name
-                string sampleName = readGroupToSampleNames[readGroup];
-                string sequencingTech;
-                map<string, string>::iterator t = readGroupToTechnology.find(readGroup);
-                if (t != readGroupToTechnology.end()) {
-                    sequencingTech = t->second;
-                }
-                // limit base quality if cap set
-                if (parameters.baseQualityCap != 0) {
-                    capBaseQuality(currentAlignment, parameters.baseQualityCap);
-                }
-                // decomposes alignment into a set of alleles
-                // here we get the deque of alignments ending at this alignment's end position
-                deque<RegisteredAlignment>& rq = registeredAlignments[currentAlignment.GetEndPosition()];
-                // and insert the registered alignment into that deque
-                rq.push_front(RegisteredAlignment(currentAlignment));
-                RegisteredAlignment& ra = rq.front();
-                registerAlignment(currentAlignment, ra, sampleName, sequencingTech);
-                // backtracking if we have too many mismatches
-                // or if there are no recorded alleles
-                if (ra.alleles.empty()
-                    || ((float) ra.mismatches / (float) currentAlignment.QueryBases.size()) > parameters.readMaxMismatchFraction
-                    || ra.mismatches > parameters.RMU
-                    || ra.snpCount > parameters.readSnpLimit
-                    || ra.indelCount > parameters.readIndelLimit) {
-                    rq.pop_front(); // backtrack
-                } else {
-                    // push the alleles into our new alleles vector
-                    for (vector<Allele>::iterator allele = ra.alleles.begin(); allele != ra.alleles.end(); ++allele) {
-                        newAlleles.push_back(&*allele);
-                    }
-                }
+            // extend our cached reference sequence to allow processing of this alignment
+            extendReferenceSequence(currentAlignment);
+            // get sample name
+            string sampleName = readGroupToSampleNames[readGroup];
+            // hold the sample's coverage to the cap before doing any work on the read
+            if (parameters.maxCoverage > 0 && downsampleAlignment(currentAlignment, sampleName)) {
+                continue;
+            }
+            // left realign indels
+            if (parameters.leftAlignIndels && hasIndels(currentAlignment)) {
+                int length = currentAlignment.GetEndPosition() - currentAlignment.Position + 1;
+                stablyLeftAlign(currentAlignment,
+                                currentSequence.substr(currentSequencePosition(currentAlignment), length),
+                                20, false, &leftAlignCache);
+            }
+            string sequencingTech;
+            map<string, string>::iterator t = readGroupToTechnology.find(readGroup);
+            if (t != readGroupToTechnology.end()) {
+                sequencingTech = t->second;
+            }
+            // limit base quality if cap set
+            if (parameters.baseQualityCap != 0) {
+                capBaseQuality(currentAlignment, parameters.baseQualityCap);
             }
-        } while ((hasMoreAlignments = bamMultiReader.GetNextAlignment(currentAlignment))
+            // an alignment matching the reference throughout yields only
+            // reference alleles, so while skipping it is held back until we
+            // stop at a position it might be used at
+            if (deferring && matchesReference(currentAlignment)) {
+                deferredAlignments.push_back(DeferredAlignment(currentAlignment, sampleName, sequencingTech));
+            } else {
+                queueAlignment(currentAlignment, sampleName, sequencingTech, newAlleles);
+            }
+        } while ((hasMoreAlignments = bamMultiReader.GetNextAlignmentCore(currentAlignment))
                  && currentAlignment.Position <= position
                  && currentAlignment.RefID == currentRefID);
     }
@@ -2030,10 +2117,168 @@ void AlleleParser::updateAlignmentQueue(long int position,
 
 }
 
+// decomposes alignment into a set of alleles and registers it, unless it has
+// too many mismatches or no recorded alleles
+void AlleleParser::queueAlignment(BamAlignment& alignment,
+                                  string& sampleName,
+                                  string& sequencingTech,
+                                  vector<Allele*>& newAlleles) {
+    // here we get the deque of alignments ending at this alignment's end position
+    deque<RegisteredAlignment>& rq = registeredAlignments[alignment.GetEndPosition()];
+    // and insert the registered alignment into that deque
+    rq.push_front(RegisteredAlignment(alignment));
+    RegisteredAlignment& ra = rq.front();
+    registerAlignment(alignment, ra, sampleName, sequencingTech);
+    // backtracking if we have too many mismatches
+    // or if there are no recorded alleles
+    if (ra.alleles.empty()
+        || ((float) ra.mismatches / (float) alignment.QueryBases.size()) > parameters.readMaxMismatchFraction
+        || ra.mismatches > parameters.RMU
+        || ra.snpCount > parameters.readSnpLimit
+        || ra.indelCount > parameters.readIndelLimit) {
+        rq.pop_front(); // backtrack
+    } else {
+        // push the alleles into our new alleles vector
+        for (vector<Allele>::iterator allele = ra.alleles.begin(); allele != ra.alleles.end(); ++allele) {
+            newAlleles.push_back(&*allele);
+        }
+    }
+}
+
+// --max-coverage: true if the alignment should be dropped to hold the
+// coverage of its sample near parameters.maxCoverage.  where the sample's
+// depth at the alignment's start exceeds the cap, it is kept if a hash of its
+// name, taken as a fraction of 1, falls below cap / depth.  the choice depends
+// only on the name, the seed and the depth, so mates tend to share it and
+// reruns repeat it, and the kept depth never exceeds the cap.
+bool AlleleParser::downsampleAlignment(BamAlignment& alignment, string& sampleName) {
+
+    long int start = alignment.Position;
+    long int end = alignment.GetEndPosition();
+
+    SampleCoverage& coverage = sampleCoverage[sampleName];
+    coverage.advance(start);
+    coverage.all.push(end);
+
+    bool keep = (int) coverage.all.size() <= parameters.maxCoverage;
+    if (!keep && (int) coverage.kept.size() < parameters.maxCoverage) {
+        // 32-bit FNV-1a of the seed and the name
+        uint32_t hash = 2166136261u;
+        for (int i = 0; i < 4; ++i) {
+            hash = (hash ^ ((parameters.downsampleSeed >> (8 * i)) & 0xff)) * 16777619u;
+        }
+        for (string::iterator c = alignment.Name.begin(); c != alignment.Name.end(); ++c) {
+            hash = (hash ^ (unsigned char) *c) * 16777619u;
+        }
+        keep = (hash / 4294967296.0) * coverage.all.size() < parameters.maxCoverage;
+    }
+
+    if (keep) {
+        coverage.kept.push(end);
+    } else {
+        downsampledAlignmentEnds.insert(end);
+    }
+    return !keep;
+
+}
+
+// true if an alignment overlapping position was dropped by --max-coverage.
+// alignments are read up to the position being processed, so any still
+// reaching position overlaps it.
+bool AlleleParser::downsampledAt(long int position) {
+    return downsampledAlignmentEnds.lower_bound(position) != downsampledAlignmentEnds.end();
+}
+
+// true if the alignment would be decomposed into nothing but reference
+// alleles: it has no indels or soft clips, and each of its aligned bases
+// matches the cached reference, which is not N
+bool AlleleParser::matchesReference(BamAlignment& alignment) {
+
+    const string& rDna = alignment.QueryBases;
+    int rp = 0;
+    int csp = currentSequencePosition(alignment);
+
+    if (csp < 0) {
+        return false;
+    }
+
+    for (vector<CigarOp>::const_iterator c = alignment.CigarData.begin(); c != alignment.CigarData.end(); ++c) {
+        int l = c->Length;
+        char t = c->Type;
+        if (t == 'M' || t == 'X' || t == '=') {
+            if (rp + l > (int) rDna.size() || csp + l > (int) currentSequence.size()
+                || matchingPrefixLength(rDna.data() + rp, currentSequence.data() + csp, l) < l) {
+                return false;
+            }
+            rp += l;
+            csp += l;
+        } else if (t == 'N') {
+            csp += l;
+        } else if (t != 'H') {
+            return false;
+        }
+    }
+
+    return true;
+
+}
+
+// deferral only changes when an alignment is decomposed, which is exact as
+// long as registration has no side effects we would otherwise miss
+bool AlleleParser::canDeferAlignments(void) {
+    return !usingHaplotypeBasisAlleles && !usingVariantInputAlleles;
+}
+
+// deferred alignments which end before the haplotype window would be erased
+// as soon as they were registered, so they are never decomposed at all.
+// they arrive in order of start, so those at the front expire first.
+void AlleleParser::dropExpiredDeferredAlignments(void) {
+    while (!deferredAlignments.empty()) {
+        long unsigned int end = deferredAlignments.front().alignment.GetEndPosition();
+        if (end < currentPosition - lastHaplotypeLength) {
+            deferredAlignments.pop_front();
+        } else {
+            break;
+        }
+    }
+}
+
+// decomposes and registers the alignments deferred while skipping.  called
+// when we stop at a position, before the registered alleles are used or the
+// cached reference sequence is trimmed behind them.
+void AlleleParser::registerDeferredAlignments(void) {
+
+    if (deferredAlignments.empty()) {
+        return;
+    }
+
+    DEBUG2("registering " << deferredAlignments.size() << " deferred alignments");
+    vector<Allele*> newAlleles;
+    for (deque<DeferredAlignment>::iterator d = deferredAlignments.begin(); d != deferredAlignments.end(); ++d) {
+        long unsigned int end = d->alignment.GetEndPosition();
+        if (end < currentPosition - lastHaplotypeLength) {
+            continue;
+        }
+        queueAlignment(d->alignment, d->sampleName, d->sequencingTech, newAlleles);
+    }
+    deferredAlignments.clear();
+    addToRegisteredAlleles(newAlleles);
+
+}
+
 void AlleleParser::addToRegisteredAlleles(vector<Allele*>& alleles) {
-    registeredAlleles.insert(registeredAlleles.end(),
-                             alleles.begin(),
-                             alleles.end());
+    for (vector<Allele*>::iterator a = alleles.begin(); a != alleles.end(); ++a) {
+        addToRegisteredAlleles(*a);
+    }
+}
+
+// registers the allele, and if it is not a reference allele, marks its start
+// as a position at which toNextPosition must stop
+void AlleleParser::addToRegisteredAlleles(Allele* allele) {
+    registeredAlleles.push_back(allele);
+    if (!allele->isReference()) {
+        candidatePositions.insert(allele->position);
+    }
 }
 
 // updates registered alleles and erases the unused portion of our cached reference sequence
@@ -2276,7 +2521,7 @@ void AlleleParser::updateInputVariants(long int pos, int referenceLength) {
                         // in the case that we have genotype likelihoods in the VCF
                         if (sample.find("GL") != sample.end()) {
                             vector<string>& gls = sample["GL"];
-                            vector<long double> genotypeLikelihoods;
+                            vector<ModelFloat> genotypeLikelihoods;
                             genotypeLikelihoods.resize(gls.size());
                             transform(gls.begin(), gls.end(), genotypeLikelihoods.begin(), log10string2ln);
 
@@ -2285,7 +2530,7 @@ void AlleleParser::updateInputVariants(long int pos, int referenceLength) {
                             for (map<Genotype*, int>::iterator gto = genotypeOrder.begin(); gto != genotypeOrder.end(); ++gto) {
                                 Genotype& genotype = *gto->first;
                                 int order = gto->second;
-                                map<string, long double>& sampleGenotypeLikelihoods = inputGenotypeLikelihoods[alternatePosition][sampleName];
+                                map<string, ModelFloat>& sampleGenotypeLikelihoods = inputGenotypeLikelihoods[alternatePosition][sampleName];
                                 //cerr << sampleName << ":" << convert(genotype) << ":" << genotypeLikelihoods[order] << endl;
                                 sampleGenotypeLikelihoods[convert(genotype)] = genotypeLikelihoods[order];
                             }
@@ -2326,7 +2571,7 @@ void AlleleParser::addCurrentGenotypeLikelihoods(map<int, vector<Genotype> >& ge
     // check if there are any genotype likelihoods at the current position
     if (inputGenotypeLikelihoods.find(currentPosition) != inputGenotypeLikelihoods.end()) {
 
-        map<string, map<string, long double> >& inputLikelihoodsBySample = inputGenotypeLikelihoods[currentPosition];
+        map<string, map<string, ModelFloat> >& inputLikelihoodsBySample = inputGenotypeLikelihoods[currentPosition];
 
         vector<Genotype*> genotypePtrs;
         for (map<int, vector<Genotype> >::iterator gp = genotypesByPloidy.begin(); gp != genotypesByPloidy.end(); ++gp) {
@@ -2336,14 +2581,14 @@ void AlleleParser::addCurrentGenotypeLikelihoods(map<int, vector<Genotype> >& ge
             }
         }
         // if there are, add them to the sample data likelihoods
-        for (map<string, map<string, long double> >::iterator gls = inputLikelihoodsBySample.begin();
+        for (map<string, map<string, ModelFloat> >::iterator gls = inputLikelihoodsBySample.begin();
                 gls != inputLikelihoodsBySample.end(); ++gls) {
             const string& sampleName = gls->first;
-            map<string, long double>& likelihoods = gls->second;
-            map<Genotype*, long double> likelihoodsPtr;
-            for (map<string, long double>::iterator gl = likelihoods.begin(); gl != likelihoods.end(); ++gl) {
+            map<string, ModelFloat>& likelihoods = gls->second;
+            map<Genotype*, ModelFloat> likelihoodsPtr;
+            for (map<string, ModelFloat>::iterator gl = likelihoods.begin(); gl != likelihoods.end(); ++gl) {
                 const string& genotype = gl->first;
-                long double l = gl->second;
+                ModelFloat l = gl->second;
                 for (vector<Genotype*>::iterator g = genotypePtrs.begin(); g != genotypePtrs.end(); ++g) {
                     if (convert(**g) == genotype) {
                         likelihoodsPtr[*g] = l;
@@ -2355,7 +2600,7 @@ void AlleleParser::addCurrentGenotypeLikelihoods(map<int, vector<Genotype> >& ge
             sampleData.name = sampleName;
             // TODO add null sample object to sampleData
             // do you need to????
-            for (map<Genotype*, long double>::iterator p = likelihoodsPtr.begin(); p != likelihoodsPtr.end(); ++p) {
+            for (map<Genotype*, ModelFloat>::iterator p = likelihoodsPtr.begin(); p != likelihoodsPtr.end(); ++p) {
                 sampleData.push_back(SampleDataLikelihood(sampleName, nullSample, p->first, p->second, 0));
             }
             sortSampleDataLikelihoods(sampleData);
@@ -2640,11 +2885,11 @@ bool AlleleParser::loadTarget(BedTarget* target) {
 bool AlleleParser::getFirstAlignment(void) {
 
     bool hasAlignments = true;
-    if (!bamMultiReader.GetNextAlignment(currentAlignment)) {
+    if (!bamMultiReader.GetNextAlignmentCore(currentAlignment)) {
         hasAlignments = false;
     } else {
         while (!currentAlignment.IsMapped()) {
-            if (!bamMultiReader.GetNextAlignment(currentAlignment)) {
+            if (!bamMultiReader.GetNextAlignmentCore(currentAlignment)) {
                 hasAlignments = false;
                 break;
             }
@@ -2688,7 +2933,11 @@ bool AlleleParser::getFirstVariant(void) {
 void AlleleParser::clearRegisteredAlignments(void) {
     DEBUG2("clearing registered alignments and alleles");
     registeredAlignments.clear();
+    deferredAlignments.clear();
+    sampleCoverage.clear();
+    downsampledAlignmentEnds.clear();
     registeredAlleles.clear();
+    candidatePositions.clear();
 }
 
 // TODO
@@ -2723,6 +2972,8 @@ bool AlleleParser::toNextPosition(void) {
     } 
     else {
         ++currentPosition;
+        skipToNextCandidatePosition();
+        registerDeferredAlignments();
     }
 
     if (!targets.empty() && (
@@ -2741,7 +2992,7 @@ bool AlleleParser::toNextPosition(void) {
         // implicit step of target sequence
         // XXX this must wait for us to clean out all of our alignments at the end of the target
         while (hasMoreAlignments && !currentAlignment.IsMapped()) {
-            hasMoreAlignments = bamMultiReader.GetNextAlignment(currentAlignment);
+            hasMoreAlignments = bamMultiReader.GetNextAlignmentCore(currentAlignment);
         }
         if (hasMoreAlignments) {
             if (currentPosition > reference.sequenceLength(currentSequenceName)
@@ -2790,6 +3041,8 @@ bool AlleleParser::toNextPosition(void) {
            && f->first < currentPosition - lastHaplotypeLength) {
         registeredAlignments.erase(f++);
     }
+    downsampledAlignmentEnds.erase(downsampledAlignmentEnds.begin(),
+                                   downsampledAlignmentEnds.lower_bound(currentPosition - lastHaplotypeLength));
 
     // remove past registered alleles
     DEBUG2("marking previous alleles as processed and removing from registered alleles");
@@ -2799,39 +3052,122 @@ bool AlleleParser::toNextPosition(void) {
 
     // and do the same for the variants from the input VCF
     DEBUG2("erasing old input variant alleles");
-    map<long int, vector<Allele> >::iterator v = inputVariantAlleles.find(currentPosition - 3);
-    if (v != inputVariantAlleles.end()) {
-        inputVariantAlleles.erase(v);
-    }
+    inputVariantAlleles.erase(inputVariantAlleles.begin(), inputVariantAlleles.lower_bound(currentPosition - 2));
 
     DEBUG2("erasing old input haplotype basis alleles");
-    map<long int, vector<AllelicPrimitive> >::iterator z = haplotypeBasisAlleles.find(currentPosition - 3);
-    if (z != haplotypeBasisAlleles.end()) {
-        haplotypeBasisAlleles.erase(z);
-    }
+    haplotypeBasisAlleles.erase(haplotypeBasisAlleles.begin(), haplotypeBasisAlleles.lower_bound(currentPosition - 2));
 
     DEBUG2("erasing old genotype likelihoods");
-    map<long int, map<string, map<string, long double> > >::iterator l = inputGenotypeLikelihoods.find(currentPosition - 3);
-    if (l != inputGenotypeLikelihoods.end()) {
-        inputGenotypeLikelihoods.erase(l);
-    }
+    inputGenotypeLikelihoods.erase(inputGenotypeLikelihoods.begin(), inputGenotypeLikelihoods.lower_bound(currentPosition - 2));
 
     DEBUG2("erasing old allele frequencies");
-    map<long int, map<Allele, int> >::iterator af = inputAlleleCounts.find(currentPosition - 3);
-    if (af != inputAlleleCounts.end()) {
-        inputAlleleCounts.erase(af);
-    }
+    inputAlleleCounts.erase(inputAlleleCounts.begin(), inputAlleleCounts.lower_bound(currentPosition - 2));
 
     DEBUG2("erasing old cached repeat counts");
-    map<long int, map<string, int> >::iterator rc = cachedRepeatCounts.find(currentPosition - 3);
-    if (rc != cachedRepeatCounts.end()) {
-        cachedRepeatCounts.erase(rc);
-    }
+    cachedRepeatAnnotations.erase(cachedRepeatAnnotations.begin(), cachedRepeatAnnotations.lower_bound(currentPosition - 2));
 
     return true;
 
 }
 
+// moves currentPosition ahead over positions at which nothing can be called:
+// those at which neither a registered non-reference allele nor an input
+// variant starts.  alignments which start in the skipped span, including at
+// currentPosition itself, are registered as it is crossed, without stopping,
+// so that their alleles are indexed before we pass them.
+// the parser state which is updated per position in toNextPosition is all
+// keyed on positions at or behind currentPosition, so it is brought up to
+// date when toNextPosition continues at the position we stop at.
+// alignments which match the reference are not decomposed as they are
+// registered here, but only once we stop, and not at all if they have
+// passed out of the haplotype window by then.
+// input variants are loaded at most CACHED_BASIS_HAPLOTYPE_WINDOW bp ahead at
+// a time, however far the skip goes.
+void AlleleParser::skipToNextCandidatePosition(void) {
+
+    // every covered position may be reported
+    if (parameters.reportMonomorphic || parameters.trace || !parameters.skipToCandidatePositions) {
+        return;
+    }
+
+    while (true) {
+
+        candidatePositions.erase(candidatePositions.begin(),
+                                 candidatePositions.lower_bound(currentPosition));
+
+        long int nextPosition = 0;
+        bool found = false;
+        bool registering = false;
+
+        if (!candidatePositions.empty()) {
+            nextPosition = *candidatePositions.begin();
+            found = true;
+        }
+
+        // stop at the end of the target, where toNextPosition moves on
+        if (!targets.empty() && (!found || nextPosition > currentTarget->right)) {
+            nextPosition = currentTarget->right;
+            found = true;
+        }
+
+        // alignments starting at or before the next candidate may have
+        // alleles before it, so register them and then look again
+        if (hasMoreAlignments
+            && currentAlignment.RefID == currentRefID
+            && (!found || currentAlignment.Position <= nextPosition)) {
+            nextPosition = max(currentPosition, (long int) currentAlignment.Position);
+            found = true;
+            registering = true;
+        }
+
+        // nothing more in this sequence, so stop where the last registered
+        // alignment expires, triggering the end-of-sequence handling in
+        // toNextPosition
+        if (!found) {
+            registerDeferredAlignments();
+            if (registeredAlignments.empty()) {
+                return;
+            }
+            nextPosition = registeredAlignments.rbegin()->first + lastHaplotypeLength + 1;
+        }
+
+        if (usingVariantInputAlleles && nextPosition > currentPosition) {
+            // look no further ahead than the window; if no variant is in it,
+            // skip to its end and look again from there
+            long int windowEnd = currentPosition + CACHED_BASIS_HAPLOTYPE_WINDOW;
+            updateInputVariants(currentPosition, min(nextPosition, windowEnd) - currentPosition + 1);
+            map<long int, vector<Allele> >::iterator v = inputVariantAlleles.lower_bound(currentPosition);
+            if (v != inputVariantAlleles.end() && v->first < nextPosition) {
+                nextPosition = v->first;
+                registering = false;
+            } else if (nextPosition > windowEnd) {
+                currentPosition = windowEnd;
+                continue;
+            }
+        }
+
+        if (nextPosition < currentPosition
+            || (nextPosition == currentPosition && !registering)) {
+            return;
+        }
+
+        currentPosition = nextPosition;
+
+        if (!registering) {
+            return;
+        }
+
+        DEBUG2("registering alignments starting at skipped position " << (long unsigned int) currentPosition + 1);
+        preserveReferenceSequenceWindow(CACHED_REFERENCE_WINDOW);
+        vector<Allele*> newAlleles;
+        updateAlignmentQueue(currentPosition, newAlleles, false, canDeferAlignments());
+        addToRegisteredAlleles(newAlleles);
+        dropExpiredDeferredAlignments();
+
+    }
+
+}
+
 // XXX for testing only, steps targets but does nothing
 bool AlleleParser::dummyProcessNextTarget(void) {
 
@@ -2840,7 +3176,7 @@ bool AlleleParser::dummyProcessNextTarget(void) {
         return false;
     }
 
-    while (bamMultiReader.GetNextAlignment(currentAlignment)) {
+    while (bamMultiReader.GetNextAlignmentCore(currentAlignment)) {
     }
 
     return true;
@@ -3078,6 +3414,32 @@ void AlleleParser::buildHaplotypeAlleles(
         // boundary of the repeat.  We build the haplotype to the
         // maximal boundary indicated by the present alleles.
 
+        // the alignments which start or end within the haplotype window once
+        // it is long enough, in the order in which they are stored, each with
+        // the length the window must exceed to take it in.  they are found
+        // once, rather than by walking registeredAlignments position by
+        // position on every pass, and as the window only grows, each pass
+        // takes in the ones it has reached so far.
+        vector<pair<RegisteredAlignment*, long int> > windowAlignments;
+        long int maxAlignmentEnd = registeredAlignments.rbegin()->first;
+        for (map<long unsigned int, deque<RegisteredAlignment> >::iterator f = registeredAlignments.upper_bound(currentPosition);
+             f != registeredAlignments.end() && (long int) f->first < maxAlignmentEnd; ++f) {
+            deque<RegisteredAlignment>& ras = f->second;
+            for (deque<RegisteredAlignment>::iterator r = ras.begin(); r != ras.end(); ++r) {
+                RegisteredAlignment& ra = *r;
+                long int entryLength = -1;
+                if (ra.start > currentPosition) {
+                    entryLength = ra.start - currentPosition;
+                }
+                if (ra.end > currentPosition && (entryLength < 0 || ra.end - currentPosition < entryLength)) {
+                    entryLength = ra.end - currentPosition;
+                }
+                if (entryLength >= 0) {
+                    windowAlignments.push_back(make_pair(&ra, entryLength));
+                }
+            }
+        }
+
         int oldHaplotypeLength = haplotypeLength;
         do {
             oldHaplotypeLength = haplotypeLength;
@@ -3086,19 +3448,15 @@ void AlleleParser::buildHaplotypeAlleles(
             registeredAlleles.clear();
             samples.clear();
 
-            long int maxAlignmentEnd = registeredAlignments.rbegin()->first;
-            for (long int i = currentPosition+1; i < maxAlignmentEnd; ++i) {
-                deque<RegisteredAlignment>& ras = registeredAlignments[i];
-                for (deque<RegisteredAlignment>::iterator r = ras.begin(); r != ras.end(); ++r) {
-                    RegisteredAlignment& ra = *r;
-                    if (ra.start > currentPosition && ra.start < currentPosition + haplotypeLength
-                        || ra.end > currentPosition && ra.end < currentPosition + haplotypeLength) {
-                        Allele* aptr;
-                        bool allowPartials = true;
-                        ra.fitHaplotype(currentPosition, haplotypeLength, aptr, allowPartials);
-                        for (vector<Allele>::iterator a = ra.alleles.begin(); a != ra.alleles.end(); ++a) {
-                            registeredAlleles.push_back(&*a);
-                        }
+            for (vector<pair<RegisteredAlignment*, long int> >::iterator w = windowAlignments.begin();
+                 w != windowAlignments.end(); ++w) {
+                if (w->second < haplotypeLength) {
+                    RegisteredAlignment& ra = *w->first;
+                    Allele* aptr;
+                    bool allowPartials = true;
+                    ra.fitHaplotype(currentPosition, haplotypeLength, aptr, allowPartials);
+                    for (vector<Allele>::iterator a = ra.alleles.begin(); a != ra.alleles.end(); ++a) {
+                        addToRegisteredAlleles(&*a);
                     }
                 }
             }
@@ -3361,7 +3719,7 @@ void AlleleParser::buildHaplotypeAlleles(
             for (deque<RegisteredAlignment>::iterator rai = rq.begin(); rai != rq.end(); ++rai) {
                 RegisteredAlignment& ra = *rai;
                 for (vector<Allele>::iterator a = ra.alleles.begin(); a != ra.alleles.end(); ++a) {
-                    registeredAlleles.push_back(&*a);
+                    addToRegisteredAlleles(&*a);
                 }
             }
         }
@@ -3410,7 +3768,7 @@ bool AlleleParser::getCompleteObservationsOfHaplotype(Samples& samples, int hapl
                     DEBUG("could not fit observation " << ra.name << " with alleles " << ra.alleles);
                     // the alleles have (possibly) been changed in fithaplotype, so add them to the registered alleles again
                     for (vector<Allele>::iterator a = ra.alleles.begin(); a != ra.alleles.end(); ++a) {
-                        registeredAlleles.push_back(&*a);
+                        addToRegisteredAlleles(&*a);
                     }
                     }*/
             }
@@ -3487,6 +3845,11 @@ bool AlleleParser::getNextAlleles(Samples& samples, int allowedAlleleTypes) {
                 nextPosition = 0;
                 justSwitchedTargets = false;
             }
+            if (currentPosition >= nextPosition && !sufficientAlternateEvidence(allowedAlleleTypes)) {
+                DEBUG("insufficient alternate observations at " << currentSequenceName << ":" << currentPosition + 1);
+                nextPosition = currentPosition + 1;
+                continue;
+            }
             getAlleles(samples, allowedAlleleTypes);
         }
     }
@@ -3494,6 +3857,88 @@ bool AlleleParser::getNextAlleles(Samples& samples, int allowedAlleleTypes) {
     return true;
 }
 
+// Counts, per sample, the observations which getAlleles would return at this
+// position, without building Samples or updating any allele.  Returns false
+// only if no sample could satisfy the min-alternate-count, -fraction and -qsum
+// filters in genotypeAlleles (or the population the min-alternate-total), in
+// which case the position would be skipped by the caller anyway.  Counts err
+// towards passing: the reference sample and ploidy are not considered.
+bool AlleleParser::sufficientAlternateEvidence(int allowedAlleleTypes) {
+
+    if (parameters.reportMonomorphic || parameters.trace
+        || hasInputVariantAllelesAtCurrentPosition()) {
+        return true;
+    }
+
+    fill(alternateObservationCounts.begin(), alternateObservationCounts.end(), 0);
+    fill(alternateQualitySums.begin(), alternateQualitySums.end(), 0);
+    fill(referenceObservationCounts.begin(), referenceObservationCounts.end(), 0);
+
+    int totalAlternateCount = 0;
+    int sample = -1;
+    const string* sampleName = NULL;
+
+    for (vector<Allele*>::const_iterator a = registeredAlleles.begin(); a != registeredAlleles.end(); ++a) {
+        Allele& allele = **a;
+        if (!(allowedAlleleTypes & allele.type)) {
+            continue;
+        }
+        int quality;
+        if (allele.type == ALLELE_REFERENCE) {
+            if (allele.position > currentPosition || allele.position + allele.referenceLength <= currentPosition) {
+                continue;
+            }
+            // the quality update() would assign at this position
+            long int offset = currentPosition - allele.position;
+            quality = offset < allele.baseQualities.size() ? allele.baseQualities.at(offset) : 0;
+        } else {
+            if (allele.position != currentPosition) {
+                continue;
+            }
+            quality = allele.quality;
+        }
+        if (quality < parameters.BQL0) {
+            continue;
+        }
+        // alleles from the same read are adjacent, so the lookup is rarely needed
+        if (sampleName == NULL || *sampleName != allele.sampleID) {
+            map<string, int>::iterator s = sampleIndexes.find(allele.sampleID);
+            if (s == sampleIndexes.end()) {
+                s = sampleIndexes.insert(make_pair(allele.sampleID, (int) sampleIndexes.size())).first;
+                alternateObservationCounts.push_back(0);
+                alternateQualitySums.push_back(0);
+                referenceObservationCounts.push_back(0);
+            }
+            sample = s->second;
+            sampleName = &allele.sampleID;
+        }
+        if (allele.type == ALLELE_REFERENCE) {
+            ++referenceObservationCounts[sample];
+        } else {
+            ++alternateObservationCounts[sample];
+            alternateQualitySums[sample] += quality;
+            ++totalAlternateCount;
+        }
+    }
+
+    if (totalAlternateCount == 0 || totalAlternateCount < parameters.minAltTotal) {
+        return false;
+    }
+
+    for (int i = 0; i < alternateObservationCounts.size(); ++i) {
+        int alternateCount = alternateObservationCounts[i];
+        int observationCount = alternateCount + referenceObservationCounts[i];
+        if (alternateCount >= parameters.minAltCount
+            && alternateQualitySums[i] >= parameters.minAltQSum
+            && ((float) alternateCount / (float) observationCount) >= parameters.minAltFraction) {
+            return true;
+        }
+    }
+
+    return false;
+
+}
+
 void AlleleParser::getAlleles(Samples& samples, int allowedAlleleTypes,
                               int haplotypeLength, bool getAllAllelesInHaplotype,
                               bool ignoreProcessedFlag) {
@@ -3881,56 +4326,44 @@ int AlleleParser::homopolymerRunRight(string altbase) {
 
 }
 
-map<string, int> AlleleParser::repeatCounts(long int position, const string& sequence, int maxsize) {
-    map<string, int> counts;
-    for (int i = 1; i <= maxsize; ++i) {
-        // subseq here i bases
-        string seq = sequence.substr(position, i);
-        // go left.
-
-        int j = position - i;
-        int leftsteps = 0;
-        while (j >= 0 && seq == sequence.substr(j, i)) {
-            j -= i;
-            ++leftsteps;
-        }
-
-        // go right.
-        j = position;
-
-        int rightsteps = 0;
-        while (j + i <= sequence.size() && seq == sequence.substr(j, i)) {
-            j += i;
-            ++rightsteps;
+RepeatAnnotation& AlleleParser::repeatAnnotation(long int position) {
+    map<long int, RepeatAnnotation>::iterator a = cachedRepeatAnnotations.find(position);
+    if (a == cachedRepeatAnnotations.end()) {
+        a = cachedRepeatAnnotations.insert(make_pair(position, RepeatAnnotation())).first;
+        RepeatAnnotation& annotation = a->second;
+        bool indexed = false;
+        if (usingRepeatIndex) {
+            string units = referenceSubstr(position, 12);
+            // the index only holds repeats of A, C, G and T, so units which
+            // take in an N or other base are counted in the cached sequence
+            if (units.find_first_not_of("ACGT") == string::npos) {
+                // the index also gives the right boundaries, which are otherwise
+                // found in the cached sequence as they are needed
+                map<string, int> counts;
+                repeatIndex.repeatsAt(currentSequenceName, position, units,
+                                      counts, annotation.rightBoundaries);
+                annotation.counts = nonRedundantRepeatCounts(counts);
+                indexed = true;
+            }
         }
-        // if we went left and right a non-zero number of times, 
-        if (leftsteps + rightsteps > 1) {
-            counts[seq] = leftsteps + rightsteps;
+        if (!indexed) {
+            annotation.counts = repeatCounts(position - currentSequenceStart, currentSequence, 12);
         }
     }
+    return a->second;
+}
+
+// repeatCounts() at a reference position, over the whole reference when
+// using a repeat index, otherwise over the cached sequence
+map<string, int> AlleleParser::referenceRepeatCounts(long int position) {
+    return repeatAnnotation(position).counts;
+}
 
+// repeat units are compared in place, so the cost is linear in the length of
+// the repeats found for each unit size
+map<string, int> AlleleParser::repeatCounts(long int position, const string& sequence, int maxsize) {
     // filter out redundant repeat information
-    if (counts.size() > 1) {
-        map<string, int> filteredcounts;
-        map<string, int>::iterator c = counts.begin();
-        string prev = c->first;
-        filteredcounts[prev] = c->second;  // shortest sequence
-        ++c;
-        for (; c != counts.end(); ++c) {
-            int i = 0;
-            string seq = c->first;
-            while (i + prev.length() <= seq.length() && seq.substr(i, prev.length()) == prev) {
-                i += prev.length();
-            }
-            if (i < seq.length()) {
-                filteredcounts[seq] = c->second;
-                prev = seq;
-            }
-        }
-        return filteredcounts;
-    } else {
-        return counts;
-    }
+    return nonRedundantRepeatCounts(sequenceRepeatCounts(position, sequence, maxsize));
 }
 
 bool AlleleParser::isRepeatUnit(const string& seq, const string& unit) {
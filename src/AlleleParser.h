@@ -7,6 +7,8 @@
 #include <vector>
 #include <map>
 #include <deque>
+#include <queue>
+#include <set>
 #include <utility>
 #include <algorithm>
 #include <time.h>
@@ -28,6 +30,7 @@
 #include "CNV.h"
 #include "Result.h"
 #include "LeftAlign.h"
+#include "RepeatIndex.h"
 #include "Variant.h"
 #include "version_git.h"
 
@@ -79,6 +82,49 @@ public:
 
 };
 
+// the repeat structure of the reference at a position, shared by every indel
+// allele which starts there
+class RepeatAnnotation {
+public:
+    map<string, int> counts;                   // repeatCounts() at the position
+    map<string, long int> rightBoundaries;     // by repeat unit, 1 past the edge of the repeat, -1 if not found
+    map<long int, long int> entropyBoundaries; // right boundaries, extended until the repeat entropy is reached
+};
+
+// an alignment which matches the reference throughout, held back from
+// decomposition into alleles while the parser skips positions at which
+// nothing can be called
+class DeferredAlignment {
+public:
+    BamAlignment alignment;
+    string sampleName;
+    string sequencingTech;
+
+    DeferredAlignment(BamAlignment& alignment, string& sampleName, string& sequencingTech)
+        : alignment(alignment)
+        , sampleName(sampleName)
+        , sequencingTech(sequencingTech)
+    { }
+};
+
+// the end positions of one sample's alignments which cover the start of the
+// latest alignment, all of them and those kept under --max-coverage
+class SampleCoverage {
+public:
+    priority_queue<long int, vector<long int>, greater<long int> > all;
+    priority_queue<long int, vector<long int>, greater<long int> > kept;
+
+    // drop the alignments which end before position
+    void advance(long int position) {
+        while (!all.empty() && all.top() < position) {
+            all.pop();
+        }
+        while (!kept.empty() && kept.top() < position) {
+            kept.pop();
+        }
+    }
+};
+
 // functor to filter alleles outside of our analysis window
 class AlleleFilter {
 
@@ -121,6 +167,10 @@ bool operator<(const AllelicPrimitive& a, const AllelicPrimitive& b);
 
 void capBaseQuality(BamAlignment& alignment, int baseQualityCap);
 
+// the length of alignment.AlignedBases, computed from the CIGAR so that it is
+// available for alignments read with GetNextAlignmentCore
+int alignedBasesLength(BamAlignment& alignment);
+
 
 class AlleleParser {
 
@@ -172,6 +222,8 @@ public:
     map<long int, vector<AllelicPrimitive> > haplotypeBasisAlleles;  // this is in the current reference sequence
     bool usingHaplotypeBasisAlleles;
     bool usingVariantInputAlleles;
+    RepeatIndex repeatIndex; // --repeat-index
+    bool usingRepeatIndex;
     long int rightmostHaplotypeBasisAllelePosition;
     long int rightmostInputAllelePosition;
     void updateHaplotypeBasisAlleles(long int pos, int referenceLength);
@@ -187,16 +239,20 @@ public:
 		      string& sampleName,
 		      BamAlignment& alignment,
 		      string& sequencingTech,
-		      long double qual,
+		      ModelFloat qual,
 		      string& qualstr);
 
 
 
     vector<Allele*> registeredAlleles;
+    set<long int> candidatePositions; // start positions of registered non-reference alleles
     map<long unsigned int, deque<RegisteredAlignment> > registeredAlignments;
+    deque<DeferredAlignment> deferredAlignments; // registered while skipping, not yet decomposed
+    map<string, SampleCoverage> sampleCoverage; // by sample, for --max-coverage
+    set<long int> downsampledAlignmentEnds; // of alignments dropped by --max-coverage
     map<long int, vector<Allele> > inputVariantAlleles; // all variants present in the input VCF, as 'genotype' alleles
     //  position         sample     genotype  likelihood
-    map<long int, map<string, map<string, long double> > > inputGenotypeLikelihoods; // drawn from input VCF
+    map<long int, map<string, map<string, ModelFloat> > > inputGenotypeLikelihoods; // drawn from input VCF
     map<long int, map<Allele, int> > inputAlleleCounts; // drawn from input VCF
     Sample* nullSample;
 
@@ -228,6 +284,7 @@ public:
     vector<int> currentPloidies(Samples& samples);
     void loadBamReferenceSequenceNames(void);
     void loadFastaReference(void);
+    void loadRepeatIndex(void);
     void loadReferenceSequence(BedTarget*, int, int);
     void loadReferenceSequence(BamAlignment& alignment);
     void preserveReferenceSequenceWindow(int bp);
@@ -242,7 +299,16 @@ public:
     void initializeOutputFiles(void);
     RegisteredAlignment& registerAlignment(BamAlignment& alignment, RegisteredAlignment& ra, string& sampleName, string& sequencingTech);
     void clearRegisteredAlignments(void);
-    void updateAlignmentQueue(long int position, vector<Allele*>& newAlleles, bool gettingPartials = false);
+    void updateAlignmentQueue(long int position, vector<Allele*>& newAlleles,
+                              bool gettingPartials = false, bool deferring = false);
+    void queueAlignment(BamAlignment& alignment, string& sampleName, string& sequencingTech,
+                        vector<Allele*>& newAlleles);
+    bool downsampleAlignment(BamAlignment& alignment, string& sampleName);
+    bool downsampledAt(long int position);
+    bool matchesReference(BamAlignment& alignment);
+    bool canDeferAlignments(void);
+    void dropExpiredDeferredAlignments(void);
+    void registerDeferredAlignments(void);
     void updateInputVariants(long int pos, int referenceLength);
     void updateHaplotypeBasisAlleles(void);
     void removeAllelesWithoutReadSpan(vector<Allele*>& alleles, int probeLength, int haplotypeLength);
@@ -255,12 +321,14 @@ public:
                                 int allowedAlleleTypes, int haplotypeLength, Allele& refallele);
     void updateRegisteredAlleles(void);
     void addToRegisteredAlleles(vector<Allele*>& alleles);
+    void addToRegisteredAlleles(Allele* allele);
     void updatePriorAlleles(void);
     vector<BedTarget>* targetsInCurrentRefSeq(void);
     bool toNextRefID(void);
     bool loadTarget(BedTarget*);
     bool toFirstTargetPosition(void);
     bool toNextPosition(void);
+    void skipToNextCandidatePosition(void);
     bool getCompleteObservationsOfHaplotype(Samples& samples, int haplotypeLength, vector<Allele*>& haplotypeObservations);
     bool getPartialObservationsOfHaplotype(Samples& samples, int haplotypeLength, vector<Allele*>& partials);
     bool dummyProcessNextTarget(void);
@@ -270,6 +338,12 @@ public:
     int currentSequencePosition();
     void unsetAllProcessedFlags(void);
     bool getNextAlleles(Samples& allelesBySample, int allowedAlleleTypes);
+    // cheap test of the min-alternate filters, run before any Samples are built
+    bool sufficientAlternateEvidence(int allowedAlleleTypes);
+    map<string, int> sampleIndexes; // sample name -> index into the per-sample counts below
+    vector<int> alternateObservationCounts;
+    vector<int> alternateQualitySums;
+    vector<int> referenceObservationCounts;
 
     // builds up haplotype (longer, e.g. ref+snp+ref) alleles to match the longest allele in genotypeAlleles
     // updates vector<Allele>& alleles with the new alleles
@@ -290,7 +364,10 @@ public:
     int homopolymerRunLeft(string altbase);
     int homopolymerRunRight(string altbase);
     map<string, int> repeatCounts(long int position, const string& sequence, int maxsize);
-    map<long int, map<string, int> > cachedRepeatCounts; // cached version of previous
+    map<string, int> referenceRepeatCounts(long int position);
+    map<long int, RepeatAnnotation> cachedRepeatAnnotations; // by reference position
+    LeftAlignCache leftAlignCache; // realigned cigars of recent reads with indels
+    RepeatAnnotation& repeatAnnotation(long int position);
     bool isRepeatUnit(const string& seq, const string& unit);
     void setupVCFOutput(void);
     void setupVCFInput(void);
@@ -3,7 +3,45 @@
 #include "multipermute.h"
 
 
-long double
+void observationClasses(Sample& sample, Contamination& contaminations, ObservationClasses& classes) {
+
+    typedef pair<ContaminationEstimate*, pair<ModelFloat, ModelFloat> > ObservationKey;
+
+    for (set<string>::iterator c = sample.supportedAlleles.begin();
+         c != sample.supportedAlleles.end(); ++c) {
+
+        Sample::iterator si = sample.find(*c);
+        if (si != sample.end()) {
+            // the observations here share their base
+            map<ObservationKey, int> classIndex;
+            vector<Allele*>& alleles = si->second;
+            for (vector<Allele*>::iterator a = alleles.begin(); a != alleles.end(); ++a) {
+                Allele& obs = **a;
+                ContaminationEstimate* contamination = &contaminations.of(obs.readGroupID);
+                ObservationKey key = make_pair(contamination, make_pair(obs.lnquality, obs.lnmapQuality));
+                map<ObservationKey, int>::iterator k = classIndex.find(key);
+                if (k == classIndex.end()) {
+                    classIndex.insert(make_pair(key, (int) classes.size()));
+                    classes.push_back(ObservationClass(*a, contamination, false));
+                } else {
+                    ++classes[k->second].count;
+                }
+            }
+        }
+
+        map<string, vector<Allele*> >::iterator pi = sample.partialSupport.find(*c);
+        if (pi != sample.partialSupport.end()) {
+            vector<Allele*>& partials = pi->second;
+            for (vector<Allele*>::iterator a = partials.begin(); a != partials.end(); ++a) {
+                classes.push_back(ObservationClass(*a, &contaminations.of((*a)->readGroupID), true));
+            }
+        }
+    }
+
+}
+
+
+ModelFloat
 probObservedAllelesGivenGenotype(
         Sample& sample,
         Genotype& genotype,
@@ -13,16 +51,17 @@ probObservedAllelesGivenGenotype(
         bool standardGLs,
         vector<Allele>& genotypeAlleles,
         Contamination& contaminations,
-        map<string, double>& freqs
+        map<string, double>& freqs,
+        ObservationClasses& classes
     ) {
 
     int observationCount = sample.observationCount();
-    vector<long double> alleleProbs = genotype.alleleProbabilities(observationBias);
+    vector<ModelFloat> alleleProbs = genotype.alleleProbabilities(observationBias);
     vector<int> observationCounts = genotype.alleleObservationCounts(sample);
     int countOut = 0;
     double countIn = 0;
-    long double prodQout = 0;  // the probability that the reads not in the genotype are all wrong
-    long double probObsGivenGt = 0;
+    ModelFloat prodQout = 0;  // the probability that the reads not in the genotype are all wrong
+    ModelFloat probObsGivenGt = 0;
     
     if (standardGLs) {
         for (Sample::iterator s = sample.begin(); s != sample.end(); ++s) {
@@ -43,113 +82,86 @@ probObservedAllelesGivenGenotype(
             }
         }
     } else {
-        // problem.
-        // we should do this over all alleles
-        // which have partial support or full support.
-        // this is only over
-        vector<Allele*> emptyA;
-        vector<Allele*> emptyB;
-        for (set<string>::iterator c = sample.supportedAlleles.begin();
-             c != sample.supportedAlleles.end(); ++c) {
-
-            vector<Allele*>* alleles = &emptyA;
-            Sample::iterator si = sample.find(*c);
-            if (si != sample.end()) alleles = &si->second;
-
-            vector<Allele*>* partials = &emptyB;
-            map<string, vector<Allele*> >::iterator pi = sample.partialSupport.find(*c);
-            if (pi != sample.partialSupport.end()) partials = &pi->second;
-
-            bool onPartials = false;
-            vector<Allele*>::iterator a = alleles->begin();
-            bool hasPartials = !partials->empty();
-            for ( ; (!hasPartials && a != alleles->end()) || a != partials->end(); ++a) {
-                if (a == alleles->end()) {
-                    if (hasPartials) {
-                        a = partials->begin();
-                        onPartials = true;
-                    } else {
-                        break;
-                    }
-                }
-                Allele& obs = **a;
-                long double probi = 0;
-                ContaminationEstimate& contamination = contaminations.of(obs.readGroupID);
-                double scale = 1;
-                // note that this will underflow if we have mapping quality = 0
-                // we guard against this externally, by ignoring such alignments (quality has to be > MQL0)
-                long double qual = (1 - exp(obs.lnquality)) * (1 - exp(obs.lnmapQuality));
-                if (onPartials) {
-                    map<Allele*, set<Allele*> >::iterator r = sample.reversePartials.find(*a);
-                    if (r != sample.reversePartials.end()) {
-                        if (sample.reversePartials[*a].empty()) {
-                            cerr << "partial " << *a << " has empty reverse" << endl;
-                            exit(1);
-                        }
-                        //cerr << "partial " << *a << " supports potentially " << sample.reversePartials[*a].size() << " alleles : ";
-                        //for (set<Allele*>::iterator m = sample.reversePartials[*a].begin();
-                        //     m != sample.reversePartials[*a].end(); ++m) cerr << **m << " ";
-                        //cerr << endl;
-                        scale = (double)1/(double)sample.reversePartials[*a].size();
+        for (ObservationClasses::iterator k = classes.begin(); k != classes.end(); ++k) {
+            Allele* a = k->observation;
+            bool onPartials = k->partial;
+            Allele& obs = *a;
+            ModelFloat probi = 0;
+            ContaminationEstimate& contamination = *k->contamination;
+            double scale = 1;
+            // note that this will underflow if we have mapping quality = 0
+            // we guard against this externally, by ignoring such alignments (quality has to be > MQL0)
+            ModelFloat qual = (1 - exp(obs.lnquality)) * (1 - exp(obs.lnmapQuality));
+            if (onPartials) {
+                map<Allele*, set<Allele*> >::iterator r = sample.reversePartials.find(a);
+                if (r != sample.reversePartials.end()) {
+                    if (sample.reversePartials[a].empty()) {
+                        cerr << "partial " << a << " has empty reverse" << endl;
+                        exit(1);
                     }
+                    //cerr << "partial " << *a << " supports potentially " << sample.reversePartials[*a].size() << " alleles : ";
+                    //for (set<Allele*>::iterator m = sample.reversePartials[*a].begin();
+                    //     m != sample.reversePartials[*a].end(); ++m) cerr << **m << " ";
+                    //cerr << endl;
+                    scale = (double)1/(double)sample.reversePartials[a].size();
                 }
+            }
 
-                // TODO add partial obs, now that we have them recorded
-                // how does this work?
-                // each partial obs is recorded as supporting, but with observation probability scaled by the number of possible haplotypes it supports
-                bool isInGenotype = false;
+            // TODO add partial obs, now that we have them recorded
+            // how does this work?
+            // each partial obs is recorded as supporting, but with observation probability scaled by the number of possible haplotypes it supports
+            bool isInGenotype = false;
 
-                for (vector<Allele>::iterator b = genotypeAlleles.begin(); b != genotypeAlleles.end(); ++b) {
-                    Allele& allele = *b;
-                    const string& base = b->currentBase;
+            for (vector<Allele>::iterator b = genotypeAlleles.begin(); b != genotypeAlleles.end(); ++b) {
+                Allele& allele = *b;
+                const string& base = b->currentBase;
 
-                    long double q;
-                    if (obs.currentBase == base
-                        || (onPartials && sample.observationSupports(*a, &*b))) {
-                        isInGenotype = true;
-                        q = qual;
-                    } else {
-                        q = 1 - qual;
-                    }
+                ModelFloat q;
+                if (obs.currentBase == base
+                    || (onPartials && sample.observationSupports(a, &*b))) {
+                    isInGenotype = true;
+                    q = qual;
+                } else {
+                    q = 1 - qual;
+                }
 
-                    if (onPartials) {
-                        q *= scale; // distribute partial support evenly across supported haplotypes
-                    }
+                if (onPartials) {
+                    q *= scale; // distribute partial support evenly across supported haplotypes
+                }
 
-                    double asampl = genotype.alleleSamplingProb(base);
-                    //double freq = freqs[base];
+                double asampl = genotype.alleleSamplingProb(base);
+                //double freq = freqs[base];
 
-                    if (asampl == 0) {
-                        // scale by frequency of (this) possibly contaminating allele
-                        asampl = contamination.probRefGivenHomAlt;
-                    } else if (asampl == 1) {
-                        // scale by frequency of (other) possibly contaminating alleles
-                        asampl = 1 - contamination.probRefGivenHomAlt;
+                if (asampl == 0) {
+                    // scale by frequency of (this) possibly contaminating allele
+                    asampl = contamination.probRefGivenHomAlt;
+                } else if (asampl == 1) {
+                    // scale by frequency of (other) possibly contaminating alleles
+                    asampl = 1 - contamination.probRefGivenHomAlt;
+                } else {
+                    // to deal with polyploids
+                    // note that this reduces to 1 for diploid heterozygotes
+                    double scale = asampl / 0.5;
+                    // this term captures reference bias
+                    if (allele.isReference()) {
+                        asampl = scale * contamination.probRefGivenHet;
                     } else {
-                        // to deal with polyploids
-                        // note that this reduces to 1 for diploid heterozygotes
-                        double scale = asampl / 0.5;
-                        // this term captures reference bias
-                        if (allele.isReference()) {
-                            asampl = scale * contamination.probRefGivenHet;
-                        } else {
-                            asampl = 1 - (scale * contamination.probRefGivenHet);
-                        }
+                        asampl = 1 - (scale * contamination.probRefGivenHet);
                     }
+                }
 
-                    probi += asampl * q;
+                probi += asampl * q;
 
-                }
+            }
 
-                if (isInGenotype) {
-                    countIn += scale;
-                }
+            if (isInGenotype) {
+                countIn += k->count * scale;
+            }
 
-                // bound to (0,1]
-                if (probi > 0) {
-                    long double lnprobi = log(min(probi, (long double) 1.0));
-                    probObsGivenGt += lnprobi;
-                }
+            // bound to (0,1]
+            if (probi > 0) {
+                ModelFloat lnprobi = log(min(probi, (ModelFloat) 1.0));
+                probObsGivenGt += k->count * lnprobi;
             }
         }
     }
@@ -178,7 +190,152 @@ probObservedAllelesGivenGenotype(
 }
 
 
-vector<pair<Genotype*, long double> >
+// Kernels for low ploidies and few alleles, for the default (non-standard)
+// GLs.  This is the same calculation as above, but the terms which depend only
+// on the observation (its quality, contamination estimate and match against
+// each allele) are computed once and shared by all genotypes, and the
+// genotypes' allele sampling probabilities are looked up once per sample
+// rather than once per observation.  Ploidy is a template parameter so that
+// everything fits in fixed-size arrays.  The arithmetic is carried out in the
+// same order as above, so the results are identical to it.
+//
+// Only the likelihoods are specialised.  The genotyping search scores each
+// neighbour in closed form, from sums GenotypeCombo adjusts as a genotype is
+// swapped, at any ploidy, so it has no fixed-size variant.  VCF output runs
+// once per reported site and is left generic.
+
+// number of genotypes of each ploidy over MAX_KERNEL_ALLELES alleles
+template <int Ploidy> struct KernelGenotypeCapacity { };
+template <> struct KernelGenotypeCapacity<1> { enum { value = 4 }; };
+template <> struct KernelGenotypeCapacity<2> { enum { value = 10 }; };
+template <> struct KernelGenotypeCapacity<3> { enum { value = 20 }; };
+template <> struct KernelGenotypeCapacity<4> { enum { value = 35 }; };
+
+template <int Ploidy>
+vector<pair<Genotype*, ModelFloat> >
+probObservedAllelesGivenGenotypesOfPloidy(
+        Sample& sample,
+        vector<Genotype*>& genotypes,
+        double dependenceFactor,
+        vector<Allele>& genotypeAlleles,
+        ObservationClasses& classes
+    ) {
+
+    const int capacity = KernelGenotypeCapacity<Ploidy>::value;
+    int genotypeCount = genotypes.size();
+    int alleleCount = genotypeAlleles.size();
+    double samplingProbs[capacity][MAX_KERNEL_ALLELES];
+    double hetScales[capacity][MAX_KERNEL_ALLELES];
+    bool isReference[MAX_KERNEL_ALLELES];
+    ModelFloat probObsGivenGt[capacity];
+    double countIn = 0;
+
+    for (int b = 0; b < alleleCount; ++b) {
+        isReference[b] = genotypeAlleles[b].isReference();
+    }
+    for (int g = 0; g < genotypeCount; ++g) {
+        probObsGivenGt[g] = 0;
+        for (int b = 0; b < alleleCount; ++b) {
+            double asampl = genotypes[g]->alleleSamplingProb(genotypeAlleles[b].currentBase);
+            samplingProbs[g][b] = asampl;
+            // to deal with polyploids; this is 1 for diploid heterozygotes
+            hetScales[g][b] = asampl / 0.5;
+        }
+    }
+
+    for (ObservationClasses::iterator k = classes.begin(); k != classes.end(); ++k) {
+        Allele* a = k->observation;
+        bool onPartials = k->partial;
+        Allele& obs = *a;
+        ContaminationEstimate& contamination = *k->contamination;
+        double scale = 1;
+        ModelFloat qual = (1 - exp(obs.lnquality)) * (1 - exp(obs.lnmapQuality));
+        if (onPartials) {
+            map<Allele*, set<Allele*> >::iterator r = sample.reversePartials.find(a);
+            if (r != sample.reversePartials.end()) {
+                if (r->second.empty()) {
+                    cerr << "partial " << a << " has empty reverse" << endl;
+                    exit(1);
+                }
+                scale = (double)1/(double)r->second.size();
+            }
+        }
+
+        bool isInGenotype = false;
+        ModelFloat q[MAX_KERNEL_ALLELES];
+        for (int b = 0; b < alleleCount; ++b) {
+            if (obs.currentBase == genotypeAlleles[b].currentBase
+                || (onPartials && sample.observationSupports(a, &genotypeAlleles[b]))) {
+                isInGenotype = true;
+                q[b] = qual;
+            } else {
+                q[b] = 1 - qual;
+            }
+            if (onPartials) {
+                q[b] *= scale;
+            }
+        }
+
+        for (int g = 0; g < genotypeCount; ++g) {
+            ModelFloat probi = 0;
+            for (int b = 0; b < alleleCount; ++b) {
+                double asampl = samplingProbs[g][b];
+                if (asampl == 0) {
+                    asampl = contamination.probRefGivenHomAlt;
+                } else if (asampl == 1) {
+                    asampl = 1 - contamination.probRefGivenHomAlt;
+                } else if (isReference[b]) {
+                    asampl = hetScales[g][b] * contamination.probRefGivenHet;
+                } else {
+                    asampl = 1 - (hetScales[g][b] * contamination.probRefGivenHet);
+                }
+                probi += asampl * q[b];
+            }
+            if (probi > 0) {
+                probObsGivenGt[g] += k->count * log(min(probi, (ModelFloat) 1.0));
+            }
+        }
+
+        if (isInGenotype) {
+            countIn += k->count * scale;
+        }
+    }
+
+    vector<pair<Genotype*, ModelFloat> > results;
+    for (int g = 0; g < genotypeCount; ++g) {
+        if (countIn > 1) {
+            probObsGivenGt[g] *= (1 + (countIn - 1) * dependenceFactor) / countIn;
+        }
+        results.push_back(make_pair(genotypes[g], isinf(probObsGivenGt[g]) ? 0 : probObsGivenGt[g]));
+    }
+    return results;
+
+}
+
+// returns the common ploidy of the genotypes if a kernel above handles them, 0 otherwise
+int
+kernelPloidy(vector<Genotype*>& genotypes, vector<Allele>& genotypeAlleles) {
+    if (genotypes.empty() || genotypeAlleles.size() > MAX_KERNEL_ALLELES) {
+        return 0;
+    }
+    int ploidy = genotypes.front()->ploidy;
+    for (vector<Genotype*>::iterator g = genotypes.begin(); g != genotypes.end(); ++g) {
+        if ((*g)->ploidy != ploidy) {
+            return 0;
+        }
+    }
+    int capacity = 0;
+    switch (ploidy) {
+    case 1: capacity = KernelGenotypeCapacity<1>::value; break;
+    case 2: capacity = KernelGenotypeCapacity<2>::value; break;
+    case 3: capacity = KernelGenotypeCapacity<3>::value; break;
+    case 4: capacity = KernelGenotypeCapacity<4>::value; break;
+    default: break;
+    }
+    return genotypes.size() <= capacity ? ploidy : 0;
+}
+
+vector<pair<Genotype*, ModelFloat> >
 probObservedAllelesGivenGenotypes(
         Sample& sample,
         vector<Genotype*>& genotypes,
@@ -190,7 +347,27 @@ probObservedAllelesGivenGenotypes(
         Contamination& contaminations,
         map<string, double>& freqs
     ) {
-    vector<pair<Genotype*, long double> > results;
+    ObservationClasses classes;
+    if (!standardGLs) {
+        observationClasses(sample, contaminations, classes);
+        switch (kernelPloidy(genotypes, genotypeAlleles)) {
+        case 1:
+            return probObservedAllelesGivenGenotypesOfPloidy<1>(
+                sample, genotypes, dependenceFactor, genotypeAlleles, classes);
+        case 2:
+            return probObservedAllelesGivenGenotypesOfPloidy<2>(
+                sample, genotypes, dependenceFactor, genotypeAlleles, classes);
+        case 3:
+            return probObservedAllelesGivenGenotypesOfPloidy<3>(
+                sample, genotypes, dependenceFactor, genotypeAlleles, classes);
+        case 4:
+            return probObservedAllelesGivenGenotypesOfPloidy<4>(
+                sample, genotypes, dependenceFactor, genotypeAlleles, classes);
+        default:
+            break;
+        }
+    }
+    vector<pair<Genotype*, ModelFloat> > results;
     for (vector<Genotype*>::iterator g = genotypes.begin(); g != genotypes.end(); ++g) {
         results.push_back(
 	    make_pair(*g,
@@ -203,7 +380,8 @@ probObservedAllelesGivenGenotypes(
                       standardGLs,
                       genotypeAlleles,
                       contaminations,
-                      freqs)));
+                      freqs,
+                      classes)));
     }
     return results;
 }
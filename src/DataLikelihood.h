@@ -20,7 +20,29 @@
 
 using namespace std;
 
-long double
+// observations of a sample which the (non-standard) GLs cannot tell apart, as
+// they share a base, base and mapping quality and contamination estimate.  the
+// terms of each class are evaluated once and weighted by its count, so the
+// results match evaluating each observation up to rounding.  partial
+// observations each form a class of their own, as the alleles they support
+// depend on the observation.
+class ObservationClass {
+public:
+    Allele* observation; // the first of the class
+    ContaminationEstimate* contamination;
+    bool partial;
+    int count;
+
+    ObservationClass(Allele* o, ContaminationEstimate* c, bool p)
+        : observation(o), contamination(c), partial(p), count(1) { }
+};
+
+typedef vector<ObservationClass> ObservationClasses;
+
+// the classes of the full then partial observations of each supported allele
+void observationClasses(Sample& sample, Contamination& contaminations, ObservationClasses& classes);
+
+ModelFloat
 probObservedAllelesGivenGenotype(
         Sample& sample,
         Genotype& genotype,
@@ -30,9 +52,10 @@ probObservedAllelesGivenGenotype(
         bool standardGLs,
         vector<Allele>& genotypeAlleles,
         Contamination& contaminations,
-        map<string, double>& freqs);
+        map<string, double>& freqs,
+        ObservationClasses& classes); // of the sample, unused with standardGLs
 
-vector<pair<Genotype*, long double> >
+vector<pair<Genotype*, ModelFloat> >
 probObservedAllelesGivenGenotypes(
         Sample& sample,
         vector<Genotype*>& genotypes,
@@ -44,4 +67,11 @@ probObservedAllelesGivenGenotypes(
         Contamination& contaminations,
         map<string, double>& freqs);
 
+// the fixed-size kernels handle ploidy 1 to 4 over at most this many alleles
+#define MAX_KERNEL_ALLELES 4
+
+// the common ploidy of the genotypes if a fixed-size kernel handles them, 0 otherwise
+int
+kernelPloidy(vector<Genotype*>& genotypes, vector<Allele>& genotypeAlleles);
+
 #endif
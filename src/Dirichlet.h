@@ -2,7 +2,7 @@
 #include "Utility.h"
 #include "Sum.h"
 
-long double dirichletMaximumLikelihoodRatio(const vector<long double>& probs, const vector<int>& obs, long double s = (long double) 1.0);
-long double dirichlet(const vector<long double>& probs, const vector<int>& obs, long double s = (long double) 1.0);
-long double dirichletMaximumLikelihoodRatioln(const vector<long double>& probs, const vector<int>& obs, long double s = (long double) 1.0);
-long double dirichletln(const vector<long double>& probs, const vector<int>& obs, long double s = (long double) 1.0);
+ModelFloat dirichletMaximumLikelihoodRatio(const vector<ModelFloat>& probs, const vector<int>& obs, ModelFloat s = (ModelFloat) 1.0);
+ModelFloat dirichlet(const vector<ModelFloat>& probs, const vector<int>& obs, ModelFloat s = (ModelFloat) 1.0);
+ModelFloat dirichletMaximumLikelihoodRatioln(const vector<ModelFloat>& probs, const vector<int>& obs, ModelFloat s = (ModelFloat) 1.0);
+ModelFloat dirichletln(const vector<ModelFloat>& probs, const vector<int>& obs, ModelFloat s = (ModelFloat) 1.0);
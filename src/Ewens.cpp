@@ -1,10 +1,10 @@
 #include "Ewens.h"
 
 
-long double alleleFrequencyProbability(const map<int, int>& alleleFrequencyCounts, long double theta) {
+ModelFloat alleleFrequencyProbability(const map<int, int>& alleleFrequencyCounts, ModelFloat theta) {
 
     int M = 0;
-    long double p = 1;
+    ModelFloat p = 1;
 
     for (map<int, int>::const_iterator f = alleleFrequencyCounts.begin(); f != alleleFrequencyCounts.end(); ++f) {
         int frequency = f->first;
@@ -13,7 +13,7 @@ long double alleleFrequencyProbability(const map<int, int>& alleleFrequencyCount
         p *= (double) pow((double) theta, (double) count) / ((double) pow((double) frequency, (double) count) * factorial(count));
     }
 
-    long double thetaH = 1;
+    ModelFloat thetaH = 1;
     for (int h = 1; h < M; ++h)
         thetaH *= theta + h;
 
@@ -21,19 +21,19 @@ long double alleleFrequencyProbability(const map<int, int>& alleleFrequencyCount
 
 }
 
-AlleleFrequencyProbabilityCache alleleFrequencyProbabilityCache;
+RisingFactorialCache risingFactorialCache;
 
-long double alleleFrequencyProbabilityln(const map<int, int>& alleleFrequencyCounts, long double theta) {
-    return alleleFrequencyProbabilityCache.alleleFrequencyProbabilityln(alleleFrequencyCounts, theta);
+ModelFloat alleleFrequencyProbabilityln(const map<int, int>& alleleFrequencyCounts, ModelFloat theta) {
+    return __alleleFrequencyProbabilityln(alleleFrequencyCounts, theta);
 }
 
 // Implements Ewens' Sampling Formula, which provides probability of a given
 // partition of alleles in a sample from a population
-long double __alleleFrequencyProbabilityln(const map<int, int>& alleleFrequencyCounts, long double theta) {
+ModelFloat __alleleFrequencyProbabilityln(const map<int, int>& alleleFrequencyCounts, ModelFloat theta) {
 
     int M = 0; // multiplicity of site
-    long double p = 0;
-    long double thetaln = log(theta);
+    ModelFloat p = 0;
+    ModelFloat thetaln = risingFactorialCache.thetaln(theta);
 
     for (map<int, int>::const_iterator f = alleleFrequencyCounts.begin(); f != alleleFrequencyCounts.end(); ++f) {
         int frequency = f->first;
@@ -42,10 +42,8 @@ long double __alleleFrequencyProbabilityln(const map<int, int>& alleleFrequencyC
         p += powln(thetaln, count) - (powln(log(frequency), count) + factorialln(count));
     }
 
-    long double thetaH = 0;
-    for (int h = 1; h < M; ++h)
-        thetaH += log(theta + h);
+    ModelFloat thetaH = risingFactorialCache.risingFactorialln(theta, M);
 
-    return factorialln(M) - (thetaln + thetaH) + p;
+    return factorialln(M) - thetaH + p;
 
 }
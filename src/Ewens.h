@@ -1,4 +1,5 @@
 #include <map>
+#include <vector>
 #include <cmath>
 #include "Utility.h"
 
@@ -6,20 +7,37 @@ using namespace std;
 
 // genotype priors
 
-long double alleleFrequencyProbability(const map<int, int>& alleleFrequencyCounts, long double theta);
-long double alleleFrequencyProbabilityln(const map<int, int>& alleleFrequencyCounts, long double theta);
-long double __alleleFrequencyProbabilityln(const map<int, int>& alleleFrequencyCounts, long double theta);
+ModelFloat alleleFrequencyProbability(const map<int, int>& alleleFrequencyCounts, ModelFloat theta);
+ModelFloat alleleFrequencyProbabilityln(const map<int, int>& alleleFrequencyCounts, ModelFloat theta);
+ModelFloat __alleleFrequencyProbabilityln(const map<int, int>& alleleFrequencyCounts, ModelFloat theta);
 
-class AlleleFrequencyProbabilityCache : public map<map<int, int>, long double> {
+// ln(theta (theta + 1) ... (theta + M - 1)), the denominator of Ewens'
+// sampling formula.  theta is fixed for a run, so the prefix sums are
+// extended on demand and kept rather than recomputed for every partition.
+class RisingFactorialCache {
 public:
-    long double alleleFrequencyProbabilityln(const map<int, int>& counts, long double theta) {
-        map<map<int, int>, long double>::iterator p = find(counts);
-        if (p == end()) {
-            long double pln = __alleleFrequencyProbabilityln(counts, theta);
-            insert(make_pair(counts, pln));
-            return pln;
-        } else {
-            return p->second;
+    RisingFactorialCache(void) : theta(-1), thetaLn(0) { }
+    ModelFloat risingFactorialln(ModelFloat t, int M) {
+        setTheta(t);
+        while (prefix.size() <= (size_t) M) {
+            prefix.push_back(prefix.back() + log(theta + (prefix.size() - 1)));
+        }
+        return prefix[M];
+    }
+    ModelFloat thetaln(ModelFloat t) {
+        setTheta(t);
+        return thetaLn;
+    }
+private:
+    ModelFloat theta;
+    ModelFloat thetaLn;
+    vector<ModelFloat> prefix;
+    void setTheta(ModelFloat t) {
+        if (t != theta) {
+            theta = t;
+            thetaLn = log(theta);
+            prefix.clear();
+            prefix.push_back(0);
         }
     }
 };
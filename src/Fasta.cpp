@@ -221,12 +221,29 @@ FastaReference::FastaReference(string reffilename) {
 }
 */
 
-void FastaReference::open(string reffilename) {
+void FastaReference::open(string reffilename, bool usemmap) {
     filename = reffilename;
     if (!(file = fopen(filename.c_str(), "r"))) {
         cerr << "could not open " << filename << endl;
         exit(1);
     }
+    usingmmap = usemmap;
+    filemm = NULL;
+    filesize = 0;
+    if (usingmmap) {
+        struct stat stFileInfo;
+        if (fstat(fileno(file), &stFileInfo) != 0) {
+            cerr << "could not stat " << filename << endl;
+            exit(1);
+        }
+        filesize = stFileInfo.st_size;
+        void* mm = mmap(NULL, filesize, PROT_READ, MAP_SHARED, fileno(file), 0);
+        if (mm == MAP_FAILED) {
+            cerr << "could not memory-map " << filename << endl;
+            exit(1);
+        }
+        filemm = (char*) mm;
+    }
     index = new FastaIndex();
     struct stat stFileInfo; 
     string indexFileName = filename + index->indexFileExtension(); 
@@ -241,17 +258,32 @@ void FastaReference::open(string reffilename) {
 }
 
 FastaReference::~FastaReference(void) {
+    if (usingmmap) {
+        munmap(filemm, filesize);
+    }
     fclose(file);
     delete index;
 }
 
+// reads up to length bytes of the file from offset into seq, which the
+// caller has zeroed, from the mapping if there is one
+void FastaReference::readBytes(char* seq, long long offset, size_t length) {
+    if (usingmmap) {
+        if (offset >= 0 && (size_t) offset < filesize) {
+            memcpy(seq, filemm + offset, min(length, filesize - (size_t) offset));
+        }
+    } else {
+        fseek64(file, (off_t) offset, SEEK_SET);
+        fread(seq, sizeof(char), length, file);
+    }
+}
+
 string FastaReference::getSequence(string seqname) {
     FastaIndexEntry entry = index->entry(seqname);
     int newlines_in_sequence = entry.length / entry.line_blen;
     int seqlen = newlines_in_sequence  + entry.length;
     char* seq = (char*) calloc (seqlen + 1, sizeof(char));
-    fseek64(file, entry.offset, SEEK_SET);
-    fread(seq, sizeof(char), seqlen, file);
+    readBytes(seq, entry.offset, seqlen);
     seq[seqlen] = '\0';
     char* pbegin = seq;
     char* pend = seq + (seqlen/sizeof(char));
@@ -288,8 +320,7 @@ string FastaReference::getSubSequence(string seqname, int start, int length) {
     int newlines_inside = newlines_by_end - newlines_before;
     int seqlen = length + newlines_inside;
     char* seq = (char*) calloc (seqlen + 1, sizeof(char));
-    fseek64(file, (off_t) (entry.offset + newlines_before + start), SEEK_SET);
-    fread(seq, sizeof(char), (off_t) seqlen, file);
+    readBytes(seq, entry.offset + newlines_before + start, seqlen);
     seq[seqlen] = '\0';
     char* pbegin = seq;
     char* pend = seq + (seqlen/sizeof(char));
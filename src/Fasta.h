@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <string.h>
 
 using namespace std;
 
@@ -56,10 +58,16 @@ class FastaIndex : public map<string, FastaIndexEntry> {
 
 class FastaReference {
     public:
-        void open(string reffilename);
+        // with usemmap, the file is mapped into memory and sequence is copied
+        // out of the mapping, so that threads can share one reference
+        void open(string reffilename, bool usemmap = false);
         string filename;
         ~FastaReference(void);
         FILE* file;
+        bool usingmmap;
+        char* filemm;
+        size_t filesize;
+        void readBytes(char* seq, long long offset, size_t length);
         FastaIndex* index;
         vector<FastaIndexEntry> findSequencesStartingWith(string seqnameStart);
         string getSequence(string seqname);
@@ -223,24 +223,24 @@ bool Genotype::isHomozygousReference(void) {
 }
 
 // the probability of drawing each allele out of the genotype, ordered by allele
-vector<long double> Genotype::alleleProbabilities(void) {
-    vector<long double> probs;
+vector<ModelFloat> Genotype::alleleProbabilities(void) {
+    vector<ModelFloat> probs;
     for (vector<GenotypeElement>::const_iterator a = this->begin(); a != this->end(); ++a) {
-        probs.push_back((long double) a->count / (long double) ploidy);
+        probs.push_back((ModelFloat) a->count / (ModelFloat) ploidy);
     }
     return probs;
 }
 
 // the probability of drawing each allele out of the genotype, ordered by allele, adjusted for reference bias
-vector<long double> Genotype::alleleProbabilities(Bias& observationBias) {
-    vector<long double> probs;
+vector<ModelFloat> Genotype::alleleProbabilities(Bias& observationBias) {
+    vector<ModelFloat> probs;
     for (vector<GenotypeElement>::const_iterator a = this->begin(); a != this->end(); ++a) {
-	long double bias = 1;
+	ModelFloat bias = 1;
 	if (!a->allele.isReference()) {
 	    int alleleLengthDifference = a->allele.alternateSequence.size() - a->allele.referenceLength;
 	    bias = observationBias.bias(alleleLengthDifference);
 	}
-        probs.push_back(((long double) a->count / (long double) ploidy) * bias);
+        probs.push_back(((ModelFloat) a->count / (ModelFloat) ploidy) * bias);
     }
     normalizeSumToOne(probs);
     return probs;
@@ -341,15 +341,263 @@ bool operator<(Genotype& a, Genotype& b) {
     return false; // if the two are equal, then we return false per C++ convention
 }
 
+Genotype::Genotype(const GenotypeTemplate& shape, vector<Allele>& potentialAlleles, const vector<int>& order) {
+    ploidy = 0;
+    for (vector<int>::const_iterator i = order.begin(); i != order.end(); ++i) {
+        int count = shape.counts[*i];
+        if (count == 0) {
+            continue;
+        }
+        Allele& allele = potentialAlleles[*i];
+        this->push_back(GenotypeElement(allele, count));
+        alleles.insert(alleles.end(), count, allele);
+        alleleCounts[allele.currentBase] = count;
+        ploidy += count;
+    }
+    homozygous = shape.homozygous;
+    permutationsln = shape.permutationsln;
+}
+
+// the template with counts[i] copies of each allele i
+void setTemplateCounts(GenotypeTemplate& shape, int ploidy, vector<int>& counts) {
+    shape.counts = counts;
+    vector<int> elementCounts;
+    for (vector<int>::iterator c = counts.begin(); c != counts.end(); ++c) {
+        if (*c > 0) {
+            elementCounts.push_back(*c);
+        }
+    }
+    shape.homozygous = elementCounts.size() == 1;
+    shape.permutationsln = 0;
+    if (!shape.homozygous) {
+        shape.permutationsln = multinomialCoefficientLn(ploidy, elementCounts);
+    }
+}
+
+vector<GenotypeTemplate>* GenotypeTemplateCache::templates(int ploidy, int alleleCount) {
+    pair<int, int> key = make_pair(ploidy, alleleCount);
+    GenotypeTemplateCache::iterator t = find(key);
+    if (t != end()) {
+        return &t->second;
+    }
+    // the number of genotypes, (ploidy + alleleCount - 1) choose (alleleCount - 1)
+    double size = 1;
+    for (int i = 1; i < alleleCount && size <= GENOTYPE_TEMPLATE_CACHE_SIZE; ++i) {
+        size = size * (ploidy + i) / i;
+    }
+    if (size > GENOTYPE_TEMPLATE_CACHE_SIZE) {
+        return NULL;
+    }
+    if (templateCount + size > GENOTYPE_TEMPLATE_CACHE_SIZE) {
+        clear();
+        templateCount = 0;
+    }
+    vector<GenotypeTemplate>& shapes = (*this)[key];
+    vector<int> indexes;
+    for (int i = 0; i < alleleCount; ++i) {
+        indexes.push_back(i);
+    }
+    vector<vector<int> > combinations = multichoose(ploidy, indexes);
+    shapes.resize(combinations.size());
+    for (int i = 0; i < combinations.size(); ++i) {
+        vector<int> counts(alleleCount, 0);
+        for (vector<int>::iterator c = combinations[i].begin(); c != combinations[i].end(); ++c) {
+            ++counts[*c];
+        }
+        setTemplateCounts(shapes[i], ploidy, counts);
+    }
+    templateCount += shapes.size();
+    return &shapes;
+}
+
+GenotypeTemplateCache genotypeTemplateCache;
+
+// orders allele indexes by the alleles they refer to
+class AlleleIndexLess {
+public:
+    AlleleIndexLess(vector<Allele>& a) : alleles(a) { }
+    bool operator()(int a, int b) const {
+        return alleles[a] < alleles[b];
+    }
+private:
+    vector<Allele>& alleles;
+};
+
+// the allele indexes in sorted allele order.  false if two alleles are
+// equivalent, as these are grouped within genotypes, which templates can't express
+bool alleleOrder(vector<Allele>& potentialAlleles, vector<int>& order) {
+    order.clear();
+    for (int i = 0; i < potentialAlleles.size(); ++i) {
+        order.push_back(i);
+    }
+    sort(order.begin(), order.end(), AlleleIndexLess(potentialAlleles));
+    for (int i = 1; i < order.size(); ++i) {
+        if (potentialAlleles[order[i]] == potentialAlleles[order[i - 1]]) {
+            return false;
+        }
+    }
+    return true;
+}
+
 vector<Genotype> allPossibleGenotypes(int ploidy, vector<Allele>& potentialAlleles) {
     vector<Genotype> genotypes;
-    vector<vector<Allele> > alleleCombinations = multichoose(ploidy, potentialAlleles);
-    for (vector<vector<Allele> >::iterator combo = alleleCombinations.begin(); combo != alleleCombinations.end(); ++combo) {
-        genotypes.push_back(Genotype(*combo));
+    if (potentialAlleles.empty()) {
+        return genotypes;
+    }
+    vector<int> order;
+    vector<GenotypeTemplate>* shapes = NULL;
+    if (alleleOrder(potentialAlleles, order)) {
+        shapes = genotypeTemplateCache.templates(ploidy, potentialAlleles.size());
+    }
+    if (!shapes) {
+        // build from the alleles directly
+        vector<vector<Allele> > alleleCombinations = multichoose(ploidy, potentialAlleles);
+        for (vector<vector<Allele> >::iterator combo = alleleCombinations.begin(); combo != alleleCombinations.end(); ++combo) {
+            genotypes.push_back(Genotype(*combo));
+        }
+        return genotypes;
+    }
+    genotypes.reserve(shapes->size());
+    for (vector<GenotypeTemplate>::iterator s = shapes->begin(); s != shapes->end(); ++s) {
+        genotypes.push_back(Genotype(*s, potentialAlleles, order));
     }
     return genotypes;
 }
 
+// the genotype with counts[i] copies of each allele i
+Genotype genotypeFromCounts(
+    int ploidy,
+    vector<Allele>& potentialAlleles,
+    vector<int>& order,
+    bool useTemplates,
+    vector<int>& counts) {
+
+    if (useTemplates) {
+        GenotypeTemplate shape;
+        setTemplateCounts(shape, ploidy, counts);
+        return Genotype(shape, potentialAlleles, order);
+    } else {
+        vector<Allele> alleles;
+        alleles.reserve(ploidy);
+        for (int j = 0; j < counts.size(); ++j) {
+            alleles.insert(alleles.end(), counts[j], potentialAlleles[j]);
+        }
+        return Genotype(alleles);
+    }
+
+}
+
+// walks the allele count vectors within the bounds, choosing the count of one
+// allele at each level.  minRest and maxRest hold the least and greatest number
+// of copies the alleles after each level can take up, so every branch taken
+// leads to at least one genotype.
+void addBoundedGenotypes(
+    vector<Genotype>& genotypes,
+    int ploidy,
+    vector<Allele>& potentialAlleles,
+    vector<int>& order,
+    bool useTemplates,
+    vector<pair<int, int> >& bounds,
+    vector<int>& minRest,
+    vector<int>& maxRest,
+    vector<int>& counts,
+    int i,
+    int remaining) {
+
+    if (i == counts.size()) {
+        genotypes.push_back(genotypeFromCounts(ploidy, potentialAlleles, order, useTemplates, counts));
+        return;
+    }
+
+    int lo = max(bounds[i].first, remaining - maxRest[i + 1]);
+    int hi = min(bounds[i].second, remaining - minRest[i + 1]);
+    for (int c = lo; c <= hi; ++c) {
+        counts[i] = c;
+        addBoundedGenotypes(genotypes, ploidy, potentialAlleles, order, useTemplates,
+                            bounds, minRest, maxRest, counts, i + 1, remaining - c);
+    }
+
+}
+
+vector<Genotype> boundedGenotypes(int ploidy, vector<Allele>& potentialAlleles, vector<pair<int, int> >& bounds) {
+    vector<Genotype> genotypes;
+    if (potentialAlleles.empty()) {
+        return genotypes;
+    }
+    vector<int> order;
+    bool useTemplates = alleleOrder(potentialAlleles, order);
+    int n = potentialAlleles.size();
+    vector<int> minRest(n + 1, 0);
+    vector<int> maxRest(n + 1, 0);
+    for (int i = n - 1; i >= 0; --i) {
+        minRest[i] = minRest[i + 1] + bounds[i].first;
+        maxRest[i] = maxRest[i + 1] + bounds[i].second;
+    }
+    vector<int> counts(n, 0);
+    if (minRest.front() <= ploidy && maxRest.front() >= ploidy) {
+        addBoundedGenotypes(genotypes, ploidy, potentialAlleles, order, useTemplates,
+                            bounds, minRest, maxRest, counts, 0, ploidy);
+    }
+    // the homozygous genotypes are always included, as the homozygous combos
+    // used to estimate the probability of polymorphism are built from them
+    for (int i = 0; i < n; ++i) {
+        if (bounds[i].second == ploidy && minRest.front() == bounds[i].first) {
+            continue; // already generated
+        }
+        vector<int> homozygous(n, 0);
+        homozygous[i] = ploidy;
+        genotypes.push_back(genotypeFromCounts(ploidy, potentialAlleles, order, useTemplates, homozygous));
+    }
+    return genotypes;
+}
+
+bool observedGenotypeCountBounds(
+    vector<pair<int, int> >& bounds,
+    Sample& sample,
+    int ploidy,
+    vector<Allele>& potentialAlleles,
+    double band) {
+
+    double depth = sample.observationCount();
+    if (depth == 0) {
+        return false;
+    }
+    bounds.resize(potentialAlleles.size());
+    for (int i = 0; i < potentialAlleles.size(); ++i) {
+        Allele& allele = potentialAlleles[i];
+        int lo = 0;
+        int hi = ploidy;
+        if (!allele.isNull()) {
+            // the standard error of the observed frequency, plus one
+            // observation's worth so that unobserved alleles are not ruled out
+            double f = sample.observationCount(allele) / depth;
+            double halfwidth = band * sqrt(f * (1 - f) / depth) + 1 / depth;
+            lo = max(0, (int) floor(ploidy * (f - halfwidth)));
+            hi = min(ploidy, (int) ceil(ploidy * (f + halfwidth)));
+        }
+        bounds[i] = make_pair(lo, hi);
+    }
+    return true;
+
+}
+
+void addGenotypeCountBounds(vector<pair<int, int> >& bounds, vector<pair<int, int> >& other) {
+    for (int i = 0; i < bounds.size() && i < other.size(); ++i) {
+        bounds[i].first = min(bounds[i].first, other[i].first);
+        bounds[i].second = max(bounds[i].second, other[i].second);
+    }
+}
+
+bool withinGenotypeCountBounds(Genotype& genotype, vector<Allele>& potentialAlleles, vector<pair<int, int> >& bounds) {
+    for (int i = 0; i < potentialAlleles.size(); ++i) {
+        int count = genotype.alleleCount(potentialAlleles[i]);
+        if (count < bounds[i].first || count > bounds[i].second) {
+            return false;
+        }
+    }
+    return true;
+}
+
 
 int GenotypeCombo::numberOfAlleles(void) {
     int count = 0;
@@ -366,7 +614,7 @@ void GenotypeCombo::init(bool useObsExpectations) {
         const SampleDataLikelihood& sdl = **s;
         const Sample& sample = *sdl.sample;
 
-        ++genotypeCounts[sdl.genotype];
+        addGenotypeCount(sdl.genotype, 1);
 
         permutationsln += sdl.genotype->permutationsln;
 
@@ -375,41 +623,26 @@ void GenotypeCombo::init(bool useObsExpectations) {
 
             // allele frequencies in selected genotypes in combo
             AlleleCounter& alleleCounter = alleleCounters[alleleBase];
+            updateFrequencyCounts(alleleCounter.frequency, alleleCounter.frequency + a->count);
             alleleCounter.frequency += a->count;
 
             if (useObsExpectations) {
                 // observational frequencies for binomial priors
-                Sample::const_iterator as = sample.find(alleleBase);
-                if (as != sample.end()) {
-                    vector<Allele*> alleles = as->second;
-                    alleleCounter.observations += alleles.size();
-                    for (vector<Allele*>::iterator o = alleles.begin(); o != alleles.end(); ++o) {
-                        const Allele& allele = **o;
-                        if (allele.basesLeft >= allele.basesRight) {
-                            ++alleleCounter.placedLeft;
-                            if (allele.strand == STRAND_FORWARD) {
-                                ++alleleCounter.placedStart;
-                            } else {
-                                ++alleleCounter.placedEnd;
-                            }
-                        } else {
-                            ++alleleCounter.placedRight;
-                            if (allele.strand == STRAND_FORWARD) {
-                                ++alleleCounter.placedEnd;
-                            } else {
-                                ++alleleCounter.placedStart;
-                            }
-                        }
-                        if (allele.strand == STRAND_FORWARD) {
-                            ++alleleCounter.forwardStrand;
-                        } else {
-                            ++alleleCounter.reverseStrand;
-                        }
-                    }
-                }
+                const ObservationTally& tally = sample.observationTally(alleleBase);
+                alleleCounter.observations += tally.observations;
+                alleleCounter.placedLeft += tally.placedLeft;
+                alleleCounter.placedRight += tally.placedRight;
+                alleleCounter.placedStart += tally.placedStart;
+                alleleCounter.placedEnd += tally.placedEnd;
+                alleleCounter.forwardStrand += tally.forwardStrand;
+                alleleCounter.reverseStrand += tally.reverseStrand;
             }
         }
     }
+    updateHweSums();
+    if (useObsExpectations) {
+        updateObservationSums();
+    }
 }
 
 void GenotypeCombo::addPriorAlleleCounts(map<string, int>& priorACs) {
@@ -418,6 +651,7 @@ void GenotypeCombo::addPriorAlleleCounts(map<string, int>& priorACs) {
         int count = p->second;
         AlleleCounter& alleleCounter = alleleCounters[alleleBase];
         //cerr <<"init "<< alleleCounter.frequency;
+        updateFrequencyCounts(alleleCounter.frequency, alleleCounter.frequency + count);
         alleleCounter.frequency += count;
     }
 }
@@ -441,15 +675,15 @@ int GenotypeCombo::alleleCount(const string& allele) {
     }
 }
 
-long double GenotypeCombo::alleleFrequency(Allele& allele) {
-    return alleleCount(allele) / (long double) numberOfAlleles();
+ModelFloat GenotypeCombo::alleleFrequency(Allele& allele) {
+    return alleleCount(allele) / (ModelFloat) numberOfAlleles();
 }
 
-long double GenotypeCombo::alleleFrequency(const string& allele) {
-    return alleleCount(allele) / (long double) numberOfAlleles();
+ModelFloat GenotypeCombo::alleleFrequency(const string& allele) {
+    return alleleCount(allele) / (ModelFloat) numberOfAlleles();
 }
 
-long double GenotypeCombo::genotypeFrequency(Genotype* genotype) {
+ModelFloat GenotypeCombo::genotypeFrequency(Genotype* genotype) {
     map<Genotype*, int>::iterator g = genotypeCounts.find(genotype);
     if (g == genotypeCounts.end()) {
         return 0;
@@ -464,25 +698,14 @@ void GenotypeCombo::updateCachedCounts(
         Genotype* newGenotype,
         bool useObsExpectations) {
 
-    // update genotype counts
-    --genotypeCounts[oldGenotype];
-    ++genotypeCounts[newGenotype];
+    // update genotype counts, removing those which are now 0
+    addGenotypeCount(oldGenotype, -1);
+    addGenotypeCount(newGenotype, 1);
 
     // update permutations
     permutationsln -= oldGenotype->permutationsln;
     permutationsln += newGenotype->permutationsln;
 
-    // remove allele frequencies which are now 0 or below
-    map<Genotype*, int>::iterator gc = genotypeCounts.begin();
-    while (gc != genotypeCounts.end()) {
-        assert(gc->second >= 0);
-        if (gc->second == 0) {
-            genotypeCounts.erase(gc++);
-        } else {
-            ++gc;
-        }
-    }
-
     // TODO can we improve efficiency by only adjusting for bases which are actually changed
 
     // remove allele frequency information for old genotype
@@ -490,48 +713,21 @@ void GenotypeCombo::updateCachedCounts(
         GenotypeElement& ge = *g;
         const string& base = ge.allele.currentBase;
         AlleleCounter& alleleCounter = alleleCounters[base];
+        if (useObsExpectations) {
+            addObservationSums(alleleCounter, -1);
+        }
+        updateFrequencyCounts(alleleCounter.frequency, alleleCounter.frequency - ge.count);
         alleleCounter.frequency -= ge.count;
         if (useObsExpectations) {
-            Sample::iterator s = sample->find(base);
-            if (s != sample->end()) {
-                const vector<Allele*>& alleles = s->second;
-                alleleCounter.observations -= alleles.size();
-                int forward_strand = 0;
-                int reverse_strand = 0;
-                int placed_left = 0;
-                int placed_right = 0;
-                int placed_start = 0;
-                int placed_end = 0;
-                for (vector<Allele*>::const_iterator a = alleles.begin(); a != alleles.end(); ++a) {
-                    const Allele& allele = **a;
-                    if (allele.strand == STRAND_FORWARD) {
-                        ++forward_strand;
-                    } else {
-                        ++reverse_strand;
-                    }
-                    if (allele.basesLeft >= allele.basesRight) {
-                        ++placed_left;
-                        if (allele.strand == STRAND_FORWARD) {
-                            ++placed_start;
-                        } else {
-                            ++placed_end;
-                        }
-                    } else {
-                        ++placed_right;
-                        if (allele.strand == STRAND_FORWARD) {
-                            ++placed_end;
-                        } else {
-                            ++placed_start;
-                        }
-                    }
-                }
-                alleleCounter.forwardStrand -= forward_strand;
-                alleleCounter.reverseStrand -= reverse_strand;
-                alleleCounter.placedLeft -= placed_left;
-                alleleCounter.placedRight -= placed_right;
-                alleleCounter.placedStart -= placed_start;
-                alleleCounter.placedEnd -= placed_end;
-            }
+            const ObservationTally& tally = sample->observationTally(base);
+            alleleCounter.observations -= tally.observations;
+            alleleCounter.forwardStrand -= tally.forwardStrand;
+            alleleCounter.reverseStrand -= tally.reverseStrand;
+            alleleCounter.placedLeft -= tally.placedLeft;
+            alleleCounter.placedRight -= tally.placedRight;
+            alleleCounter.placedStart -= tally.placedStart;
+            alleleCounter.placedEnd -= tally.placedEnd;
+            addObservationSums(alleleCounter, 1);
         }
     }
 
@@ -540,48 +736,21 @@ void GenotypeCombo::updateCachedCounts(
         GenotypeElement& ge = *g;
         const string& base = ge.allele.currentBase;
         AlleleCounter& alleleCounter = alleleCounters[base];
+        if (useObsExpectations) {
+            addObservationSums(alleleCounter, -1);
+        }
+        updateFrequencyCounts(alleleCounter.frequency, alleleCounter.frequency + ge.count);
         alleleCounter.frequency += ge.count;
         if (useObsExpectations) {
-            Sample::iterator s = sample->find(base);
-            if (s != sample->end()) {
-                const vector<Allele*>& alleles = s->second;
-                alleleCounter.observations += alleles.size();
-                int forward_strand = 0;
-                int reverse_strand = 0;
-                int placed_left = 0;
-                int placed_right = 0;
-                int placed_start = 0;
-                int placed_end = 0;
-                for (vector<Allele*>::const_iterator a = alleles.begin(); a != alleles.end(); ++a) {
-                    const Allele& allele = **a;
-                    if (allele.strand == STRAND_FORWARD) {
-                        ++forward_strand;
-                    } else {
-                        ++reverse_strand;
-                    }
-                    if (allele.basesLeft >= allele.basesRight) {
-                        ++placed_left;
-                        if (allele.strand == STRAND_FORWARD) {
-                            ++placed_start;
-                        } else {
-                            ++placed_end;
-                        }
-                    } else {
-                        ++placed_right;
-                        if (allele.strand == STRAND_FORWARD) {
-                            ++placed_end;
-                        } else {
-                            ++placed_start;
-                        }
-                    }
-                }
-                alleleCounter.forwardStrand += forward_strand;
-                alleleCounter.reverseStrand += reverse_strand;
-                alleleCounter.placedLeft += placed_left;
-                alleleCounter.placedRight += placed_right;
-                alleleCounter.placedStart += placed_start;
-                alleleCounter.placedEnd += placed_end;
-            }
+            const ObservationTally& tally = sample->observationTally(base);
+            alleleCounter.observations += tally.observations;
+            alleleCounter.forwardStrand += tally.forwardStrand;
+            alleleCounter.reverseStrand += tally.reverseStrand;
+            alleleCounter.placedLeft += tally.placedLeft;
+            alleleCounter.placedRight += tally.placedRight;
+            alleleCounter.placedStart += tally.placedStart;
+            alleleCounter.placedEnd += tally.placedEnd;
+            addObservationSums(alleleCounter, 1);
         }
     }
 
@@ -591,6 +760,9 @@ void GenotypeCombo::updateCachedCounts(
         assert(af->second.frequency >= 0);
         if (af->second.frequency == 0) {
             assert(af->second.observations == 0);
+            if (useObsExpectations) {
+                addObservationSums(af->second, -1);
+            }
             alleleCounters.erase(af++);
         } else {
             ++af;
@@ -599,18 +771,133 @@ void GenotypeCombo::updateCachedCounts(
 
 }
 
+// the frequency spectrum is maintained as allele counts change, so that
+// Ewens' sampling formula can be evaluated without walking alleleCounters
 map<int, int> GenotypeCombo::countFrequencies(void) {
-    map<int, int> frequencyCounts;
-    for (map<string, AlleleCounter>::iterator a = alleleCounters.begin(); a != alleleCounters.end(); ++a) {
-        const AlleleCounter& allele = a->second;
-        map<int, int>::iterator c = frequencyCounts.find(allele.frequency);
-        if (c != frequencyCounts.end()) {
-            c->second += 1;
-        } else {
-            frequencyCounts[allele.frequency] = 1;
+    return frequencyCounts;
+}
+
+// moves one allele from oldFrequency to newFrequency in the spectrum, and
+// updates the allele total and ln(frequency!) sum read by the priors
+// alleles at frequency 0 are not part of the partition
+void GenotypeCombo::updateFrequencyCounts(int oldFrequency, int newFrequency) {
+    if (oldFrequency == newFrequency) {
+        return;
+    }
+    alleleTotal += newFrequency - oldFrequency;
+    alleleCountFactorialsln -= factorialln(oldFrequency);
+    alleleCountFactorialsln += factorialln(newFrequency);
+    if (oldFrequency > 0) {
+        map<int, int>::iterator c = frequencyCounts.find(oldFrequency);
+        assert(c != frequencyCounts.end());
+        if (--c->second == 0) {
+            frequencyCounts.erase(c);
         }
     }
-    return frequencyCounts;
+    if (newFrequency > 0) {
+        ++frequencyCounts[newFrequency];
+    }
+}
+
+// adjusts the count of the genotype in the combo, dropping it when it reaches
+// 0, and updates the summaries used by hweComboProb
+void GenotypeCombo::addGenotypeCount(Genotype* genotype, int delta) {
+    map<Genotype*, int>::iterator g = genotypeCounts.find(genotype);
+    int oldCount = (g == genotypeCounts.end()) ? 0 : g->second;
+    int newCount = oldCount + delta;
+    assert(newCount >= 0);
+    if (newCount == 0) {
+        if (g != genotypeCounts.end()) {
+            genotypeCounts.erase(g);
+        }
+    } else if (g == genotypeCounts.end()) {
+        genotypeCounts[genotype] = newCount;
+    } else {
+        g->second = newCount;
+    }
+
+    // haploid genotypes contribute nothing to the HWE prior
+    if (genotype->ploidy == 1 || oldCount == newCount) {
+        return;
+    }
+    PloidyGenotypeCounter& counter = ploidyGenotypeCounters[genotype->ploidy];
+    counter.samples += delta;
+    counter.countFactorialsln -= factorialln(oldCount);
+    counter.countFactorialsln += factorialln(newCount);
+    if (oldCount == 0) {
+        ++counter.genotypes;
+        hwePermutationsln += genotype->permutationsln;
+    } else if (newCount == 0) {
+        --counter.genotypes;
+        hwePermutationsln -= genotype->permutationsln;
+    }
+}
+
+// recomputes the floating point HWE sums from genotypeCounts, which
+// addGenotypeCount otherwise adjusts as genotypes come and go
+void GenotypeCombo::updateHweSums(void) {
+    hwePermutationsln = 0;
+    for (map<int, PloidyGenotypeCounter>::iterator c = ploidyGenotypeCounters.begin(); c != ploidyGenotypeCounters.end(); ++c) {
+        c->second.countFactorialsln = 0;
+    }
+    for (map<Genotype*, int>::iterator g = genotypeCounts.begin(); g != genotypeCounts.end(); ++g) {
+        Genotype* genotype = g->first;
+        if (genotype->ploidy != 1) {
+            ploidyGenotypeCounters[genotype->ploidy].countFactorialsln += factorialln(g->second);
+            hwePermutationsln += genotype->permutationsln;
+        }
+    }
+}
+
+ModelFloat observationPriorln(const AlleleCounter& alleleCounter) {
+    int obs = alleleCounter.observations;
+    return halfBinomialProbln(alleleCounter.forwardStrand, obs)
+        +  halfBinomialProbln(alleleCounter.placedLeft, obs)
+        +  halfBinomialProbln(alleleCounter.placedStart, obs);
+}
+
+// ln(f^o / o!) for an allele of frequency f with o observations, its part of
+// the allele balance prior, multinomialSamplingProbLn(alleleProbs(), observationCounts())
+ModelFloat alleleBalanceTermln(const AlleleCounter& alleleCounter) {
+    int obs = alleleCounter.observations;
+    if (obs == 0) {
+        return 0;
+    }
+    return powln(log((ModelFloat) alleleCounter.frequency), obs) - factorialln(obs);
+}
+
+// adds (sign 1) or removes (sign -1) the allele's terms in the sums over
+// observations
+void GenotypeCombo::addObservationSums(const AlleleCounter& alleleCounter, int sign) {
+    observationPriorsln += sign * observationPriorln(alleleCounter);
+    alleleBalanceSumln += sign * alleleBalanceTermln(alleleCounter);
+    observationsTotal += sign * alleleCounter.observations;
+}
+
+// recomputes the sums over observations from alleleCounters, which
+// updateCachedCounts otherwise adjusts as genotypes are swapped
+void GenotypeCombo::updateObservationSums(void) {
+    observationPriorsln = 0;
+    alleleBalanceSumln = 0;
+    observationsTotal = 0;
+    for (map<string, AlleleCounter>::iterator ac = alleleCounters.begin(); ac != alleleCounters.end(); ++ac) {
+        addObservationSums(ac->second, 1);
+    }
+}
+
+void GenotypeCombo::restoreSums(GenotypeCombo& other) {
+    probObsGivenGenotypes = other.probObsGivenGenotypes;
+    permutationsln = other.permutationsln;
+    hwePermutationsln = other.hwePermutationsln;
+    alleleCountFactorialsln = other.alleleCountFactorialsln;
+    observationPriorsln = other.observationPriorsln;
+    alleleBalanceSumln = other.alleleBalanceSumln;
+    // the same genotypes give the same ploidies
+    map<int, PloidyGenotypeCounter>::iterator c = ploidyGenotypeCounters.begin();
+    map<int, PloidyGenotypeCounter>::iterator o = other.ploidyGenotypeCounters.begin();
+    for (; c != ploidyGenotypeCounters.end() && o != other.ploidyGenotypeCounters.end(); ++c, ++o) {
+        c->second.countFactorialsln = o->second.countFactorialsln;
+    }
 }
 
 vector<int> GenotypeCombo::counts(void) {
@@ -661,9 +948,9 @@ int GenotypeCombo::ploidy(void) {
     return copies;
 }
 
-vector<long double> GenotypeCombo::alleleProbs(void) {
-    vector<long double> probs;
-    long double copies = ploidy();
+vector<ModelFloat> GenotypeCombo::alleleProbs(void) {
+    vector<ModelFloat> probs;
+    ModelFloat copies = ploidy();
     for (map<string, AlleleCounter>::iterator a = alleleCounters.begin(); a != alleleCounters.end(); ++a) {
         const AlleleCounter& allele = a->second;
         probs.push_back(allele.frequency / copies);
@@ -689,6 +976,7 @@ void sortSampleDataLikelihoods(vector<SampleDataLikelihood>& likelihoods) {
     sort(likelihoods.begin(), likelihoods.end(), datalikelihoodCompare);
     int i = 0;
     for (vector<SampleDataLikelihood>::iterator sdl = likelihoods.begin(); sdl != likelihoods.end(); ++sdl) {
+        sdl->index = i;
         sdl->rank = i++;
     }
 }
@@ -767,14 +1055,14 @@ void
 dataLikelihoodMaxGenotypeCombo(
     GenotypeCombo& combo,
     SampleDataLikelihoods& sampleDataLikelihoods,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar) {
+    ModelFloat diffusionPriorScalar) {
 
     for (SampleDataLikelihoods::iterator s = sampleDataLikelihoods.begin();
             s != sampleDataLikelihoods.end(); ++s) {
@@ -802,14 +1090,14 @@ makeComboByDatalLikelihoodRank(
     SampleDataLikelihoods& variantSampleDataLikelihoods,
     SampleDataLikelihoods& invariantSampleDataLikelihoods,
     map<string, int>& priorACs,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar) {
+    ModelFloat diffusionPriorScalar) {
 
     // generate the best genotype combination according to data
     // likelihoods
@@ -845,6 +1133,117 @@ makeComboByDatalLikelihoodRank(
 
 }
 
+void
+warmStartPosition(
+    vector<int>& initialPosition,
+    SampleDataLikelihoods& sampleDataLikelihoods,
+    map<string, int>& previousAlternateCounts,
+    string& referenceBase) {
+
+    initialPosition.clear();
+    for (SampleDataLikelihoods::iterator s = sampleDataLikelihoods.begin();
+            s != sampleDataLikelihoods.end(); ++s) {
+        vector<SampleDataLikelihood>& sdls = *s;
+        int offset = 0;
+        map<string, int>::iterator p = previousAlternateCounts.find(sdls.front().name);
+        if (p != previousAlternateCounts.end()) {
+            for (int i = 0; i < sdls.size(); ++i) {
+                Genotype* genotype = sdls.at(i).genotype;
+                if (genotype->ploidy - genotype->alleleCount(referenceBase) == p->second) {
+                    offset = i;
+                    break;
+                }
+            }
+        }
+        initialPosition.push_back(offset);
+    }
+
+}
+
+string genotypingSearchName(GenotypingSearch search) {
+    switch (search) {
+        case GENOTYPING_SEARCH_EXHAUSTIVE:
+            return "exhaustive";
+        case GENOTYPING_SEARCH_BANDED:
+            return "banded";
+        case GENOTYPING_SEARCH_APPROXIMATE:
+            return "approximate";
+        default:
+            return "unknown";
+    }
+}
+
+// The cost model counts genotype evaluations.  Each neighbour scored by the
+// exhaustive local search swaps a single sample's genotype, and costs about
+// one evaluation; each banded combo walks every sample, so costs nsamples.
+// Once the search converges the neighbours of the best combo are generated
+// again and kept, at the cost of a copy of the combo (nsamples) each, and
+// marginalizing over them costs as much again.
+double
+genotypingSearchCost(
+    GenotypingSearch search,
+    SampleDataLikelihoods& sampleDataLikelihoods,
+    int iterations,
+    int banddepth,
+    bool marginals) {
+
+    double nsamples = sampleDataLikelihoods.size();
+    double neighbors = 0;
+    for (SampleDataLikelihoods::iterator s = sampleDataLikelihoods.begin();
+            s != sampleDataLikelihoods.end(); ++s) {
+        neighbors += s->size() - 1;
+    }
+
+    double perIteration = 0;
+    double kept = 0;
+    switch (search) {
+        case GENOTYPING_SEARCH_EXHAUSTIVE:
+            perIteration = neighbors;
+            kept = neighbors;
+            break;
+        case GENOTYPING_SEARCH_BANDED:
+            // bandwidth 1: the king, and each sample at each depth below it
+            kept = 1 + max(banddepth - 1, 0) * nsamples;
+            perIteration = kept * nsamples;
+            break;
+        case GENOTYPING_SEARCH_APPROXIMATE:
+            perIteration = neighbors;
+            kept = neighbors;
+            iterations = 1;
+            break;
+        default:
+            break;
+    }
+
+    double cost = iterations * perIteration + kept * nsamples;
+    if (marginals) {
+        cost += kept * nsamples;
+    }
+    return cost;
+
+}
+
+GenotypingSearch
+chooseGenotypingSearch(
+    SampleDataLikelihoods& sampleDataLikelihoods,
+    int iterations,
+    int banddepth,
+    bool marginals,
+    double maxWork) {
+
+    if (genotypingSearchCost(GENOTYPING_SEARCH_EXHAUSTIVE, sampleDataLikelihoods,
+                             iterations, banddepth, marginals) <= maxWork) {
+        return GENOTYPING_SEARCH_EXHAUSTIVE;
+    } else if (banddepth > 0
+               && genotypingSearchCost(GENOTYPING_SEARCH_BANDED, sampleDataLikelihoods,
+                                       iterations, banddepth, marginals) <= maxWork) {
+        return GENOTYPING_SEARCH_BANDED;
+    } else {
+        return GENOTYPING_SEARCH_APPROXIMATE;
+    }
+
+}
+
 // 'local' genotype combinations which step only in one sample away from the
 // data likelihood maxiumum.  deal with all genotypes.
 void
@@ -854,14 +1253,14 @@ allLocalGenotypeCombinations(
     SampleDataLikelihoods& sampleDataLikelihoods,
     Samples& samples,
     map<string, int>& priorACs,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar,
+    ModelFloat diffusionPriorScalar,
     bool keepCombos) {
 
     // make the data likelihood maximum if needed
@@ -889,6 +1288,50 @@ allLocalGenotypeCombinations(
         combos.push_back(comboKing);
     }
 
+    // when only the best combo is kept, score each neighbour in place on a
+    // copy of the comboKing, swapping the sample's new genotype in and the old
+    // one back out again, and copy only those neighbours which beat the best
+    // combo so far
+    if (!keepCombos) {
+        GenotypeCombo neighbor = comboKing;
+        size_t sampleOffset = 0;
+        for (SampleDataLikelihoods::iterator s = sampleDataLikelihoods.begin();
+                s != sampleDataLikelihoods.end(); ++s, ++sampleOffset) {
+            SampleDataLikelihood& oldsdl = *comboKing.at(sampleOffset);
+            vector<SampleDataLikelihood>& sdls = *s;
+            for (vector<SampleDataLikelihood>::iterator dl = sdls.begin(); dl != sdls.end(); ++dl) {
+                SampleDataLikelihood& newsdl = *dl;
+                if (newsdl.genotype == oldsdl.genotype) {  // don't duplicate the comboKing
+                    continue;
+                }
+                neighbor.updateCachedCounts(oldsdl.sample,
+                        oldsdl.genotype, newsdl.genotype,
+                        binomialObsPriors);
+                neighbor.at(sampleOffset) = &*dl;
+                ModelFloat diff = oldsdl.prob - newsdl.prob;
+                neighbor.probObsGivenGenotypes -= diff;
+                neighbor.calculatePosteriorProbability(theta,
+                                                pooled,
+                                                ewensPriors,
+                                                permute,
+                                                hwePriors,
+                                                binomialObsPriors,
+                                                alleleBalancePriors,
+                                                diffusionPriorScalar);
+                // ties go to the earlier combo
+                if (combos.front().posteriorProb < neighbor.posteriorProb) {
+                    combos.front() = neighbor;
+                }
+                neighbor.updateCachedCounts(oldsdl.sample,
+                        newsdl.genotype, oldsdl.genotype,
+                        binomialObsPriors);
+                neighbor.at(sampleOffset) = &oldsdl;
+                neighbor.restoreSums(comboKing);
+            }
+        }
+        return;
+    }
+
     // for each sampledatalikelihood
     // add a combo for each genotype where the combo is one step from the comboKing
     size_t sampleOffset = 0;
@@ -914,7 +1357,7 @@ allLocalGenotypeCombinations(
             // replace genotype with new genotype
             combo.at(sampleOffset) = &*dl;
             // find data likelihood difference from ComboKing
-            long double diff = oldsdl.prob - newsdl.prob;
+            ModelFloat diff = oldsdl.prob - newsdl.prob;
             // adjust combination total data likelihood
             combo.probObsGivenGenotypes -= diff;
             combo.calculatePosteriorProbability(theta,
@@ -925,17 +1368,6 @@ allLocalGenotypeCombinations(
                                             binomialObsPriors,
                                             alleleBalancePriors,
                                             diffusionPriorScalar);
-            // TODO
-            // memory-saving intervention, improve this
-            // difficult if we want to calculate marginals...
-            if (!keepCombos) {
-		// we should only have two combos in the list now...
-		if (combos.front().posteriorProb < combos.back().posteriorProb) {
-		    combos.pop_front();
-		} else {
-		    combos.pop_back();
-		}
-            }
         }
     }
 
@@ -954,14 +1386,14 @@ bandedGenotypeCombinations(
     Samples& samples,
     map<string, int>& priorACs,
     int bandwidth, int banddepth,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar,
+    ModelFloat diffusionPriorScalar,
     bool keepCombos) {
 
     // get the number of samples that vary
@@ -1024,6 +1456,12 @@ bandedGenotypeCombinations(
     }
     vector<vector<int> > deviations = multichoose(bandwidth, depths);
 
+    // scratch combo for scoring when only the best combo is kept
+    GenotypeCombo neighbor;
+    if (!keepCombos) {
+        neighbor = comboKing;
+    }
+
     // skip the first vector, which will always be the same as the
     // combo king, and has been pushed into our combinations already
     for (vector<vector<int> >::iterator d = deviations.begin(); d != deviations.end(); ++d) {
@@ -1034,8 +1472,12 @@ bandedGenotypeCombinations(
         }
         vector<vector<int> > indexPermutations = multipermute(indexes);
         for (vector<vector<int> >::const_iterator p = indexPermutations.begin(); p != indexPermutations.end(); ++p) {
-            combos.push_back(comboKing); // copy the king, and then we'll modify it according to the indicies
-            GenotypeCombo& combo = combos.back();
+            // when only the best combo is kept, score in place and swap the
+            // king's genotypes back in afterwards, as in allLocalGenotypeCombinations
+            if (keepCombos) {
+                combos.push_back(comboKing); // copy the king, and then we'll modify it according to the indicies
+            }
+            GenotypeCombo& combo = keepCombos ? combos.back() : neighbor;
             GenotypeCombo::iterator sampleGenotypeItr = combo.begin();
             vector<int>::const_iterator n = p->begin();
             for (SampleDataLikelihoods::iterator s = variantSampleDataLikelihoods.begin();
@@ -1057,7 +1499,7 @@ bandedGenotypeCombinations(
                     // replace genotype with new genotype
                     oldsdl_ptr = newsdl;
                     // find data likelihood difference from ComboKing
-                    long double diff = oldsdl.prob - newsdl->prob;
+                    ModelFloat diff = oldsdl.prob - newsdl->prob;
                     // adjust combination total data likelihood
                     combo.probObsGivenGenotypes -= diff;
                 }
@@ -1070,13 +1512,23 @@ bandedGenotypeCombinations(
                                             binomialObsPriors,
                                             alleleBalancePriors,
                                             diffusionPriorScalar);
-            if (!keepCombos && combos.size()  > 1) {
-                // we should only have two combos in the list now...
-                if (combos.front().posteriorProb < combos.back().posteriorProb) {
-                    combos.pop_front();
-                } else {
-                    combos.pop_back();
+            if (!keepCombos) {
+                // ties go to the earlier combo
+                if (combos.empty()) {
+                    combos.push_back(neighbor);
+                } else if (combos.front().posteriorProb < neighbor.posteriorProb) {
+                    combos.front() = neighbor;
+                }
+                GenotypeCombo::iterator k = comboKing.begin();
+                for (GenotypeCombo::iterator g = neighbor.begin(); g != neighbor.end(); ++g, ++k) {
+                    if (*g != *k) {
+                        neighbor.updateCachedCounts((*k)->sample,
+                                (*g)->genotype, (*k)->genotype,
+                                binomialObsPriors);
+                        *g = *k;
+                    }
                 }
+                neighbor.restoreSums(comboKing);
             }
         }
     }
@@ -1099,14 +1551,14 @@ convergentGenotypeComboSearch(
     vector<Allele>& genotypeAlleles,
     map<string, int>& priorACs,
     int bandwidth, int banddepth,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar,
+    ModelFloat diffusionPriorScalar,
     int maxiterations,
     int& totaliterations,
     bool addHomozygousCombos) {
@@ -1264,14 +1716,14 @@ void addAllHomozygousCombos(
     SampleDataLikelihoods& invariantSampleDataLikelihoods,
     Samples& samples,
     vector<Allele>& genotypeAlleles,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar) {
+    ModelFloat diffusionPriorScalar) {
 
     // determine which homozygous combos we already have
 
@@ -1358,47 +1810,68 @@ void addAllHomozygousCombos(
 }
 
 // conditional probability of the genotype combination given the represented allele frequencies
-long double GenotypeCombo::probabilityGivenAlleleFrequencyln(bool permute) {
+ModelFloat GenotypeCombo::probabilityGivenAlleleFrequencyln(bool permute) {
 
     //return -multinomialCoefficientLn(numberOfAlleles(), counts());
 
-    int n = numberOfAlleles();
-    long double lnhetscalar = 0;
+    ModelFloat lnhetscalar = 0;
 
     if (permute) {
         // scale by the product of permutations of heterozygotes
         lnhetscalar = permutationsln; // cached permutations of this combo
     }
 
-    return lnhetscalar - multinomialCoefficientLn(n, counts());
+    // multinomialCoefficientLn(numberOfAlleles(), counts()), from the sums
+    // maintained by updateFrequencyCounts
+    return lnhetscalar - (factorialln(alleleTotal) - alleleCountFactorialsln);
 
 }
 
-long double GenotypeCombo::hweComboProb(void) {
-    long double comboHweProb = 0;
-    for (map<Genotype*, int>::iterator gc = genotypeCounts.begin(); gc != genotypeCounts.end(); ++gc) {
-        Genotype* genotype = gc->first;
-        comboHweProb += hweProbGenotypeFrequencyln(genotype);
+// the sum of hweProbGenotypeFrequencyln over the distinct genotypes in the
+// combo.  for each genotype g of ploidy p != 1 that term is
+//
+//   permutationsln(g) + ln(T_p! / prod ln(n_h!)) - ln(N! / prod(f_a!))
+//
+// where T_p is the number of samples of ploidy p, n_h the counts of the
+// genotypes of that ploidy, N the number of alleles and f_a their counts.
+// haploid genotypes contribute 0.  the genotype side is maintained by
+// addGenotypeCount and the allele side by updateFrequencyCounts, so a single
+// sample's genotype swap costs O(ploidies) rather than O(genotypes * alleles).
+ModelFloat GenotypeCombo::hweComboProb(void) {
+
+    ModelFloat comboHweProb = hwePermutationsln;
+    int genotypes = 0;
+    for (map<int, PloidyGenotypeCounter>::iterator p = ploidyGenotypeCounters.begin(); p != ploidyGenotypeCounters.end(); ++p) {
+        const PloidyGenotypeCounter& counter = p->second;
+        if (counter.genotypes > 0) {
+            comboHweProb += counter.genotypes * (factorialln(counter.samples) - counter.countFactorialsln);
+            genotypes += counter.genotypes;
+        }
     }
+
+    if (genotypes > 0) {
+        comboHweProb -= genotypes * (factorialln(alleleTotal) - alleleCountFactorialsln);
+    }
+
     return comboHweProb;
 }
 
 // probability of the combo under HWE
-long double GenotypeCombo::hweExpectedFrequencyln(Genotype* genotype) {
+ModelFloat GenotypeCombo::hweExpectedFrequencyln(Genotype* genotype) {
 
     int ploidy = genotype->ploidy;
 
     vector<int> genotypeAlleleCounts;
-    vector<long double> alleleFrequencies;
+    vector<ModelFloat> alleleFrequencies;
     for (map<string, AlleleCounter>::iterator a = alleleCounters.begin(); a != alleleCounters.end(); ++a) {
         genotypeAlleleCounts.push_back(genotype->alleleCount(a->first));
-        alleleFrequencies.push_back((long double) a->second.frequency / (long double) numberOfAlleles());
+        alleleFrequencies.push_back((ModelFloat) a->second.frequency / (ModelFloat) numberOfAlleles());
     }
 
-    long double HWECoefficientln = multinomialCoefficientLn(ploidy, genotypeAlleleCounts);
+    ModelFloat HWECoefficientln = multinomialCoefficientLn(ploidy, genotypeAlleleCounts);
 
     vector<int>::iterator c = genotypeAlleleCounts.begin();
-    vector<long double>::iterator f = alleleFrequencies.begin();
+    vector<ModelFloat>::iterator f = alleleFrequencies.begin();
     for (; c != genotypeAlleleCounts.end(); ++c, ++f) {
          HWECoefficientln += powln(log(*f), *c);
     }
@@ -1409,7 +1882,7 @@ long double GenotypeCombo::hweExpectedFrequencyln(Genotype* genotype) {
 
 // probability that the genotype count in the combo is what it is given the
 // counts of the other alleles
-long double GenotypeCombo::hweProbGenotypeFrequencyln(Genotype* genotype) {
+ModelFloat GenotypeCombo::hweProbGenotypeFrequencyln(Genotype* genotype) {
 
     //cout << endl << *genotype << endl;
 
@@ -1441,10 +1914,10 @@ long double GenotypeCombo::hweProbGenotypeFrequencyln(Genotype* genotype) {
         }
     }
 
-    long double arrangementsOfAllelesInSample = multinomialCoefficientLn(popTotalAlleles, popAlleleCounts);
+    ModelFloat arrangementsOfAllelesInSample = multinomialCoefficientLn(popTotalAlleles, popAlleleCounts);
     //cout << "arrangementsOfAllelesInSample = " << exp(arrangementsOfAllelesInSample) << endl;
 
-    long double arrangementsWithExactlyCountGenotypesGivenAF =
+    ModelFloat arrangementsWithExactlyCountGenotypesGivenAF =
         multinomialCoefficientLn(genotype->ploidy, thisGenotypeAlleleCounts)
         + multinomialCoefficientLn(popTotalGenotypes, popGenotypeCounts);
     /*
@@ -1467,14 +1940,14 @@ long double GenotypeCombo::hweProbGenotypeFrequencyln(Genotype* genotype) {
 //
 void
 GenotypeCombo::calculatePosteriorProbability(
-        long double theta,
+        ModelFloat theta,
         bool pooled,
         bool ewensPriors,
         bool permute,
         bool hwePriors,
         bool binomialObsPriors,
         bool alleleBalancePriors,
-        long double diffusionPriorScalar) {
+        ModelFloat diffusionPriorScalar) {
 
     posteriorProb = 0;
     priorProb = 0;
@@ -1492,43 +1965,24 @@ GenotypeCombo::calculatePosteriorProbability(
 
     // XXX XXX hwe
     if (hwePriors) {
-        for (map<Genotype*, int>::iterator gc = genotypeCounts.begin(); gc != genotypeCounts.end(); ++gc) {
-            Genotype* genotype = gc->first;
-            priorProbGenotypesGivenHWE += hweProbGenotypeFrequencyln(genotype);
-        }
+        priorProbGenotypesGivenHWE = hweComboProb();
     }
 
     if (binomialObsPriors) {
-        // for each alternate and the reference allele
-        // calculate the binomial probability that we see the given strand balance and read placement prob
-        // cerr << *combo << endl;
-        for (map<string, AlleleCounter>::iterator ac = alleleCounters.begin(); ac != alleleCounters.end(); ++ac) {
-            //const string& allele = ac->first;
-            const AlleleCounter& alleleCounter = ac->second;
-            int obs = alleleCounter.observations;
-            /*
-            cerr << allele <<  " counts: " << alleleCounter.frequency
-                << " observations " << alleleCounter.observations
-                << " " << alleleCounter.forwardStrand
-                << "," << alleleCounter.reverseStrand
-                << " " << alleleCounter.placedLeft
-                << "," << alleleCounter.placedRight
-                << " " << alleleCounter.placedStart
-                << "," << alleleCounter.placedEnd
-                << endl;
-                */
-
-            priorProbObservations
-                += binomialProbln(alleleCounter.forwardStrand, obs, 0.5)
-		    +  binomialProbln(alleleCounter.placedLeft, obs, 0.5)
-		    +  binomialProbln(alleleCounter.placedStart, obs, 0.5);
-        }
+        // for each alternate and the reference allele, the binomial
+        // probability of its strand balance and read placement, summed by
+        // init and updateCachedCounts
+        priorProbObservations += observationPriorsln;
     }
 
     // ok... now do the same move for the observation counts
     // --- this should capture "Allele Balance"
+    // multinomialSamplingProbLn(alleleProbs(), observationCounts()), from the
+    // sums maintained by addObservationSums
     if (alleleBalancePriors) {
-        priorProbObservations += multinomialSamplingProbLn(alleleProbs(), observationCounts());
+        priorProbObservations += factorialln(observationsTotal)
+            - powln(log((ModelFloat) alleleTotal), observationsTotal)
+            + alleleBalanceSumln;
     }
 
     // with larger population samples, the effect of
@@ -1541,7 +1995,7 @@ GenotypeCombo::calculatePosteriorProbability(
 
     // Ewens' Sampling Formula
     if (ewensPriors) {
-        priorProbAf = alleleFrequencyProbabilityln(countFrequencies(), theta);
+        priorProbAf = alleleFrequencyProbabilityln(frequencyCounts, theta);
     }
 
     // posterior probability
@@ -1582,14 +2036,14 @@ void orderedGenotypeCombo(
     GenotypeCombo& combo,
     GenotypeCombo& orderedCombo,
     SampleDataLikelihoods& sampleDataLikelihoods,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar) {
+    ModelFloat diffusionPriorScalar) {
 
     GenotypeComboMap bestComboMap;
 
@@ -1684,14 +2138,22 @@ bool Genotype::sampleHasSupportingObservationsForAllAlleles(Sample& sample) {
 }
 
 
-map<int, vector<Genotype> > getGenotypesByPloidy(vector<int>& ploidies, vector<Allele>& genotypeAlleles) {
+map<int, vector<Genotype> > getGenotypesByPloidy(
+    vector<int>& ploidies,
+    vector<Allele>& genotypeAlleles,
+    map<int, vector<pair<int, int> > >& countBounds) {
 
     map<int, vector<Genotype> > genotypesByPloidy;
 
     for (vector<int>::iterator p = ploidies.begin(); p != ploidies.end(); ++p) {
         int ploidy = *p;
         if (genotypesByPloidy.find(ploidy) == genotypesByPloidy.end()) {
-            genotypesByPloidy[ploidy] = allPossibleGenotypes(ploidy, genotypeAlleles);
+            map<int, vector<pair<int, int> > >::iterator b = countBounds.find(ploidy);
+            if (b != countBounds.end()) {
+                genotypesByPloidy[ploidy] = boundedGenotypes(ploidy, genotypeAlleles, b->second);
+            } else {
+                genotypesByPloidy[ploidy] = allPossibleGenotypes(ploidy, genotypeAlleles);
+            }
         }
     }
 
@@ -1731,6 +2193,7 @@ void GenotypeCombo::appendIndependentCombo(GenotypeCombo& other) {
         const string& allele = c->first;
         AlleleCounter& otherCounter = c->second;
         AlleleCounter& thisCounter = alleleCounters[allele];
+        updateFrequencyCounts(thisCounter.frequency, thisCounter.frequency + otherCounter.frequency);
         thisCounter.frequency += otherCounter.frequency;
         thisCounter.observations += otherCounter.observations;
         thisCounter.forwardStrand += otherCounter.forwardStrand;
@@ -1744,8 +2207,10 @@ void GenotypeCombo::appendIndependentCombo(GenotypeCombo& other) {
     for (GenotypeCombo::iterator s = begin(); s != end(); ++s) {
         const SampleDataLikelihood& sdl = **s;
         const Sample& sample = *sdl.sample;
-        ++genotypeCounts[sdl.genotype];
+        addGenotypeCount(sdl.genotype, 1);
     }
+    updateHweSums();
+    updateObservationSums();
 
     // permutations
     permutationsln += other.permutationsln;
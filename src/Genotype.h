@@ -39,6 +39,16 @@ public:
 };
 
 
+// the shape of a genotype, which depends only on the ploidy and the number of
+// candidate alleles: the count of each allele, by index
+class GenotypeTemplate {
+public:
+    vector<int> counts;
+    bool homozygous;
+    ModelFloat permutationsln;
+};
+
+
 class Genotype : public vector<GenotypeElement> {
 
     friend ostream& operator<<(ostream& out, const pair<Allele, int>& rhs);
@@ -51,7 +61,7 @@ public:
     vector<Allele> alleles;
     map<string, int> alleleCounts;
     bool homozygous;
-    long double permutationsln;  // aka, multinomialCoefficientLn(ploidy, counts())
+    ModelFloat permutationsln;  // aka, multinomialCoefficientLn(ploidy, counts())
 
     Genotype(vector<Allele>& ungroupedAlleles) {
         alleles = ungroupedAlleles;
@@ -71,6 +81,10 @@ public:
 
     }
 
+    // binds a template to the site's alleles; order gives the allele indexes
+    // in sorted order, which is the order of elements in a genotype
+    Genotype(const GenotypeTemplate& shape, vector<Allele>& potentialAlleles, const vector<int>& order);
+
     vector<Allele> uniqueAlleles(void);
     int getPloidy(void);
     int alleleCount(const string& base);
@@ -81,8 +95,8 @@ public:
     vector<string> alternateBases(string& refbase);
     vector<int> counts(void);
     // the probability of drawing each allele out of the genotype, ordered by allele
-    vector<long double> alleleProbabilities(void);
-    vector<long double> alleleProbabilities(Bias& observationBias);
+    vector<ModelFloat> alleleProbabilities(void);
+    vector<ModelFloat> alleleProbabilities(Bias& observationBias);
     double alleleSamplingProb(const string& base);
     double alleleSamplingProb(Allele& allele);
     string str(void) const;
@@ -108,23 +122,61 @@ public:
 string IUPAC(Genotype& g);
 string IUPAC2GenotypeStr(string iupac);
 
+// the most genotype templates held at once.  sets larger than this are not
+// cached, and the genotypes are built from the alleles directly
+#define GENOTYPE_TEMPLATE_CACHE_SIZE 100000
+
+// genotype templates by (ploidy, number of alleles), enumerated on first use.
+// the cache is emptied when adding a set would take it over
+// GENOTYPE_TEMPLATE_CACHE_SIZE templates.
+class GenotypeTemplateCache : public map<pair<int, int>, vector<GenotypeTemplate> > {
+public:
+    GenotypeTemplateCache(void) : templateCount(0) { }
+    // NULL if there are more than GENOTYPE_TEMPLATE_CACHE_SIZE templates
+    vector<GenotypeTemplate>* templates(int ploidy, int alleleCount);
+private:
+    long int templateCount;
+};
+
 vector<Genotype> allPossibleGenotypes(int ploidy, vector<Allele>& potentialAlleles);
 
+// genotypes whose count of each allele i lies within [bounds[i].first,
+// bounds[i].second], generated without enumerating the rest of the space
+vector<Genotype> boundedGenotypes(int ploidy, vector<Allele>& potentialAlleles, vector<pair<int, int> >& bounds);
+
+// sets bounds to the allele counts, in a genotype of the given ploidy, within
+// band standard errors of the frequencies observed in the sample.  returns
+// false, leaving bounds alone, if the sample has no observations
+bool observedGenotypeCountBounds(
+    vector<pair<int, int> >& bounds,
+    Sample& sample,
+    int ploidy,
+    vector<Allele>& potentialAlleles,
+    double band);
+
+// widens bounds to admit the counts within other
+void addGenotypeCountBounds(vector<pair<int, int> >& bounds, vector<pair<int, int> >& other);
+
+// true if the count of each allele in the genotype lies within bounds
+bool withinGenotypeCountBounds(Genotype& genotype, vector<Allele>& potentialAlleles, vector<pair<int, int> >& bounds);
+
 class SampleDataLikelihood {
 public:
     string name;
     Genotype* genotype;
-    long double prob;
-    long double marginal;
+    ModelFloat prob;
+    ModelFloat marginal;
     Sample* sample;
     bool hasObservations;
     int rank; // the rank of this data likelihood relative to others for the sample, 0 is best
-    SampleDataLikelihood(string n, Sample* s, Genotype* g, long double p, int r)
+    int index; // the rank it was given when the sample's likelihoods were built, kept when they are reordered
+    SampleDataLikelihood(string n, Sample* s, Genotype* g, ModelFloat p, int r)
         : name(n)
         , sample(s)
         , genotype(g)
         , prob(p)
         , rank(r)
+        , index(r)
         , marginal(0)
         , hasObservations(true)
     { }
@@ -161,15 +213,33 @@ public:
     { }
 };
 
+// the binomial priors on the strand, placement and position balance of the
+// observations of an allele
+ModelFloat observationPriorln(const AlleleCounter& alleleCounter);
+ModelFloat alleleBalanceTermln(const AlleleCounter& alleleCounter);
+
+// per-ploidy genotype count summaries, used to maintain the HWE prior as
+// genotypes are swapped in and out of a GenotypeCombo
+struct PloidyGenotypeCounter {
+    int genotypes;  // distinct genotypes of this ploidy in the combo
+    int samples;    // samples carrying a genotype of this ploidy
+    ModelFloat countFactorialsln; // sum of ln(count!) over those genotypes
+    PloidyGenotypeCounter(void)
+        : genotypes(0)
+        , samples(0)
+        , countFactorialsln(0)
+    { }
+};
+
 // a combination of genotypes for the population of samples in the analysis
 class GenotypeCombo : public vector<SampleDataLikelihood*> {
 public:
     // GenotypeCombo::prob is equal to the sum of probs in the combo.  We
     // factor it out so that we can construct the probabilities efficiently as
     // we generate the genotype combinations
-    long double probObsGivenGenotypes;  // aka data likelihood
+    ModelFloat probObsGivenGenotypes;  // aka data likelihood
 
-    long double permutationsln;  // the number of perutations of unphased genotypes in the combo
+    ModelFloat permutationsln;  // the number of perutations of unphased genotypes in the combo
 
     // these *must* be generated at construction time
     // for efficiency they can be updated as each genotype combo is generated
@@ -179,6 +249,15 @@ public:
     //map<string, pair<int, int> > alleleReadPositionCounts; // map from allele spec to (left, right) counts
     map<string, AlleleCounter> alleleCounters;
     map<Genotype*, int> genotypeCounts;
+    map<int, int> frequencyCounts; // number of alleles at each frequency, kept in step with alleleCounters
+    map<int, PloidyGenotypeCounter> ploidyGenotypeCounters; // kept in step with genotypeCounts, for ploidy != 1
+    ModelFloat hwePermutationsln; // sum of permutationsln of the distinct genotypes with ploidy != 1
+    int alleleTotal; // sum of the allele frequencies, kept in step with frequencyCounts
+    ModelFloat alleleCountFactorialsln; // sum of ln(frequency!) over the alleles, kept in step with frequencyCounts
+    // sums over alleleCounters, maintained when they count observations
+    ModelFloat observationPriorsln; // of observationPriorln
+    ModelFloat alleleBalanceSumln; // of alleleBalanceTermln
+    int observationsTotal; // of the observations
 
     GenotypeCombo(void)
         : probObsGivenGenotypes(0)
@@ -188,6 +267,12 @@ public:
         , priorProbAf(0)
         , priorProbObservations(0)
         , permutationsln(0)
+        , hwePermutationsln(0)
+        , alleleTotal(0)
+        , alleleCountFactorialsln(0)
+        , observationPriorsln(0)
+        , alleleBalanceSumln(0)
+        , observationsTotal(0)
     { }
 
     void init(bool useObsExpectations);
@@ -199,16 +284,25 @@ public:
     void appendIndependentCombo(GenotypeCombo& other);
 
     int numberOfAlleles(void);
-    vector<long double> alleleProbs(void);  // scales counts() by the total number of alleles
+    vector<ModelFloat> alleleProbs(void);  // scales counts() by the total number of alleles
     int ploidy(void); // the number of copies of the locus in this combination
     int alleleCount(Allele& allele);
     int alleleCount(const string& allele);
-    long double alleleFrequency(Allele& allele);
-    long double alleleFrequency(const string& allele);
-    long double genotypeFrequency(Genotype* genotype);
+    ModelFloat alleleFrequency(Allele& allele);
+    ModelFloat alleleFrequency(const string& allele);
+    ModelFloat genotypeFrequency(Genotype* genotype);
     void updateCachedCounts(Sample* sample, Genotype* oldGenotype, Genotype* newGenotype, bool useObsExpectations);
     map<string, int> countAlleles(void);
     map<int, int> countFrequencies(void);
+    void updateFrequencyCounts(int oldFrequency, int newFrequency);
+    void addGenotypeCount(Genotype* genotype, int delta);
+    void updateHweSums(void);
+    void addObservationSums(const AlleleCounter& alleleCounter, int sign);
+    void updateObservationSums(void);
+    // copies the running sums from other, which must hold the same genotypes,
+    // as swapping a genotype in and back out again does not restore them
+    // exactly
+    void restoreSums(GenotypeCombo& other);
     int hetCount(void);
     vector<int> counts(void); // the counts of frequencies of the alleles in the genotype combo
     vector<int> observationCounts(void); // the counts of observations of the alleles (in sorted order)
@@ -219,32 +313,32 @@ public:
 
     // posterior
 
-    long double posteriorProb; // p(genotype combo) * p(observations | genotype combo)
+    ModelFloat posteriorProb; // p(genotype combo) * p(observations | genotype combo)
 
     // priors
 
-    long double priorProb; // p(genotype combo) = p(genotype combo | allele frequency) * p(allele frequency) * p(observations)
-    long double priorProbG_Af; // p(genotype combo | allele frequency)
-    long double priorProbAf; // p(allele frequency)
-    long double priorProbObservations; // p(observations)
-    long double priorProbGenotypesGivenHWE;
+    ModelFloat priorProb; // p(genotype combo) = p(genotype combo | allele frequency) * p(allele frequency) * p(observations)
+    ModelFloat priorProbG_Af; // p(genotype combo | allele frequency)
+    ModelFloat priorProbAf; // p(allele frequency)
+    ModelFloat priorProbObservations; // p(observations)
+    ModelFloat priorProbGenotypesGivenHWE;
 
     //GenotypeCombo* combo,
     void calculatePosteriorProbability(
-        long double theta,
+        ModelFloat theta,
         bool pooled,
         bool ewensPriors,
         bool permute,
         bool hwePriors,
         bool obsBinomialPriors,
         bool alleleBalancePriors,
-        long double diffusionPriorScalarln);
+        ModelFloat diffusionPriorScalarln);
 
-    long double probabilityGivenAlleleFrequencyln(bool permute);
+    ModelFloat probabilityGivenAlleleFrequencyln(bool permute);
 
-    long double hweExpectedFrequencyln(Genotype* genotype);
-    long double hweProbGenotypeFrequencyln(Genotype* genotype);
-    long double hweComboProb(void);
+    ModelFloat hweExpectedFrequencyln(Genotype* genotype);
+    ModelFloat hweProbGenotypeFrequencyln(Genotype* genotype);
+    ModelFloat hweComboProb(void);
 
 };
 
@@ -322,14 +416,14 @@ orderedGenotypeCombo(
     GenotypeCombo& combo,
     GenotypeCombo& orderedCombo,
     SampleDataLikelihoods& sampleDataLikelihoods,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar);
+    ModelFloat diffusionPriorScalar);
 
 void
 makeComboByDatalLikelihoodRank(
@@ -338,27 +432,66 @@ makeComboByDatalLikelihoodRank(
     SampleDataLikelihoods& variantSampleDataLikelihoods,
     SampleDataLikelihoods& invariantSampleDataLikelihoods,
     map<string, int>& priorACs,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar);
+    ModelFloat diffusionPriorScalar);
+
+// offsets into each sample's data likelihoods of the best-ranked genotype with
+// the number of alternate alleles the sample had in a previous combo, or 0
+void
+warmStartPosition(
+    vector<int>& initialPosition,
+    SampleDataLikelihoods& sampleDataLikelihoods,
+    map<string, int>& previousAlternateCounts,
+    string& referenceBase);
+
+// genotyping searches, from the most to the least thorough
+enum GenotypingSearch {
+    GENOTYPING_SEARCH_EXHAUSTIVE = 0, // exhaustive local search, bandwidth = banddepth = 0
+    GENOTYPING_SEARCH_BANDED,         // bandwidth 1, banddepth --genotyping-max-banddepth
+    GENOTYPING_SEARCH_APPROXIMATE     // exhaustive local search limited to one iteration
+};
+
+string genotypingSearchName(GenotypingSearch search);
+
+// estimated work, in genotype evaluations, of running the given search over
+// these samples for the given number of iterations, which should be the number
+// the search is expected to take rather than its cap
+double
+genotypingSearchCost(
+    GenotypingSearch search,
+    SampleDataLikelihoods& sampleDataLikelihoods,
+    int iterations,
+    int banddepth,
+    bool marginals);
+
+// the most thorough search whose estimated cost is within maxWork, or the
+// approximate search if none is
+GenotypingSearch
+chooseGenotypingSearch(
+    SampleDataLikelihoods& sampleDataLikelihoods,
+    int iterations,
+    int banddepth,
+    bool marginals,
+    double maxWork);
 
 void
 dataLikelihoodMaxGenotypeCombo(
     GenotypeCombo& combo,
     SampleDataLikelihoods& sampleDataLikelihoods,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar);
+    ModelFloat diffusionPriorScalar);
 
 bool
 bandedGenotypeCombinations(
@@ -369,14 +502,15 @@ bandedGenotypeCombinations(
     Samples& samples,
     map<string, int>& priorACs,
     int bandwidth, int banddepth,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar);
+    ModelFloat diffusionPriorScalar,
+    bool keepCombos);
 
 void
 allLocalGenotypeCombinations(
@@ -385,14 +519,14 @@ allLocalGenotypeCombinations(
     SampleDataLikelihoods& sampleDataLikelihoods,
     Samples& samples,
     map<string, int>& priorACs,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar,
+    ModelFloat diffusionPriorScalar,
     bool keepCombos);
 
 void
@@ -406,14 +540,14 @@ convergentGenotypeComboSearch(
     vector<Allele>& genotypeAlleles,
     map<string, int>& priorACs,
     int bandwidth, int banddepth,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar,
+    ModelFloat diffusionPriorScalar,
     int maxiterations,
     int& totaliterations,
     bool addHomozygousCombos);
@@ -426,14 +560,14 @@ addAllHomozygousCombos(
     SampleDataLikelihoods& invariantSampleDataLikelihoods,
     Samples& samples,
     vector<Allele>& genotypeAlleles,
-    long double theta,
+    ModelFloat theta,
     bool pooled,
     bool ewensPriors,
     bool permute,
     bool hwePriors,
     bool binomialObsPriors,
     bool alleleBalancePriors,
-    long double diffusionPriorScalar);
+    ModelFloat diffusionPriorScalar);
 
 
 vector<pair<Allele, int> > alternateAlleles(GenotypeCombo& combo, string referenceBase);
@@ -443,7 +577,11 @@ pair<int, int> alternateAndReferenceCount(vector<Allele*>& observations, string&
 ostream& operator<<(ostream& out, list<GenotypeCombo>& combo);
 ostream& operator<<(ostream& out, GenotypeCombo& g);
 
-map<int, vector<Genotype> > getGenotypesByPloidy(vector<int>& ploidies, vector<Allele>& genotypeAlleles);
+// genotypes of each ploidy, restricted to the count bounds given for that ploidy, if any
+map<int, vector<Genotype> > getGenotypesByPloidy(
+    vector<int>& ploidies,
+    vector<Allele>& genotypeAlleles,
+    map<int, vector<pair<int, int> > >& countBounds);
 
 void combinePopulationCombos(list<GenotypeCombo>& genotypeCombos,
                              map<string, list<GenotypeCombo> >& genotypeCombosByPopulation);
@@ -24,10 +24,14 @@
 //
 bool leftAlign(BamAlignment& alignment, string& referenceSequence, bool debug) {
 
+#ifdef VERBOSE_DEBUG
+    // padded copies of the sequences, for debugging output
     int arsOffset = 0; // pointer to insertion point in aligned reference sequence
     string alignedReferenceSequence = referenceSequence;
     int aabOffset = 0;
     string alignmentAlignedBases = alignment.QueryBases;
+    stringstream cigar_before, cigar_after;
+#endif
 
     // store information about the indels
     vector<FBIndelAllele> indels;
@@ -35,36 +39,45 @@ bool leftAlign(BamAlignment& alignment, string& referenceSequence, bool debug) {
     int rp = 0;  // read position, 0-based relative to read
     int sp = 0;  // sequence position
 
-    string softBegin;
-    string softEnd;
+    int softBegin = 0; // lengths of the soft clips
+    int softEnd = 0;
 
-    stringstream cigar_before, cigar_after;
     for (vector<CigarOp>::const_iterator c = alignment.CigarData.begin();
         c != alignment.CigarData.end(); ++c) {
         unsigned int l = c->Length;
         char t = c->Type;
+#ifdef VERBOSE_DEBUG
         cigar_before << l << t;
+#endif
         if (t == 'M') { // match or mismatch
             sp += l;
             rp += l;
         } else if (t == 'D') { // deletion
             indels.push_back(FBIndelAllele(false, l, sp, rp, referenceSequence.substr(sp, l)));
+#ifdef VERBOSE_DEBUG
             alignmentAlignedBases.insert(rp + aabOffset, string(l, '-'));
             aabOffset += l;
+#endif
             sp += l;  // update reference sequence position
         } else if (t == 'I') { // insertion
             indels.push_back(FBIndelAllele(true, l, sp, rp, alignment.QueryBases.substr(rp, l)));
-            alignedReferenceSequence.insert(sp + softBegin.size() + arsOffset, string(l, '-'));
+#ifdef VERBOSE_DEBUG
+            alignedReferenceSequence.insert(sp + softBegin + arsOffset, string(l, '-'));
             arsOffset += l;
+#endif
             rp += l;
         } else if (t == 'S') { // soft clip, clipped sequence present in the read not matching the reference
             // remove these bases from the refseq and read seq, but don't modify the alignment sequence
             if (rp == 0) {
+#ifdef VERBOSE_DEBUG
                 alignedReferenceSequence = string(l, '*') + alignedReferenceSequence;
-                softBegin = alignmentAlignedBases.substr(0, l);
+#endif
+                softBegin = l;
             } else {
+#ifdef VERBOSE_DEBUG
                 alignedReferenceSequence = alignedReferenceSequence + string(l, '*');
-                softEnd = alignmentAlignedBases.substr(alignmentAlignedBases.size() - l, l);
+#endif
+                softEnd = l;
             }
             rp += l;
         } else if (t == 'H') { // hard clip on the read, clipped sequence is not present in the read
@@ -117,8 +130,8 @@ bool leftAlign(BamAlignment& alignment, string& referenceSequence, bool debug) {
             }
 #endif
             while (steppos >= 0 && readsteppos >= 0
-                   && indel.sequence == referenceSequence.substr(steppos, indel.length)
-                   && indel.sequence == alignment.QueryBases.substr(readsteppos, indel.length)
+                   && referenceSequence.compare(steppos, indel.length, indel.sequence) == 0
+                   && alignment.QueryBases.compare(readsteppos, indel.length, indel.sequence) == 0
                    && (id == indels.begin()
                        || (previous->insertion && steppos >= previous->position)
                        || (!previous->insertion && steppos >= previous->position + previous->length))) {
@@ -205,8 +218,8 @@ bool leftAlign(BamAlignment& alignment, string& referenceSequence, bool debug) {
                             ((previous->insertion && pos + previous->length <= indel.position)
                             ||
                             (!previous->insertion && pos + previous->length < indel.position))
-                            && previous->sequence 
-                                == referenceSequence.substr(pos + previous->length, previous->length)) {
+                            && referenceSequence.compare(pos + previous->length, previous->length,
+                                                         previous->sequence) == 0) {
                         pos += previous->length;
                     }
                     if (pos < previous->position &&
@@ -232,8 +245,8 @@ bool leftAlign(BamAlignment& alignment, string& referenceSequence, bool debug) {
 
     vector<CigarOp> newCigar;
 
-    if (!softBegin.empty()) {
-        newCigar.push_back(CigarOp('S', softBegin.size()));
+    if (softBegin > 0) {
+        newCigar.push_back(CigarOp('S', softBegin));
     }
 
     vector<FBIndelAllele>::iterator id = indels.begin();
@@ -269,8 +282,8 @@ bool leftAlign(BamAlignment& alignment, string& referenceSequence, bool debug) {
         newCigar.push_back(CigarOp('M', alignedLength - lastend));
     }
 
-    if (!softEnd.empty()) {
-        newCigar.push_back(CigarOp('S', softEnd.size()));
+    if (softEnd > 0) {
+        newCigar.push_back(CigarOp('S', softEnd));
     }
 
     LEFTALIGN_DEBUG(endl);
@@ -287,8 +300,12 @@ bool leftAlign(BamAlignment& alignment, string& referenceSequence, bool debug) {
     }
 #endif
 
+    // check if we're realigned
+    bool realigned = !sameCigar(newCigar, alignment.CigarData);
+
     alignment.CigarData = newCigar;
 
+#ifdef VERBOSE_DEBUG
     for (vector<CigarOp>::const_iterator c = alignment.CigarData.begin();
         c != alignment.CigarData.end(); ++c) {
         unsigned int l = c->Length;
@@ -296,14 +313,98 @@ bool leftAlign(BamAlignment& alignment, string& referenceSequence, bool debug) {
         cigar_after << l << t;
     }
     LEFTALIGN_DEBUG(cigar_after.str() << endl);
+#endif
 
-    // check if we're realigned
-    if (cigar_after.str() == cigar_before.str()) {
+    return realigned;
+
+}
+
+bool sameCigar(const vector<CigarOp>& a, const vector<CigarOp>& b) {
+    if (a.size() != b.size()) {
         return false;
-    } else {
-        return true;
     }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].Type != b[i].Type || a[i].Length != b[i].Length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool hasIndels(const BamAlignment& alignment) {
+    for (vector<CigarOp>::const_iterator c = alignment.CigarData.begin();
+        c != alignment.CigarData.end(); ++c) {
+        if (c->Type == 'I' || c->Type == 'D') {
+            return true;
+        }
+    }
+    return false;
+}
 
+bool LeftAlignCacheKey::operator<(const LeftAlignCacheKey& other) const {
+    if (refID != other.refID) return refID < other.refID;
+    if (position != other.position) return position < other.position;
+    if (basesHash != other.basesHash) return basesHash < other.basesHash;
+    if (maxiterations != other.maxiterations) return maxiterations < other.maxiterations;
+    if (cigar != other.cigar) return cigar < other.cigar;
+    return reference < other.reference;
+}
+
+LeftAlignCacheKey LeftAlignCache::key(BamAlignment& alignment, string& referenceSequence, int maxiterations) {
+    LeftAlignCacheKey k;
+    k.refID = alignment.RefID;
+    k.position = alignment.Position;
+    k.maxiterations = maxiterations;
+    // FNV-1a
+    k.basesHash = 2166136261u;
+    for (string::const_iterator c = alignment.QueryBases.begin(); c != alignment.QueryBases.end(); ++c) {
+        k.basesHash = (k.basesHash ^ (unsigned char) *c) * 16777619u;
+    }
+    k.cigar.reserve(alignment.CigarData.size() * (1 + sizeof(uint32_t)));
+    for (vector<CigarOp>::const_iterator c = alignment.CigarData.begin();
+        c != alignment.CigarData.end(); ++c) {
+        k.cigar += c->Type;
+        k.cigar.append((char*) &c->Length, sizeof(uint32_t));
+    }
+    k.reference = referenceSequence.substr(0, LEFTALIGN_CACHE_REFERENCE_SPAN);
+    return k;
+}
+
+bool LeftAlignCache::find(const LeftAlignCacheKey& key, const string& bases, vector<CigarOp>& cigar, bool& stable) {
+    map<LeftAlignCacheKey, LeftAlignCacheEntry>::iterator r = results.find(key);
+    if (r == results.end() || r->second.bases != bases) {
+        return false;
+    }
+    cigar = r->second.cigar;
+    stable = r->second.stable;
+    return true;
+}
+
+// approximate, counting the strings, the cigar and the map node
+long int LeftAlignCache::entryBytes(const LeftAlignCacheKey& key, const LeftAlignCacheEntry& entry) {
+    return sizeof(LeftAlignCacheKey) + sizeof(LeftAlignCacheEntry) + 4 * sizeof(void*)
+        + key.cigar.size() + key.reference.size() + entry.bases.size()
+        + entry.cigar.size() * sizeof(CigarOp);
+}
+
+void LeftAlignCache::insert(const LeftAlignCacheKey& key, const string& bases, const vector<CigarOp>& cigar, bool stable) {
+    map<LeftAlignCacheKey, LeftAlignCacheEntry>::iterator r = results.find(key);
+    if (r != results.end()) {
+        // reads whose bases share a hash
+        bytes -= entryBytes(r->first, r->second);
+        results.erase(r);
+    }
+    LeftAlignCacheEntry entry;
+    entry.bases = bases;
+    entry.cigar = cigar;
+    entry.stable = stable;
+    long int added = entryBytes(key, entry);
+    if (bytes + added > MAX_LEFTALIGN_CACHE_BYTES) {
+        results.clear();
+        bytes = 0;
+    }
+    results[key] = entry;
+    bytes += added;
 }
 
 int countMismatches(BamAlignment& alignment, string referenceSequence) {
@@ -342,7 +443,26 @@ int countMismatches(BamAlignment& alignment, string referenceSequence) {
 // realignment.  Returns true on realignment success or non-realignment.
 // Returns false if we exceed the maximum number of realignment iterations.
 //
-bool stablyLeftAlign(BamAlignment& alignment, string referenceSequence, int maxiterations, bool debug) {
+// Alignments without indels are returned untouched.  Given a cache, the
+// result for each distinct position, cigar and read sequence is computed
+// once, so the identical reads stacked at a site are realigned once.
+//
+bool stablyLeftAlign(BamAlignment& alignment, string referenceSequence, int maxiterations, bool debug,
+                     LeftAlignCache* cache) {
+
+    if (!hasIndels(alignment)) {
+        LEFTALIGN_DEBUG("did not realign" << endl);
+        return true;
+    }
+
+    LeftAlignCacheKey key;
+    bool stable;
+    if (cache) {
+        key = cache->key(alignment, referenceSequence, maxiterations);
+        if (cache->find(key, alignment.QueryBases, alignment.CigarData, stable)) {
+            return stable;
+        }
+    }
 
 #ifdef VERBOSE_DEBUG
     int mismatchesBefore = countMismatches(alignment, referenceSequence);
@@ -351,7 +471,7 @@ bool stablyLeftAlign(BamAlignment& alignment, string referenceSequence, int maxi
     if (!leftAlign(alignment, referenceSequence, debug)) {
 
         LEFTALIGN_DEBUG("did not realign" << endl);
-        return true;
+        stable = true;
 
     } else {
 
@@ -369,12 +489,14 @@ bool stablyLeftAlign(BamAlignment& alignment, string referenceSequence, int maxi
         }
 #endif
 
-        if (maxiterations <= 0) {
-            return false;
-        } else {
-            return true;
-        }
+        stable = maxiterations > 0;
+
+    }
 
+    if (cache) {
+        cache->insert(key, alignment.QueryBases, alignment.CigarData, stable);
     }
 
+    return stable;
+
 }
@@ -30,8 +30,49 @@
 using namespace std;
 using namespace BamTools;
 
+#define MAX_LEFTALIGN_CACHE_BYTES (8 * 1024 * 1024)
+#define LEFTALIGN_CACHE_REFERENCE_SPAN 16
+
+// the reference window of a realignment is fixed by the read's position and
+// cigar, so only its first bases are kept, to catch a caller passing another
+// reference.  the read bases are hashed, and compared in full on a hit.
+class LeftAlignCacheKey {
+public:
+    int32_t refID;
+    int32_t position;
+    int maxiterations;
+    uint32_t basesHash;
+    string cigar;     // packed operation types and lengths
+    string reference; // up to LEFTALIGN_CACHE_REFERENCE_SPAN bases
+    bool operator<(const LeftAlignCacheKey& other) const;
+};
+
+class LeftAlignCacheEntry {
+public:
+    string bases;
+    vector<CigarOp> cigar;
+    bool stable;
+};
+
+// realigned cigars, keyed by everything the realignment depends on, and
+// cleared when they hold more than MAX_LEFTALIGN_CACHE_BYTES
+class LeftAlignCache {
+public:
+    LeftAlignCache(void) : bytes(0) { }
+    LeftAlignCacheKey key(BamAlignment& alignment, string& referenceSequence, int maxiterations);
+    bool find(const LeftAlignCacheKey& key, const string& bases, vector<CigarOp>& cigar, bool& stable);
+    void insert(const LeftAlignCacheKey& key, const string& bases, const vector<CigarOp>& cigar, bool stable);
+private:
+    long int entryBytes(const LeftAlignCacheKey& key, const LeftAlignCacheEntry& entry);
+    map<LeftAlignCacheKey, LeftAlignCacheEntry> results;
+    long int bytes;
+};
+
 bool leftAlign(BamAlignment& alignment, string& referenceSequence, bool debug = false);
-bool stablyLeftAlign(BamAlignment& alignment, string referenceSequence, int maxiterations = 20, bool debug = false);
+bool stablyLeftAlign(BamAlignment& alignment, string referenceSequence, int maxiterations = 20, bool debug = false,
+                     LeftAlignCache* cache = NULL);
+bool sameCigar(const vector<CigarOp>& a, const vector<CigarOp>& b);
+bool hasIndels(const BamAlignment& alignment);
 int countMismatches(BamAlignment& alignment, string referenceSequence);
 
 #endif
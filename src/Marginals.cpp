@@ -6,7 +6,7 @@
 void marginalGenotypeLikelihoods(list<GenotypeCombo>& genotypeCombos, Results& results) {
 
 
-    map<string, map<Genotype*, vector<long double> > > rawMarginals;
+    map<string, map<Genotype*, vector<ModelFloat> > > rawMarginals;
 
     // push the marginal likelihoods into the rawMarginals vectors in the results
     for (list<GenotypeCombo>::iterator gc = genotypeCombos.begin(); gc != genotypeCombos.end(); ++gc) {
@@ -19,14 +19,14 @@ void marginalGenotypeLikelihoods(list<GenotypeCombo>& genotypeCombos, Results& r
     // safely add the raw marginal vectors using logsumexp
     for (Results::iterator r = results.begin(); r != results.end(); ++r) {
         ResultData& sample = r->second;
-        map<Genotype*, vector<long double> >& rawmgs = rawMarginals[r->first];
-        vector<long double> probs;
-        for (map<Genotype*, vector<long double> >::iterator m = rawmgs.begin(); m != rawmgs.end(); ++m) {
+        map<Genotype*, vector<ModelFloat> >& rawmgs = rawMarginals[r->first];
+        vector<ModelFloat> probs;
+        for (map<Genotype*, vector<ModelFloat> >::iterator m = rawmgs.begin(); m != rawmgs.end(); ++m) {
             probs.push_back(logsumexp_probs(m->second));
         }
-        long double normalizer = logsumexp_probs(probs);
-        vector<long double>::iterator p = probs.begin();
-        for (map<Genotype*, vector<long double> >::iterator m = rawmgs.begin(); m != rawmgs.end(); ++m, ++p) {
+        ModelFloat normalizer = logsumexp_probs(probs);
+        vector<ModelFloat>::iterator p = probs.begin();
+        for (map<Genotype*, vector<ModelFloat> >::iterator m = rawmgs.begin(); m != rawmgs.end(); ++m, ++p) {
             sample.marginals[m->first] = *p - normalizer;
         }
     }
@@ -34,52 +34,56 @@ void marginalGenotypeLikelihoods(list<GenotypeCombo>& genotypeCombos, Results& r
 }
 */
 
-// recompute data likelihoods using marginals from the combos
-// assumes that the genotype combos are in the same order as the likelihoods
-// assumes that the genotype combos are the same size as the number of samples in the likelihoods
-// returns the delta from the previous marginals, informative in the case of EM
-long double marginalGenotypeLikelihoods(list<GenotypeCombo>& genotypeCombos, SampleDataLikelihoods& likelihoods) {
+// per-sample accumulators of combo posteriors, one per genotype by the index
+// of its likelihood, plus a final one for genotypes the sample lacks
+typedef vector<vector<LogSumExpAccumulator> > RawMarginals;
 
-    long double delta = 0;
+// the accumulator for sdl among those of the sample with the likelihoods sdls
+size_t rawMarginalIndex(const vector<SampleDataLikelihood>& sdls, const SampleDataLikelihood& sdl) {
+    return (sdl.index >= 0 && sdl.index < (int) sdls.size()) ? sdl.index : sdls.size();
+}
 
-    vector< map<Genotype*, long double> > rawMarginals;
+void initRawMarginals(RawMarginals& rawMarginals, SampleDataLikelihoods& likelihoods) {
     rawMarginals.resize(likelihoods.size());
-    vector< map<Genotype*, long double> >::iterator rawMarginalsItr;
-
-    // push the marginal likelihoods into the rawMarginals maps
-    for (list<GenotypeCombo>::iterator gc = genotypeCombos.begin(); gc != genotypeCombos.end(); ++gc) {
-        rawMarginalsItr = rawMarginals.begin();
-        for (GenotypeCombo::const_iterator i = gc->begin(); i != gc->end(); ++i) {
-            const SampleDataLikelihood& sdl = **i;
-            map<Genotype*, long double>& rmgs = *rawMarginalsItr++;
-            map<Genotype*, long double>::iterator rmgsItr = rmgs.find(sdl.genotype);
-            if (rmgsItr == rmgs.end()) {
-                rmgs[sdl.genotype] = gc->posteriorProb;
-            } else {
-		//vector<long double> x;
-		//x.push_back(rmgsItr->second); x.push_back(gc->posteriorProb);
-                //rmgs[sdl.genotype] = logsumexp_probs(x);
-		rmgs[sdl.genotype] = log(safe_exp(rmgsItr->second) + safe_exp(gc->posteriorProb));
-            }
-        }
+    RawMarginals::iterator r = rawMarginals.begin();
+    for (SampleDataLikelihoods::iterator s = likelihoods.begin(); s != likelihoods.end(); ++s, ++r) {
+        r->resize(s->size() + 1);
     }
+}
 
-    // safely add the raw marginal vectors using logsumexp
-    // and use to update the sample data likelihoods
-    rawMarginalsItr = rawMarginals.begin();
-    for (SampleDataLikelihoods::iterator s = likelihoods.begin(); s != likelihoods.end(); ++s) {
+// normalizes the raw marginals and uses them to update the sample data likelihoods
+// returns the delta from the previous marginals
+ModelFloat updateMarginals(RawMarginals& rawMarginals, SampleDataLikelihoods& likelihoods) {
+
+    ModelFloat delta = 0;
+
+    RawMarginals::iterator r = rawMarginals.begin();
+    for (SampleDataLikelihoods::iterator s = likelihoods.begin(); s != likelihoods.end(); ++s, ++r) {
         vector<SampleDataLikelihood>& sdls = *s;
-        const map<Genotype*, long double>& rawmgs = *rawMarginalsItr++;
-        map<Genotype*, long double> marginals;
-        vector<long double> rawprobs;
-        for (map<Genotype*, long double>::const_iterator m = rawmgs.begin(); m != rawmgs.end(); ++m) {
-            long double p = m->second;
-            marginals[m->first] = p;
-            rawprobs.push_back(p);
+        const vector<LogSumExpAccumulator>& rawmgs = *r;
+        // normalize relative to the largest raw marginal.  subtracting the
+        // log of the total rounds the marginal of a confident genotype to 0,
+        // losing the small mass of the others which its GQ is made from.
+        vector<LogSumExpAccumulator>::const_iterator best = rawmgs.end();
+        for (vector<LogSumExpAccumulator>::const_iterator m = rawmgs.begin(); m != rawmgs.end(); ++m) {
+            if (!m->empty() && (best == rawmgs.end() || m->value() > best->value())) {
+                best = m;
+            }
+        }
+        if (best == rawmgs.end()) {
+            continue;
         }
-        long double normalizer = logsumexp_probs(rawprobs);
+        ModelFloat maxln = best->value();
+        ModelFloat rest = 0;
+        for (vector<LogSumExpAccumulator>::const_iterator m = rawmgs.begin(); m != rawmgs.end(); ++m) {
+            if (!m->empty() && m != best) {
+                rest += exp(m->value() - maxln);
+            }
+        }
+        ModelFloat restln = log1p_model(rest);
         for (vector<SampleDataLikelihood>::iterator sdl = sdls.begin(); sdl != sdls.end(); ++sdl) {
-            long double newmarginal = marginals[sdl->genotype] - normalizer;
+            const LogSumExpAccumulator& m = rawmgs[rawMarginalIndex(sdls, *sdl)];
+            ModelFloat newmarginal = ((m.empty() ? 0 : m.value()) - maxln) - restln;
             delta += newmarginal - sdl->marginal;
             sdl->marginal = newmarginal;
         }
@@ -89,24 +93,46 @@ long double marginalGenotypeLikelihoods(list<GenotypeCombo>& genotypeCombos, Sam
 
 }
 
+// recompute data likelihoods using marginals from the combos
+// assumes that the genotype combos are in the same order as the likelihoods
+// assumes that the genotype combos are the same size as the number of samples in the likelihoods
+// returns the delta from the previous marginals, informative in the case of EM
+ModelFloat marginalGenotypeLikelihoods(list<GenotypeCombo>& genotypeCombos, SampleDataLikelihoods& likelihoods) {
+
+    RawMarginals rawMarginals;
+    initRawMarginals(rawMarginals, likelihoods);
+
+    // accumulate the marginal likelihoods of each sample's genotypes
+    for (list<GenotypeCombo>::iterator gc = genotypeCombos.begin(); gc != genotypeCombos.end(); ++gc) {
+        RawMarginals::iterator r = rawMarginals.begin();
+        SampleDataLikelihoods::iterator s = likelihoods.begin();
+        for (GenotypeCombo::const_iterator i = gc->begin(); i != gc->end(); ++i, ++r, ++s) {
+            (*r)[rawMarginalIndex(*s, **i)].add(gc->posteriorProb);
+        }
+    }
+
+    return updateMarginals(rawMarginals, likelihoods);
+
+}
+
 /*
 void bestMarginalGenotypeCombo(GenotypeCombo& combo,
         Results& results,
         SampleDataLikelihoods& samples,
-        long double theta,
+        ModelFloat theta,
         bool pooled,
         bool permute,
         bool hwePriors,
         bool binomialObsPriors,
         bool alleleBalancePriors,
-        long double diffusionPriorScalar) {
+        ModelFloat diffusionPriorScalar) {
 
     for (SampleDataLikelihoods::iterator s = samples.begin(); s != samples.end(); ++s) {
         vector<SampleDataLikelihood>& sdls = *s;
         const string& name = sdls.front().name;
-        const map<Genotype*, long double>& marginals = results[name].marginals;;
-        map<Genotype*, long double>::const_iterator m = marginals.begin();
-        long double bestMarginalProb = m->second;
+        const map<Genotype*, ModelFloat>& marginals = results[name].marginals;;
+        map<Genotype*, ModelFloat>::const_iterator m = marginals.begin();
+        ModelFloat bestMarginalProb = m->second;
         Genotype* bestMarginalGenotype = m->first;
         ++m;
         for (; m != marginals.end(); ++m) {
@@ -130,67 +156,40 @@ void bestMarginalGenotypeCombo(GenotypeCombo& combo,
 }
 */
 
-long double balancedMarginalGenotypeLikelihoods(list<GenotypeCombo>& genotypeCombos, SampleDataLikelihoods& likelihoods) {
+ModelFloat balancedMarginalGenotypeLikelihoods(list<GenotypeCombo>& genotypeCombos, SampleDataLikelihoods& likelihoods) {
 
-    long double delta = 0;
-
-    //map<string, map<Genotype*, vector<long double> > > rawMarginals;
-    vector< map<Genotype*, vector<long double> > > rawMarginals;
-    rawMarginals.resize(likelihoods.size());
-    vector< map<Genotype*, vector<long double> > >::iterator rawMarginalsItr;
+    RawMarginals rawMarginals;
+    initRawMarginals(rawMarginals, likelihoods);
 
-    // push the marginal likelihoods into the rawMarginals maps
+    // accumulate the marginal likelihoods of each sample's genotypes
     for (list<GenotypeCombo>::iterator gc = genotypeCombos.begin(); gc != genotypeCombos.end(); ++gc) {
         if (gc->isHomozygous()) {
-            rawMarginalsItr = rawMarginals.begin();
-            for (GenotypeCombo::const_iterator i = gc->begin(); i != gc->end(); ++i) {
-                const SampleDataLikelihood& sdl = **i;
-                map<Genotype*, vector<long double> >& rmgs = *rawMarginalsItr++;
-                rmgs[sdl.genotype].push_back(gc->posteriorProb);
+            RawMarginals::iterator r = rawMarginals.begin();
+            SampleDataLikelihoods::iterator s = likelihoods.begin();
+            for (GenotypeCombo::const_iterator i = gc->begin(); i != gc->end(); ++i, ++r, ++s) {
+                (*r)[rawMarginalIndex(*s, **i)].add(gc->posteriorProb);
             }
         } else {
             bool isComboKing = true;
-            rawMarginalsItr = rawMarginals.begin();
-            for (GenotypeCombo::const_iterator i = gc->begin(); i != gc->end(); ++i) {
+            RawMarginals::iterator r = rawMarginals.begin();
+            SampleDataLikelihoods::iterator s = likelihoods.begin();
+            for (GenotypeCombo::const_iterator i = gc->begin(); i != gc->end(); ++i, ++r, ++s) {
                 const SampleDataLikelihood& sdl = **i;
                 if (sdl.rank != 0) {
                     isComboKing = false;
-                    map<Genotype*, vector<long double> >& rmgs = *rawMarginalsItr;
-                    rmgs[sdl.genotype].push_back(gc->posteriorProb);
+                    (*r)[rawMarginalIndex(*s, sdl)].add(gc->posteriorProb);
                 }
-                ++rawMarginalsItr;
             }
             if (isComboKing) {
-                rawMarginalsItr = rawMarginals.begin();
-                for (GenotypeCombo::const_iterator i = gc->begin(); i != gc->end(); ++i) {
-                    const SampleDataLikelihood& sdl = **i;
-                    map<Genotype*, vector<long double> >& rmgs = *rawMarginalsItr++;
-                    rmgs[sdl.genotype].push_back(gc->posteriorProb);
+                r = rawMarginals.begin();
+                s = likelihoods.begin();
+                for (GenotypeCombo::const_iterator i = gc->begin(); i != gc->end(); ++i, ++r, ++s) {
+                    (*r)[rawMarginalIndex(*s, **i)].add(gc->posteriorProb);
                 }
             }
         }
     }
 
-    // safely add the raw marginal vectors using logsumexp
-    rawMarginalsItr = rawMarginals.begin();
-    for (SampleDataLikelihoods::iterator s = likelihoods.begin(); s != likelihoods.end(); ++s) {
-        vector<SampleDataLikelihood>& sdls = *s;
-        const map<Genotype*, vector<long double> >& rawmgs = *rawMarginalsItr++;
-        map<Genotype*, long double> marginals;
-        vector<long double> rawprobs;
-        for (map<Genotype*, vector<long double> >::const_iterator m = rawmgs.begin(); m != rawmgs.end(); ++m) {
-            long double p = logsumexp_probs(m->second);
-            marginals[m->first] = p;
-            rawprobs.push_back(p);
-        }
-        long double normalizer = logsumexp_probs(rawprobs);
-        for (vector<SampleDataLikelihood>::iterator sdl = sdls.begin(); sdl != sdls.end(); ++sdl) {
-            long double newmarginal = marginals[sdl->genotype] - normalizer;
-            delta += newmarginal - sdl->marginal;
-            sdl->marginal = newmarginal;
-        }
-    }
-
-    return delta;
+    return updateMarginals(rawMarginals, likelihoods);
 
 }
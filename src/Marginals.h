@@ -9,18 +9,18 @@
 using namespace std;
 
 //void marginalGenotypeLikelihoods(list<GenotypeCombo>& genotypeCombos, Results& results);
-long double marginalGenotypeLikelihoods(list<GenotypeCombo>& genotypeCombos, SampleDataLikelihoods& likelihoods);
+ModelFloat marginalGenotypeLikelihoods(list<GenotypeCombo>& genotypeCombos, SampleDataLikelihoods& likelihoods);
 void bestMarginalGenotypeCombo(GenotypeCombo& combo,
         Results& results,
         SampleDataLikelihoods& samples,
-        long double theta,
+        ModelFloat theta,
         bool pooled,
         bool permute,
         bool hwePriors,
         bool binomialObsPriors,
         bool alleleBalancePriors,
-        long double diffusionPriorScalar);
+        ModelFloat diffusionPriorScalar);
 
-long double balancedMarginalGenotypeLikelihoods(list<GenotypeCombo>& genotypeCombos, SampleDataLikelihoods& likelihoods);
+ModelFloat balancedMarginalGenotypeLikelihoods(list<GenotypeCombo>& genotypeCombos, SampleDataLikelihoods& likelihoods);
 
 #endif
@@ -4,8 +4,8 @@
 #include "Utility.h"
 #include <vector>
 
-long double multinomialSamplingProb(const vector<long double>& probs, const vector<int>& obs);
-long double multinomialSamplingProbLn(const vector<long double>& probs, const vector<int>& obs);
-long double multinomialCoefficientLn(int n, const vector<int>& counts);
+ModelFloat multinomialSamplingProb(const vector<ModelFloat>& probs, const vector<int>& obs);
+ModelFloat multinomialSamplingProbLn(const vector<ModelFloat>& probs, const vector<int>& obs);
+ModelFloat multinomialCoefficientLn(int n, const vector<int>& counts);
 
 #endif
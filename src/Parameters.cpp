@@ -174,6 +174,13 @@ void Parameters::usage(char** argv) {
         << "   -K --pooled-continuous" << endl
         << "                   Output all alleles which pass input filters, regardles of" << endl
         << "                   genotyping outcome or model." << endl
+        << "   --pooled-frequencies" << endl
+        << "                   Implies --pooled-continuous.  Estimate the frequency of each" << endl
+        << "                   allele in each sample (pool) by EM on its observation qualities," << endl
+        << "                   without generating genotypes, and set QUAL from the likelihood" << endl
+        << "                   ratio of the estimates against a monomorphic reference.  The" << endl
+        << "                   cost is linear in depth and independent of --ploidy.  Samples" << endl
+        << "                   have DP, RO, QR, AO, QA and AF (estimated frequency) fields." << endl
         << endl
         << "reference allele:" << endl
         << endl
@@ -203,6 +210,11 @@ void Parameters::usage(char** argv) {
         << "   --min-repeat-entropy N" << endl
         << "                   To detect interrupted repeats, build across sequence until it has" << endl
         << "                   entropy > N bits per bp.  (default: 0, off)" << endl
+        << "   --repeat-index FILE" << endl
+        << "                   Take the repeat structure of the reference from FILE, as" << endl
+        << "                   written by repeatindex, rather than scanning the cached" << endl
+        << "                   reference around each indel.  Repeats are then measured over" << endl
+        << "                   the whole reference, independent of the region being called." << endl
         << "   --no-partial-observations" << endl
         << "                   Exclude observations which do not fully span the dynamically-determined" << endl
         << "                   detection window.  (default, use all observations, dividing partial" << endl
@@ -268,6 +280,13 @@ void Parameters::usage(char** argv) {
         << "                   to use the allele in analysis.  default: 1" << endl
         << "   -! --min-coverage N" << endl
         << "                   Require at least this coverage to process a site.  default: 0" << endl
+        << "   --max-coverage N" << endl
+        << "                   Downsample each sample to at most N reads over any position," << endl
+        << "                   choosing reads by a hash of their names, so that mates and" << endl
+        << "                   reruns agree.  Sites with dropped reads are flagged DS." << endl
+        << "                   default: 0 (off)" << endl
+        << "   --downsample-seed N" << endl
+        << "                   Seed the read name hash used by --max-coverage.  default: 0" << endl
         << endl
         << "population priors:" << endl
         << endl
@@ -285,6 +304,10 @@ void Parameters::usage(char** argv) {
         << "                   Disable incorporation of prior expectations about observations." << endl
         << "                   Uses read placement probability, strand balance probability," << endl
         << "                   and read position (5'-3') probability." << endl
+        << "   --binomial-obs-priors-depth N" << endl
+        << "                   Precompute the observation priors for up to N observations of" << endl
+        << "                   an allele, at most 5000.  Deeper sites are evaluated directly." << endl
+        << "                   default: 1000" << endl
         << "   -a --allele-balance-priors-off" << endl
         << "                   Disable use of aggregate probability of observation balance between alleles" << endl
         << "                   as a component of the priors." << endl
@@ -320,6 +343,32 @@ void Parameters::usage(char** argv) {
         << "   --genotyping-max-banddepth N" << endl
         << "                   Integrate no deeper than the Nth best genotype by likelihood when" << endl
         << "                   genotyping. default: 6." << endl
+        << "   --genotyping-warm-start N" << endl
+        << "                   Seed the genotyping search at a site with the number of alternate" << endl
+        << "                   alleles each sample carried in the best genotyping of the previous" << endl
+        << "                   site, if that site is within N bp.  Usually reduces the number of" << endl
+        << "                   iterations (GTI) at clustered sites.  The seed is used only if it" << endl
+        << "                   scores at least as well as the usual data likelihood maximum, but" << endl
+        << "                   the search may still converge to a different local maximum, so" << endl
+        << "                   output may differ from that without this option." << endl
+        << "                   default: 0 (disabled)" << endl
+        << "   --genotyping-max-work N" << endl
+        << "                   Estimate the work, in genotype evaluations, of exhaustive, banded" << endl
+        << "                   and single-iteration genotyping searches at each site, and use the" << endl
+        << "                   most thorough one which is expected to cost no more than N.  The" << endl
+        << "                   searches are expected to converge in one iteration per estimated" << endl
+        << "                   minor allele at the site plus one, up to --genotyping-max-iterations." << endl
+        << "                   The search used is recorded in GTA.  default: 0 (exhaustive search," << endl
+        << "                   banded when there are more than --genotyping-max-banddepth alleles)" << endl
+        << "   --genotype-count-band Z" << endl
+        << "                   For samples of ploidy greater than 2, only consider genotypes in" << endl
+        << "                   which the count of each allele is within Z standard errors (plus" << endl
+        << "                   one observation) of the frequency observed in the sample, and the" << endl
+        << "                   homozygous genotypes.  Samples without observations consider the" << endl
+        << "                   genotypes of the other samples of the same ploidy.  Genotypes" << endl
+        << "                   outside every band are never generated, so this bounds the cost" << endl
+        << "                   of high-ploidy and pooled analyses by the data rather than by the" << endl
+        << "                   ploidy.  default: 0 (consider all genotypes)" << endl
         << "   -W --posterior-integration-limits N,M" << endl
         << "                   Integrate all genotype combinations in our posterior space" << endl
         << "                   which include no more than N samples with their Mth best" << endl
@@ -347,6 +396,11 @@ void Parameters::usage(char** argv) {
         << endl
         << "   -d --debug      Print debugging output." << endl
         << "   -dd             Print more verbose debugging output (requires \"make DEBUG\")" << endl
+        << "   --no-candidate-skipping" << endl
+        << "                   Process every position in the target regions, rather than" << endl
+        << "                   skipping ahead to the next position at which an alignment has" << endl
+        << "                   an alternate allele.  Output should be identical; this is for" << endl
+        << "                   checking that with scripts/compare_candidate_skipping.py." << endl
         << endl
         << endl
         << "author:   Erik Garrison <erik.garrison@bc.edu>, Marth Lab, Boston College, 2010-2014" << endl
@@ -401,15 +455,18 @@ Parameters::Parameters(int argc, char** argv) {
     maxComplexGap = 3;
     //maxHaplotypeLength = 100;
     minRepeatSize = 5;
+    repeatIndexFile = "";
     minRepeatEntropy = 0;
     usePartialObservations = true;
     pooledDiscrete = false;                 // -J --pooled
     pooledContinuous = false;
+    pooledFrequencies = false;
     ewensPriors = true;
     permute = true;                // -K --permute
     useMappingQuality = false;
     useMinIndelQuality = true;
     obsBinomialPriors = true;
+    obsBinomialPriorsTableDepth = DEFAULT_HALF_BINOMIAL_TABLE_DEPTH;
     hwePriors = true;
     alleleBalancePriors = true;
     excludeUnobservedGenotypes = false;
@@ -419,10 +476,14 @@ Parameters::Parameters(int argc, char** argv) {
     reportGenotypeLikelihoodMax = false;
     genotypingMaxIterations = 1000;
     genotypingMaxBandDepth = 7;
+    genotypingWarmStartWindow = 0;
+    genotypingMaxWork = 0;
+    genotypeCountBand = 0;
     minPairedAltCount = 0;
     minAltMeanMapQ = 0;
     reportAllHaplotypeAlleles = false;
     reportMonomorphic = false;
+    skipToCandidatePositions = true;
     boundIndels = true; // ignore indels at ends of reads
     onlyUseInputAlleles = false;
     standardGLs = true;
@@ -455,6 +516,8 @@ Parameters::Parameters(int argc, char** argv) {
     probContamination = 10e-9;
     //minAltQSumTotal = 0;
     minCoverage = 0;
+    maxCoverage = 0;
+    downsampleSeed = 0;
     debuglevel = 0;
     debug = false;
     debug2 = false;
@@ -488,6 +551,7 @@ Parameters::Parameters(int argc, char** argv) {
             {"ploidy", required_argument, 0, 'p'},
             {"pooled-discrete", no_argument, 0, 'J'},
             {"pooled-continuous", no_argument, 0, 'K'},
+            {"pooled-frequencies", no_argument, 0, '~'},
             {"no-population-priors", no_argument, 0, 'k'},
             {"use-mapping-quality", no_argument, 0, 'j'},
             {"min-mapping-quality", required_argument, 0, 'm'},
@@ -507,12 +571,14 @@ Parameters::Parameters(int argc, char** argv) {
             {"haplotype-length", required_argument, 0, 'E'},
             {"min-repeat-size", required_argument, 0, 'E'},
             {"min-repeat-entropy", required_argument, 0, 'E'},
+            {"repeat-index", required_argument, 0, '<'},
             {"no-snps", no_argument, 0, 'I'},
             {"indel-exclusion-window", required_argument, 0, 'x'},
             {"theta", required_argument, 0, 'T'},
             {"pvar", required_argument, 0, 'P'},
             {"read-dependence-factor", required_argument, 0, 'D'},
             {"binomial-obs-priors-off", no_argument, 0, 'V'},
+            {"binomial-obs-priors-depth", required_argument, 0, '#'},
             {"allele-balance-priors-off", no_argument, 0, 'a'},
             {"hwe-priors-off", no_argument, 0, 'w'},
             {"posterior-integration-limits", required_argument, 0, 'W'},
@@ -524,6 +590,8 @@ Parameters::Parameters(int argc, char** argv) {
             //{"min-alternate-mean-mapq", required_argument, 0, 'k'},
             {"min-alternate-qsum", required_argument, 0, '3'},
             {"min-coverage", required_argument, 0, '!'},
+            {"max-coverage", required_argument, 0, '+'},
+            {"downsample-seed", required_argument, 0, '*'},
             {"genotype-qualities", no_argument, 0, '='},
             {"variant-input", required_argument, 0, '@'},
             {"only-use-input-alleles", no_argument, 0, 'l'},
@@ -533,6 +601,9 @@ Parameters::Parameters(int argc, char** argv) {
             {"site-selection-max-iterations", required_argument, 0, 'M'},
             {"genotyping-max-iterations", required_argument, 0, 'B'},
             {"genotyping-max-banddepth", required_argument, 0, '7'},
+            {"genotyping-warm-start", required_argument, 0, 'g'},
+            {"genotyping-max-work", required_argument, 0, 'y'},
+            {"genotype-count-band", required_argument, 0, 'o'},
             {"haplotype-basis-alleles", required_argument, 0, '9'},
             {"report-genotype-likelihood-max", no_argument, 0, '5'},
             {"report-all-haplotype-alleles", no_argument, 0, '6'},
@@ -541,6 +612,7 @@ Parameters::Parameters(int argc, char** argv) {
             {"prob-contamination", required_argument, 0, '_'},
             {"contamination-estimates", required_argument, 0, ','},
             {"report-monomorphic", no_argument, 0, '6'},
+            {"no-candidate-skipping", no_argument, 0, '>'},
             {"debug", no_argument, 0, 'd'},
             {0, 0, 0, 0}
 
@@ -549,7 +621,7 @@ Parameters::Parameters(int argc, char** argv) {
     while (true) {
 
         int option_index = 0;
-        c = getopt_long(argc, argv, "hcO4ZKjH[0diN5a)Ik=wl6uVXJY:b:G:M:x:@:A:f:t:r:s:v:n:B:p:m:q:R:Q:U:$:e:T:P:D:^:S:W:F:C:&:L:8:z:1:3:E:7:2:9:%:(:_:,:",
+        c = getopt_long(argc, argv, "hcO4ZKjH[0diN5a)Ik=wl6uVXJ~>Y:b:G:M:x:@:A:f:t:r:s:v:n:B:p:m:q:R:Q:U:$:e:T:P:D:^:S:W:F:C:&:L:8:z:1:3:E:7:2:9:%:(:_:,:#:g:y:o:+:*:<:",
                         long_options, &option_index);
 
         if (c == -1) // end of options
@@ -660,6 +732,34 @@ Parameters::Parameters(int argc, char** argv) {
             }
             break;
 
+            // --max-coverage
+        case '+':
+            if (!convert(optarg, maxCoverage)) {
+                cerr << "could not parse max-coverage" << endl;
+                exit(1);
+            }
+            break;
+
+            // --downsample-seed
+        case '*':
+            if (!convert(optarg, downsampleSeed)) {
+                cerr << "could not parse downsample-seed" << endl;
+                exit(1);
+            }
+            break;
+
+            // --repeat-index
+        case '<':
+            repeatIndexFile = optarg;
+            break;
+
+            // --no-candidate-skipping
+            // step through every position, for comparison with the default
+            // skipping by scripts/compare_candidate_skipping.py
+        case '>':
+            skipToCandidatePositions = false;
+            break;
+
             // -n --use-best-n-alleles
         case 'n':
             if (!convert(optarg, useBestNAlleles)) {
@@ -735,6 +835,30 @@ Parameters::Parameters(int argc, char** argv) {
             }
             break;
 
+            // --genotyping-warm-start
+        case 'g':
+            if (!convert(optarg, genotypingWarmStartWindow)) {
+                cerr << "could not parse genotyping-warm-start" << endl;
+                exit(1);
+            }
+            break;
+
+            // --genotyping-max-work
+        case 'y':
+            if (!convert(optarg, genotypingMaxWork)) {
+                cerr << "could not parse genotyping-max-work" << endl;
+                exit(1);
+            }
+            break;
+
+            // --genotype-count-band
+        case 'o':
+            if (!convert(optarg, genotypeCountBand)) {
+                cerr << "could not parse genotype-count-band" << endl;
+                exit(1);
+            }
+            break;
+
             // -1 --reference-quality
         case '1':
             if (!convert(split(optarg, ",").front(), MQR)) {
@@ -910,6 +1034,18 @@ Parameters::Parameters(int argc, char** argv) {
             obsBinomialPriors = false;
             break;
 
+            // --binomial-obs-priors-depth
+        case '#':
+            if (!convert(optarg, obsBinomialPriorsTableDepth)) {
+                cerr << "could not parse binomial-obs-priors-depth" << endl;
+                exit(1);
+            }
+            if (obsBinomialPriorsTableDepth < 0 || obsBinomialPriorsTableDepth > MAX_HALF_BINOMIAL_TABLE_DEPTH) {
+                cerr << "binomial-obs-priors-depth must be between 0 and " << MAX_HALF_BINOMIAL_TABLE_DEPTH << endl;
+                exit(1);
+            }
+            break;
+
             // allele balance
         case 'a':
             alleleBalancePriors = false;
@@ -959,6 +1095,12 @@ Parameters::Parameters(int argc, char** argv) {
             pooledContinuous = true;
             break;
 
+            // --pooled-frequencies
+        case '~':
+            pooledContinuous = true;
+            pooledFrequencies = true;
+            break;
+
         case '=':
             calculateMarginals = true;
             break;
@@ -52,6 +52,7 @@ public:
     // operation parameters
     bool outputAlleles;          //  unused...
     bool trace;                  // -L --trace
+    bool skipToCandidatePositions; // off with --no-candidate-skipping
     bool useDuplicateReads;      // -E --use-duplicate-reads
     bool suppressOutput;         // -S --suppress-output
     int useBestNAlleles;         // -n --use-best-n-alleles
@@ -65,21 +66,27 @@ public:
     int maxComplexGap;
     //int maxHaplotypeLength;
     int minRepeatSize;
+    string repeatIndexFile;      // --repeat-index
     double minRepeatEntropy;
     bool usePartialObservations;
     bool allowSNPs;              // -I --no-snps
     bool pooledDiscrete;
     bool pooledContinuous;
+    bool pooledFrequencies;      // --pooled-frequencies
     bool ewensPriors;
     bool permute;                //    --permute
     bool useMappingQuality;      //
     bool useMinIndelQuality;
     bool obsBinomialPriors;
+    int obsBinomialPriorsTableDepth;
     bool alleleBalancePriors;
     bool hwePriors;
     bool reportGenotypeLikelihoodMax;
     int genotypingMaxIterations;
     int genotypingMaxBandDepth;
+    int genotypingWarmStartWindow; // --genotyping-warm-start
+    double genotypingMaxWork;    // --genotyping-max-work
+    double genotypeCountBand;    // --genotype-count-band
     bool excludePartiallyObservedGenotypes;
     bool excludeUnobservedGenotypes;
     float genotypeVariantThreshold;
@@ -101,14 +108,14 @@ public:
     int readSnpLimit;            // -$ --read-snp-limit
     int readIndelLimit;          // -e --read-indel-limit
     int IDW;                     // -I --indel-exclusion-window
-    long double TH;              // -T --theta
-    long double PVL;             // -P --pvar
+    ModelFloat TH;              // -T --theta
+    ModelFloat PVL;             // -P --pvar
                                  // -K --posterior-integration-depth
     int posteriorIntegrationDepth;
     bool calculateMarginals;
     string algorithm;
     double RDF;             // -D --read-dependence-factor
-    long double diffusionPriorScalar; // -V --diffusion-prior-scalar
+    ModelFloat diffusionPriorScalar; // -V --diffusion-prior-scalar
     int WB;                      // -W --posterior-integration-bandwidth
     // XXX adjusting this to anything other than 1 may have bad consequences
     // for large numbers of samples
@@ -116,10 +123,12 @@ public:
     bool includeMonoB;
     int TR;
     int I;
-    long double minAltFraction;  // -F --min-alternate-fraction
+    ModelFloat minAltFraction;  // -F --min-alternate-fraction
     int minAltCount;             // -C --min-alternate-count
     int minAltTotal;             // -G --min-alternate-total
     int minCoverage;             // -! --min-coverage
+    int maxCoverage;             // --max-coverage
+    unsigned int downsampleSeed; // --downsample-seed
     int debuglevel;              // -d --debug increments
     bool debug; // set if debuglevel >=1
     bool debug2; // set if debuglevel >=2
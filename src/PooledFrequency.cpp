@@ -0,0 +1,123 @@
+#include "PooledFrequency.h"
+
+// Each observation of allele j with error probability e has likelihood 1 - e
+// given that it was drawn from allele j, and e / (K - 1) given any of the
+// other K - 1 alleles.  Observations with the same allele and error
+// probability contribute identically, so they are counted once, and each EM
+// iteration is over the distinct (allele, quality) pairs rather than the reads.
+void estimatePooledFrequencies(
+    PooledFrequencyEstimate& estimate,
+    Sample& sample,
+    vector<Allele>& alleles,
+    int referenceIndex,
+    bool useMapQ,
+    int maxIterations,
+    ModelFloat tolerance) {
+
+    int K = alleles.size();
+    estimate.frequencies.assign(K, 0);
+    estimate.loglikelihood = 0;
+    estimate.referenceLoglikelihood = 0;
+    estimate.observations = 0;
+    estimate.iterations = 0;
+    if (K == 0) {
+        return;
+    }
+
+    // observation counts by allele and error probability
+    vector<map<ModelFloat, int> > errorCounts(K);
+    vector<int> alleleCounts(K, 0);
+    for (int j = 0; j < K; ++j) {
+        Sample::iterator s = sample.find(alleles[j].currentBase);
+        if (s == sample.end()) {
+            continue;
+        }
+        vector<Allele*>& observations = s->second;
+        for (vector<Allele*>::iterator a = observations.begin(); a != observations.end(); ++a) {
+            Allele& obs = **a;
+            ModelFloat correct = 1 - exp(obs.lnquality);
+            if (useMapQ) {
+                correct *= 1 - exp(obs.lnmapQuality);
+            }
+            ++errorCounts[j][1 - correct];
+        }
+        alleleCounts[j] = observations.size();
+        estimate.observations += observations.size();
+    }
+
+    if (estimate.observations == 0) {
+        if (referenceIndex >= 0) {
+            estimate.frequencies[referenceIndex] = 1;
+        }
+        return;
+    }
+
+    ModelFloat others = max(K - 1, 1);
+
+    // start from the observed proportions, smoothed so that no allele starts
+    // at 0, from which EM cannot move it
+    vector<ModelFloat>& f = estimate.frequencies;
+    for (int k = 0; k < K; ++k) {
+        f[k] = (ModelFloat) (alleleCounts[k] + 1) / (ModelFloat) (estimate.observations + K);
+    }
+
+    vector<ModelFloat> expected(K, 0);
+    for (estimate.iterations = 1; estimate.iterations <= maxIterations; ++estimate.iterations) {
+        fill(expected.begin(), expected.end(), 0);
+        for (int j = 0; j < K; ++j) {
+            for (map<ModelFloat, int>::iterator c = errorCounts[j].begin(); c != errorCounts[j].end(); ++c) {
+                ModelFloat error = c->first;
+                ModelFloat mismatch = error / others;
+                ModelFloat match = 1 - error;
+                ModelFloat total = f[j] * match + (1 - f[j]) * mismatch;
+                if (total <= 0) {
+                    continue;
+                }
+                ModelFloat weight = c->second / total;
+                for (int k = 0; k < K; ++k) {
+                    expected[k] += weight * f[k] * (k == j ? match : mismatch);
+                }
+            }
+        }
+        ModelFloat change = 0;
+        for (int k = 0; k < K; ++k) {
+            ModelFloat next = expected[k] / estimate.observations;
+            change = max(change, (ModelFloat) fabs(next - f[k]));
+            f[k] = next;
+        }
+        if (change < tolerance) {
+            break;
+        }
+    }
+    estimate.iterations = min(estimate.iterations, maxIterations);
+
+    // likelihoods at the estimate, and with only the reference allele
+    for (int j = 0; j < K; ++j) {
+        for (map<ModelFloat, int>::iterator c = errorCounts[j].begin(); c != errorCounts[j].end(); ++c) {
+            ModelFloat error = c->first;
+            ModelFloat mismatch = error / others;
+            ModelFloat match = 1 - error;
+            estimate.loglikelihood += c->second * log(f[j] * match + (1 - f[j]) * mismatch);
+            if (referenceIndex >= 0) {
+                estimate.referenceLoglikelihood += c->second * log(j == referenceIndex ? match : mismatch);
+            }
+        }
+    }
+    if (referenceIndex < 0) {
+        estimate.referenceLoglikelihood = estimate.loglikelihood;
+    }
+
+}
+
+ModelFloat pooledMonomorphicProbln(map<string, PooledFrequencyEstimate>& estimates) {
+    // ln(L0 / (L0 + L1)) = -ln(1 + exp(ln L1 - ln L0))
+    ModelFloat ratio = 0;
+    for (map<string, PooledFrequencyEstimate>::iterator e = estimates.begin(); e != estimates.end(); ++e) {
+        ratio += max((ModelFloat) 0, e->second.loglikelihood - e->second.referenceLoglikelihood);
+    }
+    if (ratio > 50) {
+        return -ratio;
+    } else {
+        return -log(1 + exp(ratio));
+    }
+}
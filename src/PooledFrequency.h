@@ -0,0 +1,51 @@
+#ifndef __POOLED_FREQUENCY_H
+#define __POOLED_FREQUENCY_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <cmath>
+#include "Allele.h"
+#include "Sample.h"
+#include "Utility.h"
+
+using namespace std;
+
+// allele frequencies in a continuous pool, estimated by EM directly on the
+// qualities of the pool's observations.  no genotypes are enumerated, so the
+// cost is linear in depth and does not depend on the number of individuals
+// in the pool.
+class PooledFrequencyEstimate {
+public:
+    vector<ModelFloat> frequencies;     // in the order of the alleles estimated over
+    ModelFloat loglikelihood;           // ln P(observations | frequencies)
+    ModelFloat referenceLoglikelihood;  // ln P(observations | only the reference allele)
+    int observations;                   // observations supporting any of the alleles
+    int iterations;
+
+    PooledFrequencyEstimate(void)
+        : loglikelihood(0)
+        , referenceLoglikelihood(0)
+        , observations(0)
+        , iterations(0)
+    { }
+};
+
+#define DEFAULT_POOLED_FREQUENCY_MAX_ITERATIONS 100
+#define DEFAULT_POOLED_FREQUENCY_TOLERANCE 1e-6
+
+// referenceIndex is the index of the reference allele in alleles, or -1
+void estimatePooledFrequencies(
+    PooledFrequencyEstimate& estimate,
+    Sample& sample,
+    vector<Allele>& alleles,
+    int referenceIndex,
+    bool useMapQ,
+    int maxIterations = DEFAULT_POOLED_FREQUENCY_MAX_ITERATIONS,
+    ModelFloat tolerance = DEFAULT_POOLED_FREQUENCY_TOLERANCE);
+
+// ln of the probability that no pool carries an alternate allele, taking
+// each pool's likelihood ratio against the reference with even prior odds
+ModelFloat pooledMonomorphicProbln(map<string, PooledFrequencyEstimate>& estimates);
+
+#endif
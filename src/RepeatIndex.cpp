@@ -0,0 +1,341 @@
+#include "RepeatIndex.h"
+
+bool operator<(const RepeatTract& a, const RepeatTract& b) {
+    if (a.position == b.position) {
+        return a.period < b.period;
+    } else {
+        return a.position < b.position;
+    }
+}
+
+// the bases which can make up a repeat
+bool isRepeatBase(char base) {
+    return base == 'A' || base == 'C' || base == 'G' || base == 'T';
+}
+
+void findRepeatTracts(const string& sequence, int maxPeriod, int minLength, vector<RepeatTract>& tracts) {
+
+    long int n = sequence.size();
+    size_t first = tracts.size();
+
+    for (int i = 1; i <= maxPeriod; ++i) {
+        // start of the current run of bases matching the base i before them
+        long int runStart = -1;
+        for (long int x = i; x <= n; ++x) {
+            if (x < n && sequence[x] == sequence[x - i] && isRepeatBase(sequence[x])) {
+                if (runStart < 0) {
+                    runStart = x;
+                }
+            } else if (runStart >= 0) {
+                long int start = runStart - i;
+                int length = x - start;
+                if (length >= 2 * i && length >= minLength) {
+                    RollingEntropy tractEntropy;
+                    for (long int j = start; j < x; ++j) {
+                        tractEntropy.add(sequence[j]);
+                    }
+                    tracts.push_back(RepeatTract(start, length, i, tractEntropy.value()));
+                }
+                runStart = -1;
+            }
+        }
+    }
+
+    sort(tracts.begin() + first, tracts.end());
+
+}
+
+map<string, int> sequenceRepeatCounts(long int position, const string& sequence, int maxsize) {
+    map<string, int> counts;
+    for (int i = 1; i <= maxsize; ++i) {
+        // subseq here i bases
+        string seq = sequence.substr(position, i);
+        // go left.
+
+        int j = position - i;
+        int leftsteps = 0;
+        while (j >= 0 && sequence.compare(j, i, seq) == 0) {
+            j -= i;
+            ++leftsteps;
+        }
+
+        // go right.
+        j = position;
+
+        int rightsteps = 0;
+        while (j + i <= sequence.size() && sequence.compare(j, i, seq) == 0) {
+            j += i;
+            ++rightsteps;
+        }
+        // if we went left and right a non-zero number of times, 
+        if (leftsteps + rightsteps > 1) {
+            counts[seq] = leftsteps + rightsteps;
+        }
+    }
+    return counts;
+}
+
+map<string, int> nonRedundantRepeatCounts(const map<string, int>& counts) {
+    if (counts.size() > 1) {
+        map<string, int> filteredcounts;
+        map<string, int>::const_iterator c = counts.begin();
+        string prev = c->first;
+        filteredcounts[prev] = c->second;  // shortest sequence
+        ++c;
+        for (; c != counts.end(); ++c) {
+            int i = 0;
+            string seq = c->first;
+            while (i + prev.length() <= seq.length() && seq.substr(i, prev.length()) == prev) {
+                i += prev.length();
+            }
+            if (i < seq.length()) {
+                filteredcounts[seq] = c->second;
+                prev = seq;
+            }
+        }
+        return filteredcounts;
+    } else {
+        return counts;
+    }
+}
+
+template <class T>
+void writeBinary(ofstream& out, T value) {
+    out.write((char*) &value, sizeof(T));
+}
+
+template <class T>
+bool readBinary(ifstream& in, T& value) {
+    in.read((char*) &value, sizeof(T));
+    return in.good();
+}
+
+bool RepeatIndexWriter::open(const string& filename, int maxPeriod, int minLength) {
+    file.open(filename.c_str(), ios::out | ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    file.write("FBRI", 4);
+    writeBinary(file, (int32_t) REPEAT_INDEX_VERSION);
+    writeBinary(file, (int32_t) maxPeriod);
+    writeBinary(file, (int32_t) minLength);
+    return true;
+}
+
+void writeTract(ofstream& out, const RepeatTract& tract) {
+    writeBinary(out, (uint32_t) tract.position);
+    writeBinary(out, (uint32_t) tract.length);
+    writeBinary(out, (uint8_t) tract.period);
+    writeBinary(out, (float) tract.entropy);
+}
+
+void RepeatIndexWriter::write(const string& sequenceName, const vector<RepeatTract>& tracts) {
+    RepeatIndexEntry entry;
+    entry.name = sequenceName;
+    entry.offset = file.tellp();
+    for (vector<RepeatTract>::const_iterator t = tracts.begin(); t != tracts.end(); ++t) {
+        if (t->length <= REPEAT_INDEX_LONG_TRACT) {
+            writeTract(file, *t);
+            entry.maxLength = max(entry.maxLength, (uint32_t) t->length);
+            ++entry.records;
+        }
+    }
+    entry.longOffset = file.tellp();
+    for (vector<RepeatTract>::const_iterator t = tracts.begin(); t != tracts.end(); ++t) {
+        if (t->length > REPEAT_INDEX_LONG_TRACT) {
+            writeTract(file, *t);
+            ++entry.longRecords;
+        }
+    }
+    directory.push_back(entry);
+}
+
+void RepeatIndexWriter::close(void) {
+    int64_t directoryOffset = file.tellp();
+    for (vector<RepeatIndexEntry>::iterator e = directory.begin(); e != directory.end(); ++e) {
+        writeBinary(file, (uint32_t) e->name.size());
+        file.write(e->name.c_str(), e->name.size());
+        writeBinary(file, e->offset);
+        writeBinary(file, e->records);
+        writeBinary(file, e->maxLength);
+        writeBinary(file, e->longOffset);
+        writeBinary(file, e->longRecords);
+    }
+    writeBinary(file, directoryOffset);
+    writeBinary(file, (int32_t) directory.size());
+    file.write("FBRI", 4);
+    file.close();
+}
+
+bool RepeatIndex::open(const string& filename) {
+
+    file.open(filename.c_str(), ios::in | ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    char magic[4];
+    int32_t version, period, length;
+    file.read(magic, 4);
+    if (!file.good() || string(magic, 4) != "FBRI"
+        || !readBinary(file, version) || version != REPEAT_INDEX_VERSION
+        || !readBinary(file, period) || !readBinary(file, length)) {
+        return false;
+    }
+    maxPeriod = period;
+    minLength = length;
+
+    int64_t directoryOffset;
+    int32_t sequences;
+    file.seekg(-16, ios::end);
+    if (!readBinary(file, directoryOffset) || !readBinary(file, sequences)) {
+        return false;
+    }
+
+    file.seekg(directoryOffset);
+    for (int i = 0; i < sequences; ++i) {
+        RepeatIndexEntry entry;
+        uint32_t nameLength;
+        if (!readBinary(file, nameLength)) {
+            return false;
+        }
+        entry.name.resize(nameLength);
+        file.read(&entry.name[0], nameLength);
+        if (!readBinary(file, entry.offset)
+            || !readBinary(file, entry.records)
+            || !readBinary(file, entry.maxLength)
+            || !readBinary(file, entry.longOffset)
+            || !readBinary(file, entry.longRecords)) {
+            return false;
+        }
+        directory[entry.name] = entry;
+    }
+
+    return true;
+
+}
+
+RepeatTract RepeatIndex::readTract(int64_t offset, int64_t record) {
+    file.seekg(offset + record * REPEAT_INDEX_RECORD_SIZE);
+    uint32_t position, length;
+    uint8_t period;
+    float entropy;
+    readBinary(file, position);
+    readBinary(file, length);
+    readBinary(file, period);
+    readBinary(file, entropy);
+    return RepeatTract(position, length, period, entropy);
+}
+
+void RepeatIndex::tractsOverlapping(const string& sequenceName, long int start, long int end,
+                                    vector<RepeatTract>& tracts) {
+
+    map<string, RepeatIndexEntry>::iterator e = directory.find(sequenceName);
+    if (e == directory.end()) {
+        return;
+    }
+    RepeatIndexEntry& entry = e->second;
+
+    size_t first = tracts.size();
+
+    // no tract of up to maxLength bp starting before here can reach start
+    long int from = start - (long int) entry.maxLength;
+    int64_t lo = 0;
+    int64_t hi = entry.records;
+    while (lo < hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (readTract(entry.offset, mid).position < from) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (int64_t r = lo; r < entry.records; ++r) {
+        RepeatTract tract = readTract(entry.offset, r);
+        if (tract.position >= end) {
+            break;
+        }
+        if (tract.end() > start) {
+            tracts.push_back(tract);
+        }
+    }
+
+    // the long tracts are few, so are all checked
+    for (int64_t r = 0; r < entry.longRecords; ++r) {
+        RepeatTract tract = readTract(entry.longOffset, r);
+        if (tract.position >= end) {
+            break;
+        }
+        if (tract.end() > start) {
+            tracts.push_back(tract);
+        }
+    }
+
+    if (entry.longRecords > 0) {
+        sort(tracts.begin() + first, tracts.end());
+    }
+
+}
+
+bool tractStartsAfter(long int position, const RepeatTract& tract) {
+    return position < tract.position;
+}
+
+void RepeatIndex::repeatsAt(const string& sequenceName, long int position, const string& units,
+                            map<string, int>& counts, map<string, long int>& rightBoundaries) {
+
+    if (sequenceName != sliceSequence || position < sliceStart || position >= sliceEnd) {
+        vector<RepeatTract> tracts;
+        sliceSequence = sequenceName;
+        sliceStart = position;
+        sliceEnd = position + REPEAT_INDEX_SLICE;
+        tractsOverlapping(sliceSequence, sliceStart, sliceEnd, tracts);
+        slice.clear();
+        sliceLong.clear();
+        sliceMaxLength = 0;
+        for (vector<RepeatTract>::iterator t = tracts.begin(); t != tracts.end(); ++t) {
+            if (t->length > REPEAT_INDEX_LONG_TRACT) {
+                sliceLong.push_back(*t);
+            } else {
+                slice.push_back(*t);
+                sliceMaxLength = max(sliceMaxLength, t->length);
+            }
+        }
+    }
+
+    // walk back over the tracts which start at or before position and are
+    // long enough to reach it
+    vector<RepeatTract>::iterator t = upper_bound(slice.begin(), slice.end(), position, tractStartsAfter);
+    while (t != slice.begin()) {
+        --t;
+        if (t->position < position - sliceMaxLength) {
+            break;
+        }
+        countRepeat(*t, position, units, counts, rightBoundaries);
+    }
+
+    for (t = sliceLong.begin(); t != sliceLong.end() && t->position <= position; ++t) {
+        countRepeat(*t, position, units, counts, rightBoundaries);
+    }
+
+}
+
+void RepeatIndex::countRepeat(const RepeatTract& tract, long int position, const string& units,
+                              map<string, int>& counts, map<string, long int>& rightBoundaries) {
+
+    int i = tract.period;
+    // counts need a whole unit at position inside the tract
+    if (i > (int) units.size() || position < tract.position || position + i > tract.end()) {
+        return;
+    }
+    int leftsteps = (position - tract.position) / i;
+    int count = leftsteps + (tract.end() - position) / i;
+    if (count > 1) {
+        string unit = units.substr(0, i);
+        counts[unit] = count;
+        long int leftbound = position - leftsteps * i;
+        rightBoundaries[unit] = leftbound + count * i + 1;
+    }
+
+}
@@ -0,0 +1,137 @@
+#ifndef REPEATINDEX_H
+#define REPEATINDEX_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <stdint.h>
+#include "Utility.h"
+
+using namespace std;
+
+// a maximal tandem repeat in the reference: a run of at least two copies of a
+// unit of period bases, in which each base matches the one period before it
+class RepeatTract {
+public:
+    long int position; // 0-based start
+    int length;        // bases covered, including a trailing partial copy
+    int period;
+    float entropy;     // of the covered sequence, in bits per bp
+
+    RepeatTract(void)
+        : position(0), length(0), period(0), entropy(0) { }
+
+    RepeatTract(long int p, int l, int u, float e)
+        : position(p), length(l), period(u), entropy(e) { }
+
+    long int end(void) const { return position + length; }
+    int copies(void) const { return length / period; }
+};
+
+// by position, then period
+bool operator<(const RepeatTract& a, const RepeatTract& b);
+
+// appends the tracts in sequence of period 1..maxPeriod which cover at least
+// minLength bases, sorted.  each period is a single pass over the sequence.
+// runs of N, or of any other base than A, C, G or T, are not repeats.
+void findRepeatTracts(const string& sequence, int maxPeriod, int minLength, vector<RepeatTract>& tracts);
+
+// the units of 1..maxsize bases starting at position in sequence which occur
+// at least twice in a row there, with their number of copies, scanning the
+// sequence directly.  unlike findRepeatTracts this counts units of any base.
+map<string, int> sequenceRepeatCounts(long int position, const string& sequence, int maxsize);
+
+// drops repeat units which are themselves repeats of the previous unit, as
+// AlleleParser::repeatCounts does
+map<string, int> nonRedundantRepeatCounts(const map<string, int>& counts);
+
+/*
+ * The index file, with integers in host byte order:
+ *
+ *   "FBRI", int32 version, int32 max period, int32 min length
+ *   for each sequence in turn, the records of its tracts of up to
+ *   REPEAT_INDEX_LONG_TRACT bp and then those of its longer tracts, each
+ *   sorted by position then period, and each uint32 position, uint32 length,
+ *   uint8 period, float entropy
+ *   for each sequence, uint32 name length, name, int64 offset of its first
+ *   record, int64 number of records, uint32 longest of those tracts, int64
+ *   offset of its first long tract record, int64 number of long tracts
+ *   int64 offset of the sequence directory, int32 number of sequences, "FBRI"
+ *
+ * Keeping the few long tracts apart bounds how far back a lookup has to
+ * start among the others, wherever a long tract lies.
+ */
+
+#define REPEAT_INDEX_VERSION 2
+#define REPEAT_INDEX_RECORD_SIZE 13
+#define REPEAT_INDEX_SLICE 100000
+#define REPEAT_INDEX_LONG_TRACT 1000
+
+class RepeatIndexEntry {
+public:
+    string name;
+    int64_t offset;
+    int64_t records;
+    uint32_t maxLength; // of the tracts of up to REPEAT_INDEX_LONG_TRACT bp
+    int64_t longOffset;
+    int64_t longRecords;
+
+    RepeatIndexEntry(void) : offset(0), records(0), maxLength(0), longOffset(0), longRecords(0) { }
+};
+
+class RepeatIndexWriter {
+public:
+    bool open(const string& filename, int maxPeriod, int minLength);
+    void write(const string& sequenceName, const vector<RepeatTract>& tracts);
+    void close(void);
+
+private:
+    ofstream file;
+    vector<RepeatIndexEntry> directory;
+};
+
+class RepeatIndex {
+public:
+    int maxPeriod;
+    int minLength;
+
+    RepeatIndex(void)
+        : maxPeriod(0), minLength(0), sliceStart(0), sliceEnd(0), sliceMaxLength(0) { }
+
+    bool open(const string& filename);
+
+    // appends the tracts overlapping [start, end) of the sequence, sorted
+    void tractsOverlapping(const string& sequenceName, long int start, long int end,
+                           vector<RepeatTract>& tracts);
+
+    // the repeat units AlleleParser::repeatCounts counts at position, before
+    // redundant units are dropped, and for each unit the right repeat
+    // boundary makeAllele takes from it.  units is the reference sequence
+    // from position, maxPeriod bases where available.  the slice of the
+    // index around position is loaded as needed.  units containing a base
+    // other than A, C, G or T are never found, see isRepeatBase.
+    void repeatsAt(const string& sequenceName, long int position, const string& units,
+                   map<string, int>& counts, map<string, long int>& rightBoundaries);
+
+private:
+    ifstream file;
+    map<string, RepeatIndexEntry> directory;
+
+    // the tracts last loaded for repeatsAt, with those longer than
+    // REPEAT_INDEX_LONG_TRACT in sliceLong
+    string sliceSequence;
+    long int sliceStart;
+    long int sliceEnd;
+    int sliceMaxLength;
+    vector<RepeatTract> slice;
+    vector<RepeatTract> sliceLong;
+
+    RepeatTract readTract(int64_t offset, int64_t record);
+    void countRepeat(const RepeatTract& tract, long int position, const string& units,
+                     map<string, int>& counts, map<string, long int>& rightBoundaries);
+};
+
+#endif
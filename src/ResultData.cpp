@@ -8,13 +8,14 @@ using namespace std;
 vcf::Variant& Results::vcf(
     vcf::Variant& var, // variant to update
     BigFloat pHom,
-    long double bestComboOddsRatio,
-    //long double alleleSamplingProb,
+    ModelFloat bestComboOddsRatio,
+    //ModelFloat alleleSamplingProb,
     Samples& samples,
     string refbase,
     vector<Allele>& altAllelesIncludingNulls,
     map<string, int> repeats,
 	int genotypingIterations,
+    string genotypingSearch,
     vector<string>& sampleNames,
     int coverage,
     GenotypeCombo& genotypeCombo,
@@ -63,7 +64,7 @@ vcf::Variant& Results::vcf(
     var.filter = ".";
 
     // note that we set QUAL to 0 at loci with no data
-    var.quality = max((long double) 0, nan2zero(big2phred(pHom)));
+    var.quality = max((ModelFloat) 0, nan2zero(big2phred(pHom)));
     if (coverage == 0) {
         var.quality = 0;
     }
@@ -90,9 +91,9 @@ vcf::Variant& Results::vcf(
     unsigned int refEndRight = 0;
     unsigned int refmqsum = 0;
     unsigned int refProperPairs = 0;
-    long double refReadMismatchSum = 0;
-    long double refReadSNPSum = 0;
-    long double refReadIndelSum = 0;
+    ModelFloat refReadMismatchSum = 0;
+    ModelFloat refReadSNPSum = 0;
+    ModelFloat refReadIndelSum = 0;
     unsigned int refObsCount = 0;
     map<string, int> refObsBySequencingTechnology;
 
@@ -132,9 +133,9 @@ vcf::Variant& Results::vcf(
         }
     }
 
-    long double refReadMismatchRate = (refObsCount == 0 ? 0 : refReadMismatchSum / (long double) refObsCount);
-    long double refReadSNPRate = (refObsCount == 0 ? 0 : refReadSNPSum / (long double) refObsCount);
-    long double refReadIndelRate = (refObsCount == 0 ? 0 : refReadIndelSum / (long double) refObsCount);
+    ModelFloat refReadMismatchRate = (refObsCount == 0 ? 0 : refReadMismatchSum / (ModelFloat) refObsCount);
+    ModelFloat refReadSNPRate = (refObsCount == 0 ? 0 : refReadSNPSum / (ModelFloat) refObsCount);
+    ModelFloat refReadIndelRate = (refObsCount == 0 ? 0 : refReadIndelSum / (ModelFloat) refObsCount);
 
     //var.info["XRM"].push_back(convert(refReadMismatchRate));
     //var.info["XRS"].push_back(convert(refReadSNPRate));
@@ -147,6 +148,9 @@ vcf::Variant& Results::vcf(
 
     //var.info["HWE"].push_back(convert(nan2zero(ln2phred(genotypeCombo.hweComboProb()))));
     var.info["GTI"].push_back(convert(genotypingIterations));
+    if (parameters.genotypingMaxWork > 0) {
+        var.info["GTA"].push_back(genotypingSearch);
+    }
 
     // loop over all alternate alleles
     for (vector<Allele>::iterator aa = altAlleles.begin(); aa != altAlleles.end(); ++aa) {
@@ -247,9 +251,9 @@ vcf::Variant& Results::vcf(
         unsigned int altEndRight = 0;
         unsigned int altmqsum = 0;
         unsigned int altproperPairs = 0;
-        long double altReadMismatchSum = 0;
-        long double altReadSNPSum = 0;
-        long double altReadIndelSum = 0;
+        ModelFloat altReadMismatchSum = 0;
+        ModelFloat altReadSNPSum = 0;
+        ModelFloat altReadIndelSum = 0;
         unsigned int altObsCount = 0;
         map<string, int> altObsBySequencingTechnology;
 
@@ -291,9 +295,9 @@ vcf::Variant& Results::vcf(
             }
         }
 
-        long double altReadMismatchRate = (altObsCount == 0 ? 0 : altReadMismatchSum / altObsCount);
-        long double altReadSNPRate = (altObsCount == 0 ? 0 : altReadSNPSum / altObsCount);
-        long double altReadIndelRate = (altObsCount == 0 ? 0 : altReadIndelSum / altObsCount);
+        ModelFloat altReadMismatchRate = (altObsCount == 0 ? 0 : altReadMismatchSum / altObsCount);
+        ModelFloat altReadSNPRate = (altObsCount == 0 ? 0 : altReadSNPSum / altObsCount);
+        ModelFloat altReadIndelRate = (altObsCount == 0 ? 0 : altReadIndelSum / altObsCount);
         
         //var.info["XAM"].push_back(convert(altReadMismatchRate));
         //var.info["XAS"].push_back(convert(altReadSNPRate));
@@ -433,6 +437,10 @@ vcf::Variant& Results::vcf(
     // number of alternate alleles
     var.info["NUMALT"].push_back(convert(altAlleles.size()));
 
+    if (parameters.maxCoverage > 0 && parser->downsampledAt(referencePosition)) {
+        var.infoFlags["DS"] = true;
+    }
+
     if (parameters.showReferenceRepeats && !repeats.empty()) {
         stringstream repeatsstr;
         for (map<string, int>::iterator c = repeats.begin(); c != repeats.end(); ++c) {
@@ -506,7 +514,9 @@ vcf::Variant& Results::vcf(
             sampleOutput["GT"].push_back(genotype->relativeGenotype(refbase, altAlleles));
 
             if (parameters.calculateMarginals) {
-                sampleOutput["GQ"].push_back(convert(nan2zero(big2phred((BigFloat)1 - big_exp(sampleLikelihoods.front().marginal)))));
+                // 1 - exp(marginal) rounds to 0 for confident genotypes, even in BigFloat
+                ModelFloat pWrong = -expm1_model(sampleLikelihoods.front().marginal);
+                sampleOutput["GQ"].push_back(convert(pWrong > 0 ? nan2zero(float2phred(pWrong)) : 0));
             }
 
             sampleOutput["DP"].push_back(convert(sample.observationCount()));
@@ -591,16 +601,16 @@ vcf::Variant& Results::vcf(
                     }
 
                     // normalize GLs to -10 min 0 max using division by max and bounding at -10
-                    long double minGL = 0;
+                    ModelFloat minGL = 0;
                     for (map<int, double>::iterator g = genotypeLikelihoods.begin(); g != genotypeLikelihoods.end(); ++g) {
                         if (g->second < minGL) minGL = g->second;
                     }
-                    long double maxGL = minGL;
+                    ModelFloat maxGL = minGL;
                     for (map<int, double>::iterator g = genotypeLikelihoods.begin(); g != genotypeLikelihoods.end(); ++g) {
                         if (g->second > maxGL) maxGL = g->second;
                     }
                     for (map<int, double>::iterator g = genotypeLikelihoods.begin(); g != genotypeLikelihoods.end(); ++g) {
-                        genotypeLikelihoodsOutput[g->first] = convert( max((long double)-10, (g->second-maxGL)) );
+                        genotypeLikelihoodsOutput[g->first] = convert( max((ModelFloat)-10, (g->second-maxGL)) );
                     }
 
                     vector<string>& datalikelihoods = sampleOutput["GL"];
@@ -617,3 +627,118 @@ vcf::Variant& Results::vcf(
     return var;
 
 }
+
+vcf::Variant& Results::pooledFrequencyVcf(
+    vcf::Variant& var,
+    ModelFloat pMonomorphicln,
+    Samples& samples,
+    string refbase,
+    vector<Allele>& genotypeAlleles,
+    map<string, PooledFrequencyEstimate>& estimates,
+    vector<string>& sampleNames,
+    int coverage,
+    map<string, vector<Allele*> >& alleleGroups,
+    AlleleParser* parser) {
+
+    var.ref = refbase;
+    assert(!var.ref.empty());
+
+    var.sequenceName = parser->currentSequenceName;
+    var.position = (long int) parser->currentPosition + 1;
+    var.id = ".";
+    var.filter = ".";
+
+    // note that we set QUAL to 0 at loci with no data
+    var.quality = max((ModelFloat) 0, nan2zero(ln2phred(pMonomorphicln)));
+    if (coverage == 0) {
+        var.quality = 0;
+    }
+
+    var.format.clear();
+    var.format.push_back("DP");
+    var.format.push_back("RO");
+    var.format.push_back("QR");
+    var.format.push_back("AO");
+    var.format.push_back("QA");
+    var.format.push_back("AF");
+
+    // the site-wide frequency of each allele, averaged over pools by depth
+    vector<ModelFloat> siteFrequencies(genotypeAlleles.size(), 0);
+    int estimatedObservations = 0;
+    for (map<string, PooledFrequencyEstimate>::iterator e = estimates.begin(); e != estimates.end(); ++e) {
+        PooledFrequencyEstimate& estimate = e->second;
+        for (int i = 0; i < genotypeAlleles.size(); ++i) {
+            siteFrequencies[i] += estimate.frequencies[i] * estimate.observations;
+        }
+        estimatedObservations += estimate.observations;
+    }
+
+    int numalt = 0;
+    for (int i = 0; i < genotypeAlleles.size(); ++i) {
+        Allele& altAllele = genotypeAlleles[i];
+        if (altAllele.isReference() || altAllele.isNull()) {
+            continue;
+        }
+        ++numalt;
+        string altbase = altAllele.base();
+        var.alt.push_back(altAllele.alternateSequence);
+
+        map<string, vector<Allele*> >::iterator f = alleleGroups.find(altbase);
+        var.info["AO"].push_back(convert((f == alleleGroups.end()) ? 0 : f->second.size()));
+        var.info["QA"].push_back(convert(samples.qualSum(altbase)));
+        var.info["AF"].push_back(convert((estimatedObservations == 0) ? 0 : siteFrequencies[i] / estimatedObservations));
+        var.info["CIGAR"].push_back(altAllele.cigar);
+        var.info["LEN"].push_back(convert(altAllele.length));
+
+        if (altAllele.type == ALLELE_DELETION) {
+            var.info["TYPE"].push_back("del");
+        } else if (altAllele.type == ALLELE_INSERTION) {
+            var.info["TYPE"].push_back("ins");
+        } else if (altAllele.type == ALLELE_COMPLEX) {
+            var.info["TYPE"].push_back("complex");
+        } else if (altAllele.type == ALLELE_SNP) {
+            var.info["TYPE"].push_back("snp");
+        } else if (altAllele.type == ALLELE_MNP) {
+            var.info["TYPE"].push_back("mnp");
+        }
+    }
+
+    map<string, vector<Allele*> >::iterator f = alleleGroups.find(refbase);
+    var.info["NS"].push_back(convert(estimates.size()));
+    var.info["DP"].push_back(convert(coverage));
+    var.info["RO"].push_back(convert((f == alleleGroups.end()) ? 0 : f->second.size()));
+    var.info["QR"].push_back(convert(samples.qualSum(refbase)));
+    var.info["NUMALT"].push_back(convert(numalt));
+
+    if (parser->parameters.maxCoverage > 0 && parser->downsampledAt(parser->currentPosition)) {
+        var.infoFlags["DS"] = true;
+    }
+
+    for (vector<string>::iterator sn = sampleNames.begin(); sn != sampleNames.end(); ++sn) {
+        string& sampleName = *sn;
+        map<string, PooledFrequencyEstimate>::iterator e = estimates.find(sampleName);
+        Samples::iterator s = samples.find(sampleName);
+        if (e == estimates.end() || s == samples.end()) {
+            continue;
+        }
+        Sample& sample = s->second;
+        PooledFrequencyEstimate& estimate = e->second;
+        map<string, vector<string> >& sampleOutput = var.samples[sampleName];
+        sampleOutput["DP"].push_back(convert(sample.observationCount()));
+        sampleOutput["RO"].push_back(convert(sample.observationCount(refbase)));
+        sampleOutput["QR"].push_back(convert(sample.qualSum(refbase)));
+        for (int i = 0; i < genotypeAlleles.size(); ++i) {
+            Allele& altAllele = genotypeAlleles[i];
+            if (altAllele.isReference() || altAllele.isNull()) {
+                continue;
+            }
+            string altbase = altAllele.base();
+            sampleOutput["AO"].push_back(convert(sample.observationCount(altbase)));
+            sampleOutput["QA"].push_back(convert(sample.qualSum(altbase)));
+            sampleOutput["AF"].push_back(convert(estimate.frequencies[i]));
+        }
+    }
+
+    return var;
+
+}
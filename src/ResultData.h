@@ -11,14 +11,15 @@
 #include "Variant.h"
 #include "version_git.h"
 #include "Result.h"
+#include "PooledFrequency.h"
 
 using namespace std;
 
 // for sorting data likelihoods
 class DataLikelihoodCompare {
 public:
-    bool operator()(const pair<Genotype*, long double>& a,
-            const pair<Genotype*, long double>& b) {
+    bool operator()(const pair<Genotype*, ModelFloat>& a,
+            const pair<Genotype*, ModelFloat>& b) {
         return a.second > b.second;
     }
 };
@@ -43,13 +44,14 @@ public:
     vcf::Variant& vcf(
         vcf::Variant& var, // variant to update
         BigFloat pHom,
-        long double bestComboOddsRatio,
-        //long double alleleSamplingProb,
+        ModelFloat bestComboOddsRatio,
+        //ModelFloat alleleSamplingProb,
         Samples& samples,
         string refbase,
         vector<Allele>& altAlleles,
         map<string, int> repeats,
 	int genotypingIterations,
+        string genotypingSearch,
         vector<string>& sampleNames,
         int coverage,
         GenotypeCombo& genotypeCombo,
@@ -59,6 +61,20 @@ public:
         map<int, vector<Genotype> >& genotypesByPloidy,
         vector<string>& sequencingTechnologies,
         AlleleParser* parser);
+
+    // --pooled-frequencies: site and per-sample observation counts and
+    // estimated allele frequencies, without genotypes
+    vcf::Variant& pooledFrequencyVcf(
+        vcf::Variant& var,
+        ModelFloat pMonomorphicln,
+        Samples& samples,
+        string refbase,
+        vector<Allele>& genotypeAlleles,
+        map<string, PooledFrequencyEstimate>& estimates,
+        vector<string>& sampleNames,
+        int coverage,
+        map<string, vector<Allele*> >& alleleGroups,
+        AlleleParser* parser);
 };
 
 
@@ -166,7 +166,7 @@ double Samples::partialQualSum(const string& base) {
 }
 
 map<string, double> Samples::estimatedAlleleFrequencies(void) {
-    map<string, long double> qualsums;
+    map<string, ModelFloat> qualsums;
     for (Samples::iterator s = begin(); s != end(); ++s) {
         Sample& sample = s->second;
         for (Sample::iterator o = sample.begin(); o != sample.end(); ++o) {
@@ -174,12 +174,12 @@ map<string, double> Samples::estimatedAlleleFrequencies(void) {
             qualsums[base] += sample.qualSum(base);
         }
     }
-    long double total = 0;
-    for (map<string, long double>::iterator q = qualsums.begin(); q != qualsums.end(); ++q) {
+    ModelFloat total = 0;
+    for (map<string, ModelFloat>::iterator q = qualsums.begin(); q != qualsums.end(); ++q) {
         total += q->second;
     }
     map<string, double> freqs;
-    for (map<string, long double>::iterator q = qualsums.begin(); q != qualsums.end(); ++q) {
+    for (map<string, ModelFloat>::iterator q = qualsums.begin(); q != qualsums.end(); ++q) {
         freqs[q->first] = q->second / total;
         //cerr << "estimated frequency " << q->first << " " << freqs[q->first] << endl;
     }
@@ -470,3 +470,45 @@ void Samples::setSupportedAlleles(void) {
     for (Samples::iterator s = begin(); s != end(); ++s)
         s->second.setSupportedAlleles();
 }
+
+void Sample::clear(void) {
+    map<string, vector<Allele*> >::clear();
+    observationTallies.clear();
+}
+
+const ObservationTally& Sample::observationTally(const string& base) const {
+    map<string, ObservationTally>::iterator t = observationTallies.find(base);
+    if (t != observationTallies.end()) {
+        return t->second;
+    }
+    ObservationTally& tally = observationTallies[base];
+    Sample::const_iterator s = find(base);
+    if (s != end()) {
+        const vector<Allele*>& alleles = s->second;
+        tally.observations = alleles.size();
+        for (vector<Allele*>::const_iterator a = alleles.begin(); a != alleles.end(); ++a) {
+            const Allele& allele = **a;
+            if (allele.strand == STRAND_FORWARD) {
+                ++tally.forwardStrand;
+            } else {
+                ++tally.reverseStrand;
+            }
+            if (allele.basesLeft >= allele.basesRight) {
+                ++tally.placedLeft;
+                if (allele.strand == STRAND_FORWARD) {
+                    ++tally.placedStart;
+                } else {
+                    ++tally.placedEnd;
+                }
+            } else {
+                ++tally.placedRight;
+                if (allele.strand == STRAND_FORWARD) {
+                    ++tally.placedEnd;
+                } else {
+                    ++tally.placedStart;
+                }
+            }
+        }
+    }
+    return tally;
+}
@@ -33,6 +33,30 @@ StrandBaseCounts(int fr,
 
 };
 
+// strand and placement totals over a sample's observations of one allele,
+// which is all the observation priors use of them
+class ObservationTally {
+
+public:
+    int observations;
+    int forwardStrand;
+    int reverseStrand;
+    int placedLeft;
+    int placedRight;
+    int placedStart;
+    int placedEnd;
+
+ObservationTally(void)
+    : observations(0)
+        , forwardStrand(0)
+        , reverseStrand(0)
+        , placedLeft(0)
+        , placedRight(0)
+        , placedStart(0)
+        , placedEnd(0) { }
+
+};
+
 // sample tracking and allele sorting
 class Sample : public map<string, vector<Allele*> > {
 
@@ -89,6 +113,14 @@ public:
 
     int baseCount(string base, AlleleStrand strand);
 
+    // removes the observations, and the tallies counted from them
+    void clear(void);
+
+    // strand and placement totals of the observations of base, counted on
+    // first use, once the sample's observations are complete
+    const ObservationTally& observationTally(const string& base) const;
+    mutable map<string, ObservationTally> observationTallies;
+
     string json(void);
 
 };
@@ -3,6 +3,9 @@
 #include "Utility.h"
 #include "Sum.h"
 #include "Product.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define PHRED_MAX 50000.0 // max Phred seems to be about 43015 (?), could be an underflow bug...
 
@@ -12,11 +15,11 @@ short qualityChar2ShortInt(char c) {
     return static_cast<short>(c) - 33;
 }
 
-long double qualityChar2LongDouble(char c) {
-    return static_cast<long double>(c) - 33;
+ModelFloat qualityChar2LongDouble(char c) {
+    return static_cast<ModelFloat>(c) - 33;
 }
 
-long double lnqualityChar2ShortInt(char c) {
+ModelFloat lnqualityChar2ShortInt(char c) {
     return log(static_cast<short>(c) - 33);
 }
 
@@ -24,41 +27,41 @@ char qualityInt2Char(short i) {
     return static_cast<char>(i + 33);
 }
 
-long double ln2log10(long double prob) {
+ModelFloat ln2log10(ModelFloat prob) {
     return M_LOG10E * prob;
 }
 
-long double log102ln(long double prob) {
+ModelFloat log102ln(ModelFloat prob) {
     return M_LN10 * prob;
 }
 
-long double phred2ln(int qual) {
+ModelFloat phred2ln(int qual) {
     return M_LN10 * qual * -.1;
 }
 
-long double ln2phred(long double prob) {
+ModelFloat ln2phred(ModelFloat prob) {
     return -10 * M_LOG10E * prob;
 }
 
-long double phred2float(int qual) {
+ModelFloat phred2float(int qual) {
     return pow(10, qual * -.1);
 }
 
-long double float2phred(long double prob) {
+ModelFloat float2phred(ModelFloat prob) {
     if (prob == 1)
         return PHRED_MAX;  // guards against "-0"
-    long double p = -10 * (long double) log10(prob);
+    ModelFloat p = -10 * (ModelFloat) log10(prob);
     if (p < 0 || p > PHRED_MAX) // int overflow guard
         return PHRED_MAX;
     else
         return p;
 }
 
-long double big2phred(const BigFloat& prob) {
-    return -10 * (long double) (ttmath::Log(prob, (BigFloat)10)).ToDouble();
+ModelFloat big2phred(const BigFloat& prob) {
+    return -10 * (ModelFloat) (ttmath::Log(prob, (BigFloat)10)).ToDouble();
 }
 
-long double nan2zero(long double x) {
+ModelFloat nan2zero(ModelFloat x) {
     if (x != x) {
         return 0;
     } else {
@@ -66,18 +69,18 @@ long double nan2zero(long double x) {
     }
 }
 
-long double powln(long double m, int n) {
+ModelFloat powln(ModelFloat m, int n) {
     return m * n;
 }
 
 // the probability that we have a completely true vector of qualities
-long double jointQuality(const std::vector<short>& quals) {
-    std::vector<long double> probs;
+ModelFloat jointQuality(const std::vector<short>& quals) {
+    std::vector<ModelFloat> probs;
     for (int i = 0; i<quals.size(); ++i) {
         probs.push_back(phred2float(quals[i]));
     }
     // product of probability we don't have a true event for each element
-    long double prod = 1 - probs.front();
+    ModelFloat prod = 1 - probs.front();
     for (int i = 1; i<probs.size(); ++i) {
         prod *= 1 - probs.at(i);
     }
@@ -85,9 +88,9 @@ long double jointQuality(const std::vector<short>& quals) {
     return 1 - prod;
 }
 
-long double jointQuality(const std::string& qualstr) {
+ModelFloat jointQuality(const std::string& qualstr) {
 
-    long double jq = 1;
+    ModelFloat jq = 1;
     // product of probability we don't have a true event for each element
     for (string::const_iterator q = qualstr.begin(); q != qualstr.end(); ++q) {
         jq *= 1 - phred2float(qualityChar2ShortInt(*q));
@@ -108,17 +111,17 @@ std::vector<short> qualities(const std::string& qualstr) {
 
 }
 
-long double sumQuality(const std::string& qualstr) {
-    long double qual = 0;
+ModelFloat sumQuality(const std::string& qualstr) {
+    ModelFloat qual = 0;
     for (string::const_iterator q = qualstr.begin(); q != qualstr.end(); ++q)
         qual += qualityChar2LongDouble(*q);
     return qual;
 }
 
-long double minQuality(const std::string& qualstr) {
-    long double qual = 0;
+ModelFloat minQuality(const std::string& qualstr) {
+    ModelFloat qual = 0;
     for (string::const_iterator q = qualstr.begin(); q != qualstr.end(); ++q) {
-        long double nq = qualityChar2LongDouble(*q);
+        ModelFloat nq = qualityChar2LongDouble(*q);
         if (qual == 0) {
             qual = nq;
         } else if (nq < qual) {
@@ -137,15 +140,15 @@ short minQuality(const std::vector<short>& qualities) {
 }
 
 // crudely averages quality scores in phred space
-long double averageQuality(const std::string& qualstr) {
-    long double qual = 0; //(long double) *max_element(quals.begin(), quals.end());
+ModelFloat averageQuality(const std::string& qualstr) {
+    ModelFloat qual = 0; //(ModelFloat) *max_element(quals.begin(), quals.end());
     for (string::const_iterator q = qualstr.begin(); q != qualstr.end(); ++q)
         qual += qualityChar2LongDouble(*q);
     return qual / qualstr.size();
 }
 
-long double averageQuality(const vector<short>& qualities) {
-    long double qual = 0;
+ModelFloat averageQuality(const vector<short>& qualities) {
+    ModelFloat qual = 0;
     for (vector<short>::const_iterator q = qualities.begin(); q != qualities.end(); ++q) {
         qual += *q;
     }
@@ -171,6 +174,29 @@ bool allATGC(string& s) {
     return true;
 }
 
+int matchingPrefixLength(const char* read, const char* ref, int length) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i n = _mm_set1_epi8('N');
+    for ( ; i + 16 <= length; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (read + i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (ref + i));
+        // lanes which match, and where the reference is not N
+        __m128i matches = _mm_andnot_si128(_mm_cmpeq_epi8(b, n), _mm_cmpeq_epi8(a, b));
+        int mask = _mm_movemask_epi8(matches);
+        if (mask != 0xFFFF) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#endif
+    for ( ; i < length; ++i) {
+        if (read[i] != ref[i] || ref[i] == 'N') {
+            break;
+        }
+    }
+    return i;
+}
+
 int upper(int c) {
     return toupper((unsigned char) c);
 }
@@ -198,48 +224,75 @@ int binomialCoefficient(int n, int k) {
 }
 
 // k successes in n trials with prob of success p
-long double binomialProb(int k, int n, long double p) {
+ModelFloat binomialProb(int k, int n, ModelFloat p) {
     return factorial(n) / (factorial(k) * factorial(n - k)) * pow(p, k) * pow(1 - p, n - k);
 }
 
-long double __binomialProbln(int k, int n, long double p) {
+ModelFloat __binomialProbln(int k, int n, ModelFloat p) {
     return factorialln(n) - (factorialln(k) + factorialln(n - k)) + powln(log(p), k) + powln(log(1 - p), n - k);
 }
 
-long double binomialCoefficientLn(int k, int n) {
+ModelFloat binomialCoefficientLn(int k, int n) {
     return factorialln(n) - (factorialln(k) + factorialln(n - k));
 }
 
 BinomialCache binomialCache;
 
-long double binomialProbln(int k, int n, long double p) {
+ModelFloat binomialProbln(int k, int n, ModelFloat p) {
     return binomialCache.binomialProbln(k, n, p);
 }
 
+void HalfBinomialTable::setDepth(int d) {
+    depth = d;
+    maxDepth = -1;
+    table.clear();
+}
+
+void HalfBinomialTable::build(void) {
+    maxDepth = depth;
+    table.resize((maxDepth + 1) * (maxDepth + 2) / 2);
+    vector<ModelFloat>::iterator t = table.begin();
+    for (int n = 0; n <= maxDepth; ++n) {
+        for (int k = 0; k <= n; ++k) {
+            *t++ = __binomialProbln(k, n, 0.5);
+        }
+    }
+}
+
+HalfBinomialTable halfBinomialTable;
+
+ModelFloat halfBinomialProbln(int k, int n) {
+    return halfBinomialTable.probln(k, n);
+}
+
+void setHalfBinomialTableDepth(int depth) {
+    halfBinomialTable.setDepth(depth);
+}
+
 /*
-long double probability(int k, int n, long double p) {
+ModelFloat probability(int k, int n, ModelFloat p) {
     int n = n - k;
     int m = k;
-    long double q = 1 - p;
-    long double temp = lgammal(m + n + 1.0);
+    ModelFloat q = 1 - p;
+    ModelFloat temp = lgammal(m + n + 1.0);
     temp -= lgammal(n + 1.0) + lgammal(m + 1.0);
     temp += m*log(p) + n*log(q);
     return temp;
 }
 */
 
-long double poissonpln(int observed, int expected) {
+ModelFloat poissonpln(int observed, int expected) {
     return ((log(expected) * observed) - expected) - factorialln(observed);
 }
 
-long double poissonp(int observed, int expected) {
+ModelFloat poissonp(int observed, int expected) {
     return (double) pow((double) expected, (double) observed) * (double) pow(M_E, (double) -expected) / factorial(observed);
 }
 
 
 // given the expected number of events is the max of a and b
 // what is the probability that we might observe less than the observed?
-long double poissonPvalLn(int a, int b) {
+ModelFloat poissonPvalLn(int a, int b) {
 
     int expected, observed;
     if (a > b) {
@@ -248,7 +301,7 @@ long double poissonPvalLn(int a, int b) {
         expected = b; observed = a;
     }
 
-    vector<long double> probs;
+    vector<ModelFloat> probs;
     for (int i = 0; i < observed; ++i) {
         probs.push_back(poissonpln(i, expected));
     }
@@ -258,38 +311,38 @@ long double poissonPvalLn(int a, int b) {
 }
 
 
-long double gammaln(
-    long double x
+ModelFloat gammaln(
+    ModelFloat x
     ) {
 
-    long double cofactors[] = { 76.18009173, 
+    ModelFloat cofactors[] = { 76.18009173, 
                                 -86.50532033,
                                 24.01409822,
                                 -1.231739516,
                                 0.120858003E-2,
                                 -0.536382E-5 };    
 
-    long double x1 = x - 1.0;
-    long double tmp = x1 + 5.5;
+    ModelFloat x1 = x - 1.0;
+    ModelFloat tmp = x1 + 5.5;
     tmp -= (x1 + 0.5) * log(tmp);
-    long double ser = 1.0;
+    ModelFloat ser = 1.0;
     for (int j=0; j<=5; j++) {
         x1 += 1.0;
         ser += cofactors[j]/x1;
     }
-    long double y =  (-1.0 * tmp + log(2.50662827465 * ser));
+    ModelFloat y =  (-1.0 * tmp + log(2.50662827465 * ser));
 
     return y;
 }
 
-long double factorial(
+ModelFloat factorial(
     int n
     ) {
     if (n < 0) {
-        return (long double)0.0;
+        return (ModelFloat)0.0;
     }
     else if (n == 0) {
-        return (long double)1.0;
+        return (ModelFloat)1.0;
     }
     else {
         return exp(gammaln(n + 1.0));
@@ -299,65 +352,81 @@ long double factorial(
 FactorialCache factorialCache;
 
 /*
-long double factorialln(int n) {
+ModelFloat factorialln(int n) {
     return factorialCache.factorialln(n);
 }
 */
 
-long double __factorialln(
+ModelFloat __factorialln(
     int n
     ) {
     if (n < 0) {
-        return (long double)-1.0;
+        return (ModelFloat)-1.0;
     }
     else if (n == 0) {
-        return (long double)0.0;
+        return (ModelFloat)0.0;
     }
     else {
         return gammaln(n + 1.0);
     }
 }
 
-long double cofactor(
+ModelFloat cofactor(
     int n, 
     int i
     ) {
     if ((n < 0) || (i < 0) || (n < i)) {
-        return (long double)0.0;
+        return (ModelFloat)0.0;
     }
     else if (n == i) {
-        return (long double)1.0;
+        return (ModelFloat)1.0;
     }
     else {
         return exp(gammaln(n + 1.0) - gammaln(i + 1.0) - gammaln(n-i + 1.0));
     }
 }
 
-long double cofactorln(
+ModelFloat cofactorln(
     int n, 
     int i
     ) {
     if ((n < 0) || (i < 0) || (n < i)) {
-        return (long double)-1.0;
+        return (ModelFloat)-1.0;
     }
     else if (n == i) {
-        return (long double)0.0;
+        return (ModelFloat)0.0;
     }
     else {
         return gammaln(n + 1.0) - gammaln(i + 1.0) - gammaln(n-i + 1.0);
     }
 }
 
-// prevent underflows by returning exp(LDBL_MIN_EXP) if exponentiation will produce an underflow
-long double safe_exp(long double ln) {
-    if (ln < LDBL_MIN_EXP) {  // -16381
-        return LDBL_MIN;      // 3.3621e-4932
+// prevent underflows by returning exp(MODEL_FLOAT_MIN_EXP) if exponentiation will produce an underflow
+ModelFloat safe_exp(ModelFloat ln) {
+    if (ln < MODEL_FLOAT_MIN_EXP) {  // -16381, or -1021 for double
+        return MODEL_FLOAT_MIN;      // 3.3621e-4932, or 2.2251e-308 for double
     } else {
         return exp(ln);
     }
 }
 
-BigFloat big_exp(long double ln) {
+ModelFloat log1p_model(ModelFloat x) {
+#ifdef DOUBLE_PRECISION_MODEL
+    return log1p(x);
+#else
+    return log1pl(x);
+#endif
+}
+
+ModelFloat expm1_model(ModelFloat x) {
+#ifdef DOUBLE_PRECISION_MODEL
+    return expm1(x);
+#else
+    return expm1l(x);
+#endif
+}
+
+BigFloat big_exp(ModelFloat ln) {
     BigFloat x, result;
     x.FromDouble(ln);
     result = ttmath::Exp(x);
@@ -365,29 +434,23 @@ BigFloat big_exp(long double ln) {
 }
 
 // 'safe' log summation for probabilities
-long double logsumexp_probs(const vector<long double>& lnv) {
-    vector<long double>::const_iterator i = lnv.begin();
-    long double maxN = *i;
-    ++i;
-    for (; i != lnv.end(); ++i) {
-        if (*i > maxN)
-            maxN = *i;
-    }
-    BigFloat sum = 0;
-    for (vector<long double>::const_iterator i = lnv.begin(); i != lnv.end(); ++i) {
-        sum += big_exp(*i - maxN);
+// once the maximum is factored out every term is at most 1 and the sum lies
+// in [1, n], so it can be accumulated in ModelFloat without overflow rather
+// than in BigFloat
+ModelFloat logsumexp_probs(const vector<ModelFloat>& lnv) {
+    ModelFloat maxN = *max_element(lnv.begin(), lnv.end());
+    ModelFloat sum = 0;
+    for (vector<ModelFloat>::const_iterator i = lnv.begin(); i != lnv.end(); ++i) {
+        sum += exp(*i - maxN);
     }
-    BigFloat maxNb; maxNb.FromDouble(maxN);
-    BigFloat bigResult = maxNb + ttmath::Ln(sum);
-    long double result;
-    return bigResult.ToDouble();
+    return maxN + log(sum);
 }
 
 // unsafe, kept for potential future use
-long double logsumexp(const vector<long double>& lnv) {
-    long double maxAbs, minN, maxN, c;
-    vector<long double>::const_iterator i = lnv.begin();
-    long double n = *i;
+ModelFloat logsumexp(const vector<ModelFloat>& lnv) {
+    ModelFloat maxAbs, minN, maxN, c;
+    vector<ModelFloat>::const_iterator i = lnv.begin();
+    ModelFloat n = *i;
     maxAbs = n; maxN = n; minN = n;
     ++i;
     for (; i != lnv.end(); ++i) {
@@ -404,36 +467,36 @@ long double logsumexp(const vector<long double>& lnv) {
     } else {
         c = maxN;
     }
-    long double sum = 0;
-    for (vector<long double>::const_iterator i = lnv.begin(); i != lnv.end(); ++i) {
+    ModelFloat sum = 0;
+    for (vector<ModelFloat>::const_iterator i = lnv.begin(); i != lnv.end(); ++i) {
         sum += exp(*i - c);
     }
     return c + log(sum);
 }
 
-long double betaln(const vector<long double>& alphas) {
-    vector<long double> gammalnAlphas;
+ModelFloat betaln(const vector<ModelFloat>& alphas) {
+    vector<ModelFloat> gammalnAlphas;
     gammalnAlphas.resize(alphas.size());
     transform(alphas.begin(), alphas.end(), gammalnAlphas.begin(), gammaln);
     return sum(gammalnAlphas) - gammaln(sum(alphas));
 }
 
-long double beta(const vector<long double>& alphas) {
+ModelFloat beta(const vector<ModelFloat>& alphas) {
     return exp(betaln(alphas));
 }
 
-long double hoeffding(double successes, double trials, double prob) {
+ModelFloat hoeffding(double successes, double trials, double prob) {
     return 0.5 * exp(-2 * pow(trials * prob - successes, 2) / trials);
 }
 
-long double hoeffdingln(double successes, double trials, double prob) {
+ModelFloat hoeffdingln(double successes, double trials, double prob) {
     return log(0.5) + (-2 * pow(trials * prob - successes, 2) / trials);
 }
 
 // the sum of the harmonic series 1, n
-long double harmonicSum(int n) {
-    long double r = 0;
-    long double i = 1;
+ModelFloat harmonicSum(int n) {
+    ModelFloat r = 0;
+    ModelFloat i = 1;
     while (i <= n) {
         r += 1 / i;
         ++i;
@@ -557,19 +620,19 @@ string dateStr(void) {
 
 }
 
-long double string2float(const string& s) {
-    long double r;
+ModelFloat string2float(const string& s) {
+    ModelFloat r;
     convert(s, r);
     return r;
 }
 
-long double log10string2ln(const string& s) {
-    long double r;
+ModelFloat log10string2ln(const string& s) {
+    ModelFloat r;
     convert(s, r);
     return log102ln(r);
 }
 
-long double safedivide(long double a, long double b) {
+ModelFloat safedivide(ModelFloat a, ModelFloat b) {
     if (b == 0) {
         if (a == 0) {
             return 1;
@@ -684,12 +747,12 @@ std::string operator*(std::string const &s, size_t n)
 }
 
 // normalize vector sum to 1
-void normalizeSumToOne(vector<long double>& v) {
-    long double sum = 0;
-    for (vector<long double>::iterator i = v.begin(); i != v.end(); ++i) {
+void normalizeSumToOne(vector<ModelFloat>& v) {
+    ModelFloat sum = 0;
+    for (vector<ModelFloat>::iterator i = v.begin(); i != v.end(); ++i) {
         sum += *i;
     }
-    for (vector<long double>::iterator i = v.begin(); i != v.end(); ++i) {
+    for (vector<ModelFloat>::iterator i = v.begin(); i != v.end(); ++i) {
         *i /= sum;
     }
 }
@@ -100756,3 +100819,14 @@ double entropy(const string& st) {
     ent = -ent;
     return ent;
 }
+
+double RollingEntropy::value(void) const {
+    double ent = 0;
+    double ln2 = log(2);
+    for (string::const_iterator c = alphabet.begin(); c != alphabet.end(); ++c) {
+        double f = (double) counts[(unsigned char) *c] / (double) length;
+        ent += f * log(f)/ln2;
+    }
+    ent = -ent;
+    return ent;
+}
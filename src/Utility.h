@@ -21,64 +21,80 @@ using namespace std;
 
 typedef ttmath::Big<TTMATH_BITS(256), TTMATH_BITS(64)> BigFloat;
 
-long double factorial(int);
+// floating point type used throughout the model.  long double by default;
+// building with -D DOUBLE_PRECISION_MODEL (make double) switches to double,
+// which avoids x87 arithmetic on x86-64 at some cost in precision.
+#ifdef DOUBLE_PRECISION_MODEL
+typedef double ModelFloat;
+#define MODEL_FLOAT_MIN_EXP DBL_MIN_EXP
+#define MODEL_FLOAT_MIN DBL_MIN
+#else
+typedef long double ModelFloat;
+#define MODEL_FLOAT_MIN_EXP LDBL_MIN_EXP
+#define MODEL_FLOAT_MIN LDBL_MIN
+#endif
+
+ModelFloat factorial(int);
 short qualityChar2ShortInt(char c);
-long double qualityChar2LongDouble(char c);
-long double lnqualityChar2ShortInt(char c);
+ModelFloat qualityChar2LongDouble(char c);
+ModelFloat lnqualityChar2ShortInt(char c);
 char qualityInt2Char(short i);
-//long double phred2float(int qual);
-long double phred2ln(int qual);
-long double ln2phred(long double prob);
-long double ln2log10(long double prob);
-long double log102ln(long double prob);
-long double phred2float(int qual);
-long double float2phred(long double prob);
-long double big2phred(const BigFloat& prob);
-long double nan2zero(long double x);
-long double powln(long double m, int n);
+//ModelFloat phred2float(int qual);
+ModelFloat phred2ln(int qual);
+ModelFloat ln2phred(ModelFloat prob);
+ModelFloat ln2log10(ModelFloat prob);
+ModelFloat log102ln(ModelFloat prob);
+ModelFloat phred2float(int qual);
+ModelFloat float2phred(ModelFloat prob);
+ModelFloat big2phred(const BigFloat& prob);
+ModelFloat nan2zero(ModelFloat x);
+ModelFloat powln(ModelFloat m, int n);
 // here 'joint' means 'probability that we have a vector entirely composed of true bases'
-long double jointQuality(const std::vector<short>& quals);
-long double jointQuality(const std::string& qualstr);
+ModelFloat jointQuality(const std::vector<short>& quals);
+ModelFloat jointQuality(const std::string& qualstr);
 std::vector<short> qualities(const std::string& qualstr);
 // 
-long double sumQuality(const std::string& qualstr);
-long double minQuality(const std::string& qualstr);
+ModelFloat sumQuality(const std::string& qualstr);
+ModelFloat minQuality(const std::string& qualstr);
 short minQuality(const std::vector<short>& qualities);
-long double averageQuality(const std::string& qualstr);
-long double averageQuality(const std::vector<short>& qualities);
+ModelFloat averageQuality(const std::string& qualstr);
+ModelFloat averageQuality(const std::vector<short>& qualities);
 //unsigned int factorial(int n);
 bool stringInVector(string item, vector<string> items);
 int upper(int c); // helper to below, wraps toupper
 string uppercase(string s);
 bool allATGC(string& s);
+// the number of leading positions at which read matches ref, stopping at the
+// first mismatch or reference N.  compares 16 bases at a time with SSE2.
+int matchingPrefixLength(const char* read, const char* ref, int length);
 string strip(string const& str, char const* separators = " \t");
 
 int binomialCoefficient(int n, int k);
-long double binomialCoefficientLn(int k, int n);
-long double binomialProb(int k, int n, long double p);
-long double __binomialProbln(int k, int n, long double p);
-long double binomialProbln(int k, int n, long double p);
+ModelFloat binomialCoefficientLn(int k, int n);
+ModelFloat binomialProb(int k, int n, ModelFloat p);
+ModelFloat __binomialProbln(int k, int n, ModelFloat p);
+ModelFloat binomialProbln(int k, int n, ModelFloat p);
 
-long double poissonpln(int observed, int expected);
-long double poissonp(int observed, int expected);
-long double poissonPvalLn(int a, int b);
+ModelFloat poissonpln(int observed, int expected);
+ModelFloat poissonp(int observed, int expected);
+ModelFloat poissonPvalLn(int a, int b);
 
-long double gammaln( long double x);
-long double factorial( int n);
+ModelFloat gammaln( ModelFloat x);
+ModelFloat factorial( int n);
 double factorialln( int n);
-long double __factorialln( int n);
+ModelFloat __factorialln( int n);
 
 #define MAX_FACTORIAL_CACHE_SIZE 100000
 
-class FactorialCache : public map<int, long double> {
+class FactorialCache : public map<int, ModelFloat> {
 public:
-    long double factorialln(int n) {
-        map<int, long double>::iterator f = find(n);
+    ModelFloat factorialln(int n) {
+        map<int, ModelFloat>::iterator f = find(n);
         if (f == end()) {
             if (size() > MAX_FACTORIAL_CACHE_SIZE) {
                 clear();
             }
-            long double fln = __factorialln(n);
+            ModelFloat fln = __factorialln(n);
             insert(make_pair(n, fln));
             return fln;
         } else {
@@ -89,17 +105,17 @@ public:
 
 #define MAX_BINOMIAL_CACHE_SIZE 100000
 
-class BinomialCache : public map<long double, map<pair<int, int>, long double> > {
+class BinomialCache : public map<ModelFloat, map<pair<int, int>, ModelFloat> > {
 public:
-    long double binomialProbln(int k, int n, long double p) {
-        map<pair<int, int>, long double>& t = (*this)[p];
+    ModelFloat binomialProbln(int k, int n, ModelFloat p) {
+        map<pair<int, int>, ModelFloat>& t = (*this)[p];
         pair<int, int> kn = make_pair(k, n);
-        map<pair<int, int>, long double>::iterator f = t.find(kn);
+        map<pair<int, int>, ModelFloat>::iterator f = t.find(kn);
         if (f == t.end()) {
             if (t.size() > MAX_BINOMIAL_CACHE_SIZE) {
                 t.clear();
             }
-            long double bln = __binomialProbln(k, n, p);
+            ModelFloat bln = __binomialProbln(k, n, p);
             t.insert(make_pair(kn, bln));
             return bln;
         } else {
@@ -108,33 +124,108 @@ public:
     }
 };
 
-long double cofactor( int n, int i);
-long double cofactorln( int n, int i);
+#define DEFAULT_HALF_BINOMIAL_TABLE_DEPTH 1000
+#define MAX_HALF_BINOMIAL_TABLE_DEPTH 5000
+
+// binomialProbln(k, n, 0.5), which is evaluated for every allele in every
+// genotype combo by the strand, placement and read position priors.
+// rows up to the depth are precomputed when the table is first used, and
+// anything outside them is computed directly.
+class HalfBinomialTable {
+public:
+    HalfBinomialTable(void)
+        : depth(DEFAULT_HALF_BINOMIAL_TABLE_DEPTH)
+        , maxDepth(-1)
+    { }
+
+    // the depth to build to, 0 to MAX_HALF_BINOMIAL_TABLE_DEPTH
+    void setDepth(int d);
+
+    ModelFloat probln(int k, int n) {
+        if (maxDepth < 0) {
+            build();
+        }
+        if (k < 0 || k > n) {
+            return log((ModelFloat) 0); // impossible
+        } else if (n <= maxDepth) {
+            // row n starts at offset n * (n + 1) / 2
+            return table[n * (n + 1) / 2 + k];
+        } else {
+            return __binomialProbln(k, n, 0.5);
+        }
+    }
+
+private:
+    int depth;
+    int maxDepth; // of the rows built, -1 until then
+    vector<ModelFloat> table;
+
+    void build(void);
+};
+
+ModelFloat halfBinomialProbln(int k, int n);
+void setHalfBinomialTableDepth(int depth);
 
-long double harmonicSum(int n);
+ModelFloat cofactor( int n, int i);
+ModelFloat cofactorln( int n, int i);
 
-long double safedivide(long double a, long double b);
+ModelFloat harmonicSum(int n);
 
-long double safe_exp(long double ln);
+ModelFloat safedivide(ModelFloat a, ModelFloat b);
 
-BigFloat big_exp(long double ln);
+ModelFloat safe_exp(ModelFloat ln);
 
-long double logsumexp_probs(const vector<long double>& lnv);
-long double logsumexp(const vector<long double>& lnv);
+BigFloat big_exp(ModelFloat ln);
 
-long double betaln(const vector<long double>& alphas);
-long double beta(const vector<long double>& alphas);
+// ln(1 + x) and exp(x) - 1, keeping the precision of small x which
+// log(1 + x) and exp(x) - 1 round away
+ModelFloat log1p_model(ModelFloat x);
+ModelFloat expm1_model(ModelFloat x);
 
-long double hoeffding(double successes, double trials, double prob);
-long double hoeffdingln(double successes, double trials, double prob);
+ModelFloat logsumexp_probs(const vector<ModelFloat>& lnv);
+
+// streaming logsumexp, for summing ln probabilities as they are produced
+// the sum is kept relative to the largest term seen so far, and rescaled
+// when a larger one arrives, so no term needs to be stored
+class LogSumExpAccumulator {
+public:
+    LogSumExpAccumulator(void) : maxN(0), sum(0) { }
+    void add(ModelFloat ln) {
+        if (sum == 0) {
+            maxN = ln;
+            sum = 1;
+        } else if (ln == maxN) {
+            // exp(0), and for two terms of -inf keeps the sum -inf
+            // rather than exp(-inf - -inf), which is NaN
+            sum += 1;
+        } else if (ln < maxN) {
+            sum += exp(ln - maxN);
+        } else {
+            sum = sum * exp(maxN - ln) + 1;
+            maxN = ln;
+        }
+    }
+    bool empty(void) const { return sum == 0; }
+    ModelFloat value(void) const { return maxN + log(sum); }
+private:
+    ModelFloat maxN;
+    ModelFloat sum;
+};
+ModelFloat logsumexp(const vector<ModelFloat>& lnv);
+
+ModelFloat betaln(const vector<ModelFloat>& alphas);
+ModelFloat beta(const vector<ModelFloat>& alphas);
+
+ModelFloat hoeffding(double successes, double trials, double prob);
+ModelFloat hoeffdingln(double successes, double trials, double prob);
 
 int levenshteinDistance(const std::string source, const std::string target);
 bool isTransition(string& ref, string& alt);
 
 string dateStr(void);
 
-long double string2float(const string& s);
-long double log10string2ln(const string& s);
+ModelFloat string2float(const string& s);
+ModelFloat log10string2ln(const string& s);
 
 string mergeCigar(const string& c1, const string& c2);
 vector<pair<int, string> > splitCigar(const string& cigarStr);
@@ -145,10 +236,31 @@ bool isEmptyCigarElement(const pair<int, string>& elem);
 
 std::string operator*(std::string const &s, size_t n);
 
-void normalizeSumToOne(vector<long double>&);
+void normalizeSumToOne(vector<ModelFloat>&);
 
 void addLinesFromFile(vector<string>& v, const string& f);
 
 double entropy(const string& st);
 
+// entropy() of a string which is grown one character at a time, without
+// rescanning it.  the alphabet is kept in the order entropy() sums over it,
+// so the two agree exactly.
+class RollingEntropy {
+public:
+    RollingEntropy(void) : length(0) {
+        fill(counts, counts + 256, 0);
+    }
+    void add(char c) {
+        if (counts[(unsigned char) c]++ == 0) {
+            alphabet.insert(lower_bound(alphabet.begin(), alphabet.end(), c), c);
+        }
+        ++length;
+    }
+    double value(void) const;
+private:
+    int counts[256];
+    int length;
+    string alphabet;
+};
+
 #endif
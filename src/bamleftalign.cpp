@@ -9,6 +9,8 @@
 #include <algorithm>
 #include <map>
 #include <vector>
+#include <deque>
+#include <pthread.h>
 
 #include "Fasta.h"
 #include "api/BamAlignment.h"
@@ -19,7 +21,7 @@
 
 #ifdef VERBOSE_DEBUG
 #define DEBUG(msg) \
-    if (debug) { cerr << msg; }
+    if (debug) { messages << msg; }
 #else
 #define DEBUG(msg)
 #endif
@@ -38,7 +40,140 @@ void printUsage(char** argv) {
          << "      -d --debug             Print debugging information about realignment process" << endl
          << "      -s --suppress-output   Don't write BAM output stream (for debugging)" << endl
          << "      -m --max-iterations N  Iterate the left-realignment no more than this many times" << endl
-         << "      -c --compressed        Write compressed BAM on stdout, default is uncompressed" << endl;
+         << "      -c --compressed        Write compressed BAM on stdout, default is uncompressed" << endl
+         << "      -t --threads N         Realign using N threads.  Output is in input order." << endl;
+}
+
+// alignments are handed to the realignment threads in batches of this many
+#define ALIGNMENT_BATCH_SIZE 1000
+
+// the name of reference sequence id, or "" for the unmapped id -1
+string referenceName(const vector<string>& referenceNames, int id) {
+    if (id >= 0 && id < (int) referenceNames.size()) {
+        return referenceNames[id];
+    } else {
+        return "";
+    }
+}
+
+// left-realigns one alignment in place, writing debugging output and
+// warnings to messages
+void realign(BamAlignment& alignment,
+             FastaReference& reference,
+             const vector<string>& referenceNames,
+             int maxiterations,
+             bool debug,
+             LeftAlignCache& cache,
+             ostream& messages) {
+
+    string refname = referenceName(referenceNames, alignment.RefID);
+
+    DEBUG("---------------------------   read    --------------------------" << endl);
+    DEBUG("| " << refname << ":" << alignment.Position << endl);
+    DEBUG("| " << alignment.Name << ":" << alignment.GetEndPosition() << endl);
+    DEBUG("| " << alignment.Name << ":" << (alignment.IsMapped() ? " mapped" : " unmapped") << endl);
+    DEBUG("| " << alignment.Name << ":" << " cigar data size: " << alignment.CigarData.size() << endl);
+    DEBUG("--------------------------- realigned --------------------------" << endl);
+
+    // skip unmapped alignments, as they cannot be left-realigned without CIGAR data
+    if (alignment.IsMapped()) {
+
+        int endpos = alignment.GetEndPosition();
+        int length = endpos - alignment.Position + 1;
+        if (alignment.Position >= 0 && length > 0) {
+            if (!stablyLeftAlign(alignment,
+                        reference.getSubSequence(
+                            refname,
+                            alignment.Position,
+                            length),
+                        maxiterations, debug, &cache)) {
+                messages << "unstable realignment of " << alignment.Name
+                         << " at " << refname << ":" << alignment.Position << endl
+                         << alignment.AlignedBases << endl;
+            }
+        }
+
+    }
+
+    DEBUG("----------------------------------------------------------------" << endl);
+    DEBUG(endl);
+
+}
+
+// a run of consecutive input alignments, numbered in input order
+class AlignmentBatch {
+public:
+    long int number;
+    vector<BamAlignment> alignments;
+    string messages;
+};
+
+// batches waiting for a realignment thread, and those realigned but not yet
+// written.  the reference is memory-mapped, so the threads can share it.
+class RealignmentQueue {
+public:
+    pthread_mutex_t lock;
+    pthread_cond_t batchPending;
+    pthread_cond_t batchDone;
+    deque<AlignmentBatch*> pending;
+    map<long int, AlignmentBatch*> done;
+    bool finished; // no more batches will be queued
+
+    FastaReference* reference;
+    vector<string>* referenceNames;
+    int maxiterations;
+    bool debug;
+
+    RealignmentQueue(void) : finished(false) {
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&batchPending, NULL);
+        pthread_cond_init(&batchDone, NULL);
+    }
+
+    ~RealignmentQueue(void) {
+        pthread_mutex_destroy(&lock);
+        pthread_cond_destroy(&batchPending);
+        pthread_cond_destroy(&batchDone);
+    }
+};
+
+// realignment thread: takes batches until the queue is finished and empty.
+// each thread keeps its own LeftAlignCache.
+void* realignBatches(void* arg) {
+
+    RealignmentQueue* queue = (RealignmentQueue*) arg;
+    LeftAlignCache cache;
+
+    while (true) {
+
+        pthread_mutex_lock(&queue->lock);
+        while (queue->pending.empty() && !queue->finished) {
+            pthread_cond_wait(&queue->batchPending, &queue->lock);
+        }
+        if (queue->pending.empty()) {
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        AlignmentBatch* batch = queue->pending.front();
+        queue->pending.pop_front();
+        pthread_mutex_unlock(&queue->lock);
+
+        stringstream messages;
+        for (vector<BamAlignment>::iterator a = batch->alignments.begin(); a != batch->alignments.end(); ++a) {
+            realign(*a, *queue->reference, *queue->referenceNames,
+                    queue->maxiterations, queue->debug, cache, messages);
+        }
+        batch->messages = messages.str();
+
+        pthread_mutex_lock(&queue->lock);
+        queue->done[batch->number] = batch;
+        pthread_cond_signal(&queue->batchDone);
+        pthread_mutex_unlock(&queue->lock);
+
+    }
+
+    return NULL;
+
 }
 
 int main(int argc, char** argv) {
@@ -46,13 +181,15 @@ int main(int argc, char** argv) {
     int c;
 
     FastaReference reference;
+    string referenceFile;
     bool has_ref = false;
     bool suppress_output = false;
     bool debug = false;
     bool isuncompressed = true;
 
     int maxiterations = 50;
-    
+    int threads = 1;
+
     if (argc < 2) {
         printUsage(argv);
         exit(1);
@@ -67,12 +204,13 @@ int main(int argc, char** argv) {
             {"max-iterations", required_argument, 0, 'm'},
             {"suppress-output", no_argument, 0, 's'},
             {"compressed", no_argument, 0, 'c'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "hdcsf:m:",
+        c = getopt_long (argc, argv, "hdcsf:m:t:",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -82,7 +220,7 @@ int main(int argc, char** argv) {
         switch (c) {
 
             case 'f':
-                reference.open(optarg); // will exit on open failure
+                referenceFile = optarg;
                 has_ref = true;
                 break;
      
@@ -102,6 +240,10 @@ int main(int argc, char** argv) {
                 isuncompressed = false;
                 break;
 
+            case 't':
+                threads = atoi(optarg);
+                break;
+
             case 'h':
                 printUsage(argv);
                 exit(0);
@@ -123,6 +265,14 @@ int main(int argc, char** argv) {
         exit(1);
     }
 
+    if (threads < 1) {
+        cerr << "--threads must be at least 1" << endl;
+        exit(1);
+    }
+
+    // the threads share the reference through a read-only mapping
+    reference.open(referenceFile, threads > 1); // will exit on open failure
+
     BamReader reader;
     if (!reader.Open("stdin")) {
         cerr << "could not open stdin for reading" << endl;
@@ -141,50 +291,94 @@ int main(int argc, char** argv) {
     }
 
     // store the names of all the reference sequences in the BAM file
-    map<int, string> referenceIDToName;
+    vector<string> referenceNames;
     vector<RefData> referenceSequences = reader.GetReferenceData();
-    int i = 0;
     for (RefVector::iterator r = referenceSequences.begin(); r != referenceSequences.end(); ++r) {
-        referenceIDToName[i] = r->RefName;
-        ++i;
+        referenceNames.push_back(r->RefName);
     }
 
-    BamAlignment alignment;
-
-    while (reader.GetNextAlignment(alignment)) {
-
-            DEBUG("---------------------------   read    --------------------------" << endl);
-            DEBUG("| " << referenceIDToName[alignment.RefID] << ":" << alignment.Position << endl);
-            DEBUG("| " << alignment.Name << ":" << alignment.GetEndPosition() << endl);
-            DEBUG("| " << alignment.Name << ":" << (alignment.IsMapped() ? " mapped" : " unmapped") << endl);
-            DEBUG("| " << alignment.Name << ":" << " cigar data size: " << alignment.CigarData.size() << endl);
-            DEBUG("--------------------------- realigned --------------------------" << endl);
-
-            // skip unmapped alignments, as they cannot be left-realigned without CIGAR data
-            if (alignment.IsMapped()) {
-
-                int endpos = alignment.GetEndPosition();
-                int length = endpos - alignment.Position + 1;
-                if (alignment.Position >= 0 && length > 0) {
-                    if (!stablyLeftAlign(alignment,
-                                reference.getSubSequence(
-                                    referenceIDToName[alignment.RefID],
-                                    alignment.Position,
-                                    length),
-                                maxiterations, debug)) {
-                        cerr << "unstable realignment of " << alignment.Name
-                             << " at " << referenceIDToName[alignment.RefID] << ":" << alignment.Position << endl
-                             << alignment.AlignedBases << endl;
-                    }
-                }
+    if (threads == 1) {
+
+        BamAlignment alignment;
+        LeftAlignCache cache;
+
+        while (reader.GetNextAlignment(alignment)) {
+            realign(alignment, reference, referenceNames, maxiterations, debug, cache, cerr);
+            if (!suppress_output)
+                writer.SaveAlignment(alignment);
+        }
+
+    } else {
 
+        RealignmentQueue queue;
+        queue.reference = &reference;
+        queue.referenceNames = &referenceNames;
+        queue.maxiterations = maxiterations;
+        queue.debug = debug;
+
+        vector<pthread_t> workers(threads);
+        for (vector<pthread_t>::iterator w = workers.begin(); w != workers.end(); ++w) {
+            if (pthread_create(&*w, NULL, realignBatches, &queue) != 0) {
+                cerr << "could not start realignment thread" << endl;
+                exit(1);
             }
+        }
 
-            DEBUG("----------------------------------------------------------------" << endl);
-            DEBUG(endl);
+        // read batches while fewer than two per thread are outstanding,
+        // otherwise write the next batch in input order once it is realigned
+        long int nextBatch = 0;
+        long int nextWrite = 0;
+        bool reading = true;
+
+        while (reading || nextWrite < nextBatch) {
+            if (reading && nextBatch - nextWrite < 2 * threads) {
+                AlignmentBatch* batch = new AlignmentBatch;
+                batch->number = nextBatch;
+                batch->alignments.reserve(ALIGNMENT_BATCH_SIZE);
+                BamAlignment alignment;
+                while (batch->alignments.size() < ALIGNMENT_BATCH_SIZE
+                       && reader.GetNextAlignment(alignment)) {
+                    batch->alignments.push_back(alignment);
+                }
+                if (batch->alignments.size() < ALIGNMENT_BATCH_SIZE) {
+                    reading = false;
+                }
+                if (batch->alignments.empty()) {
+                    delete batch;
+                    continue;
+                }
+                pthread_mutex_lock(&queue.lock);
+                queue.pending.push_back(batch);
+                pthread_cond_signal(&queue.batchPending);
+                pthread_mutex_unlock(&queue.lock);
+                ++nextBatch;
+            } else {
+                pthread_mutex_lock(&queue.lock);
+                map<long int, AlignmentBatch*>::iterator d;
+                while ((d = queue.done.find(nextWrite)) == queue.done.end()) {
+                    pthread_cond_wait(&queue.batchDone, &queue.lock);
+                }
+                AlignmentBatch* batch = d->second;
+                queue.done.erase(d);
+                pthread_mutex_unlock(&queue.lock);
+                cerr << batch->messages;
+                if (!suppress_output) {
+                    for (vector<BamAlignment>::iterator a = batch->alignments.begin(); a != batch->alignments.end(); ++a) {
+                        writer.SaveAlignment(*a);
+                    }
+                }
+                delete batch;
+                ++nextWrite;
+            }
+        }
 
-        if (!suppress_output)
-            writer.SaveAlignment(alignment);
+        pthread_mutex_lock(&queue.lock);
+        queue.finished = true;
+        pthread_cond_broadcast(&queue.batchPending);
+        pthread_mutex_unlock(&queue.lock);
+        for (vector<pthread_t>::iterator w = workers.begin(); w != workers.end(); ++w) {
+            pthread_join(*w, NULL);
+        }
 
     }
 
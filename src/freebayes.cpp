@@ -38,6 +38,7 @@
 
 #include "Bias.h"
 #include "Contamination.h"
+#include "PooledFrequency.h"
 
 
 // local helper debugging macros to improve code readability
@@ -70,6 +71,8 @@ int main (int argc, char *argv[]) {
     Parameters& parameters = parser->parameters;
     list<Allele*> alleles;
 
+    setHalfBinomialTableDepth(parameters.obsBinomialPriorsTableDepth);
+
     Samples samples;
 
     ostream& out = *(parser->output);
@@ -115,6 +118,15 @@ int main (int argc, char *argv[]) {
 
     unsigned long total_sites = 0;
     unsigned long processed_sites = 0;
+    unsigned long total_genotyping_iterations = 0;
+    unsigned long warm_started_sites = 0;
+    unsigned long cold_started_warm_sites = 0;
+
+    // alternate allele counts of each sample in the best combo at the previous
+    // site, which seed the genotyping search under --genotyping-warm-start
+    map<string, int> previousAlternateCounts;
+    string previousSequenceName;
+    long int previousPosition = 0;
 
     while (parser->getNextAlleles(samples, allowedAlleleTypes)) {
 
@@ -245,7 +257,7 @@ int main (int argc, char *argv[]) {
         coverage = countAlleles(samples);
 
         // estimate theta using the haplotype length
-        long double theta = parameters.TH * parser->lastHaplotypeLength;
+        ModelFloat theta = parameters.TH * parser->lastHaplotypeLength;
 
         // if we have only one viable allele, we don't have evidence for variation at this site
         if (!parser->hasInputVariantAllelesAtCurrentPosition() && !parameters.reportMonomorphic && genotypeAlleles.size() <= 1 && genotypeAlleles.front().isReference()) {
@@ -254,6 +266,46 @@ int main (int argc, char *argv[]) {
         }
         DEBUG("genotype alleles: " << genotypeAlleles);
 
+        // continuous pools: estimate allele frequencies directly from the
+        // observations, skipping genotype generation and the combo search
+        if (parameters.pooledFrequencies) {
+            ++processed_sites;
+            int referenceIndex = -1;
+            for (int i = 0; i < genotypeAlleles.size(); ++i) {
+                if (genotypeAlleles[i].isReference()) {
+                    referenceIndex = i;
+                    break;
+                }
+            }
+            map<string, PooledFrequencyEstimate> estimates;
+            for (vector<string>::iterator n = parser->sampleList.begin(); n != parser->sampleList.end(); ++n) {
+                Samples::iterator s = samples.find(*n);
+                if (s == samples.end()) {
+                    continue;
+                }
+                estimatePooledFrequencies(estimates[*n], s->second, genotypeAlleles,
+                                          referenceIndex, parameters.useMappingQuality);
+            }
+            ModelFloat pMonomorphicln = pooledMonomorphicProbln(estimates);
+            if ((1 - exp(pMonomorphicln)) >= parameters.PVL || parameters.PVL == 0) {
+                Results results;
+                vcf::Variant var(parser->variantCallFile);
+                out << results.pooledFrequencyVcf(
+                    var,
+                    pMonomorphicln,
+                    samples,
+                    referenceBase,
+                    genotypeAlleles,
+                    estimates,
+                    parser->sampleList,
+                    coverage,
+                    alleleGroups,
+                    parser)
+                    << endl;
+            }
+            continue;
+        }
+
         // add the null genotype
         bool usingNull = false;
         if (parameters.excludeUnobservedGenotypes && genotypeAlleles.size() > 2) {
@@ -267,7 +319,31 @@ int main (int argc, char *argv[]) {
 
         // for each possible ploidy in the dataset, generate all possible genotypes
         vector<int> ploidies = parser->currentPloidies(samples);
-        map<int, vector<Genotype> > genotypesByPloidy = getGenotypesByPloidy(ploidies, genotypeAlleles);
+        // or, at high ploidy, only those near the frequencies observed in some
+        // sample.  each sample with observations then considers only those near
+        // its own, and samples without observations consider all of them.
+        map<int, vector<pair<int, int> > > genotypeCountBounds;
+        map<string, vector<pair<int, int> > > sampleGenotypeCountBounds;
+        if (parameters.genotypeCountBand > 0) {
+            for (vector<int>::iterator p = ploidies.begin(); p != ploidies.end(); ++p) {
+                if (*p > 2) {
+                    // empty, with each low bound above each high bound, so that
+                    // only the homozygous genotypes are made if no sample widens them
+                    genotypeCountBounds[*p].resize(genotypeAlleles.size(), make_pair(*p, 0));
+                }
+            }
+            for (Samples::iterator s = samples.begin(); s != samples.end(); ++s) {
+                int ploidy = parser->currentSamplePloidy(s->first);
+                vector<pair<int, int> > bounds;
+                if (ploidy > 2
+                    && observedGenotypeCountBounds(bounds, s->second, ploidy,
+                                                   genotypeAlleles, parameters.genotypeCountBand)) {
+                    addGenotypeCountBounds(genotypeCountBounds[ploidy], bounds);
+                    sampleGenotypeCountBounds[s->first] = bounds;
+                }
+            }
+        }
+        map<int, vector<Genotype> > genotypesByPloidy = getGenotypesByPloidy(ploidies, genotypeAlleles, genotypeCountBounds);
         int numCopiesOfLocus = parser->copiesOfLocus(samples);
 
 
@@ -319,7 +395,12 @@ int main (int argc, char *argv[]) {
             Sample& sample = samples[sampleName];
             vector<Genotype>& genotypes = genotypesByPloidy[parser->currentSamplePloidy(sampleName)];
             vector<Genotype*> genotypesWithObs;
+            map<string, vector<pair<int, int> > >::iterator sampleBounds = sampleGenotypeCountBounds.find(sampleName);
             for (vector<Genotype>::iterator g = genotypes.begin(); g != genotypes.end(); ++g) {
+                if (sampleBounds != sampleGenotypeCountBounds.end() && !g->homozygous
+                    && !withinGenotypeCountBounds(*g, genotypeAlleles, sampleBounds->second)) {
+                    continue;
+                }
                 if (parameters.excludePartiallyObservedGenotypes) {
                     if (g->sampleHasSupportingObservationsForAllAlleles(sample)) {
                         genotypesWithObs.push_back(&*g);
@@ -343,7 +424,7 @@ int main (int argc, char *argv[]) {
                 continue;
             }
 
-            vector<pair<Genotype*, long double> > probs
+            vector<pair<Genotype*, ModelFloat> > probs
                 = probObservedAllelesGivenGenotypes(sample, genotypesWithObs,
                                                     parameters.RDF, parameters.useMappingQuality,
                                                     observationBias, parameters.standardGLs,
@@ -353,7 +434,7 @@ int main (int argc, char *argv[]) {
             
 #ifdef VERBOSE_DEBUG
             if (parameters.debug2) {
-                for (vector<pair<Genotype*, long double> >::iterator p = probs.begin(); p != probs.end(); ++p) {
+                for (vector<pair<Genotype*, ModelFloat> >::iterator p = probs.begin(); p != probs.end(); ++p) {
                     cerr << parser->currentSequenceName << "," << (long unsigned int) parser->currentPosition + 1 << ","
                          << sampleName << ",likelihood," << *(p->first) << "," << p->second << endl;
                 }
@@ -363,7 +444,7 @@ int main (int argc, char *argv[]) {
             Result& sampleData = results[sampleName];
             sampleData.name = sampleName;
             sampleData.observations = &sample;
-            for (vector<pair<Genotype*, long double> >::iterator p = probs.begin(); p != probs.end(); ++p) {
+            for (vector<pair<Genotype*, ModelFloat> >::iterator p = probs.begin(); p != probs.end(); ++p) {
                 sampleData.push_back(SampleDataLikelihood(sampleName, &sample, p->first, p->second, 0));
             }
 
@@ -452,7 +533,7 @@ int main (int argc, char *argv[]) {
         BigFloat pVar = 1.0;
         BigFloat pHom = 0.0;
 
-        long double bestComboOddsRatio = 0;
+        ModelFloat bestComboOddsRatio = 0;
 
         GenotypeCombo bestCombo; // = NULL;
 
@@ -463,12 +544,12 @@ int main (int argc, char *argv[]) {
                 vector<Genotype*> comboGenotypes;
                 for (GenotypeCombo::iterator g = gc->begin(); g != gc->end(); ++g)
                     comboGenotypes.push_back((*g)->genotype);
-                long double posteriorProb = gc->posteriorProb;
-                long double dataLikelihoodln = gc->probObsGivenGenotypes;
-                long double priorln = gc->posteriorProb;
-                long double priorlnG_Af = gc->priorProbG_Af;
-                long double priorlnAf = gc->priorProbAf;
-                long double priorlnBin = gc->priorProbObservations;
+                ModelFloat posteriorProb = gc->posteriorProb;
+                ModelFloat dataLikelihoodln = gc->probObsGivenGenotypes;
+                ModelFloat priorln = gc->posteriorProb;
+                ModelFloat priorlnG_Af = gc->priorProbG_Af;
+                ModelFloat priorlnAf = gc->priorProbAf;
+                ModelFloat priorlnBin = gc->priorProbObservations;
 
                 parser->traceFile << parser->currentSequenceName << "," << (long unsigned int) parser->currentPosition + 1 << ",genotypecombo,";
 
@@ -512,8 +593,17 @@ int main (int argc, char *argv[]) {
         //SampleDataLikelihoods marginalLikelihoods = sampleDataLikelihoods;  // heavyweight copy...
         map<string, list<GenotypeCombo> > genotypeCombosByPopulation;
         int genotypingTotalIterations = 0; // tally total iterations required to reach convergence
+        GenotypingSearch genotypingSearch = GENOTYPING_SEARCH_EXHAUSTIVE;
         map<string, list<GenotypeCombo> > glMaxCombos;
 
+        bool warmStart = parameters.genotypingWarmStartWindow > 0
+            && !previousAlternateCounts.empty()
+            && previousSequenceName == parser->currentSequenceName
+            && parser->currentPosition - previousPosition <= parameters.genotypingWarmStartWindow;
+        if (warmStart) {
+            ++warm_started_sites;
+        }
+
         for (map<string, SampleDataLikelihoods>::iterator p = sampleDataLikelihoodsByPopulation.begin(); p != sampleDataLikelihoodsByPopulation.end(); ++p) {
 
             const string& population = p->first;
@@ -527,22 +617,80 @@ int main (int argc, char *argv[]) {
             int itermax = min(max(10, 2 * estimatedMinorAllelesAtLocus), parameters.genotypingMaxIterations);
             //int itermax = parameters.genotypingMaxIterations;
 
-            // XXX HACK
             // passing 0 for bandwidth and banddepth means "exhaustive local search"
             // this produces properly normalized GQ's at polyallelic sites
-            int adjustedBandwidth = 0;
-            int adjustedBanddepth = 0;
             // however, this can lead to huge performance problems at complex sites,
-            // so we implement this hack...
-            if (parameters.genotypingMaxBandDepth > 0 &&
+            // so given a work budget we pick the most thorough search which fits it,
+            // and otherwise fall back to banding sites with many alleles
+            GenotypingSearch search = GENOTYPING_SEARCH_EXHAUSTIVE;
+            if (parameters.genotypingMaxWork > 0) {
+                // itermax is only a cap.  each iteration moves the genotype of one
+                // sample, and the moves the priors make away from the data
+                // likelihood maximum trade minor alleles, so expect one iteration
+                // per estimated minor allele plus one to confirm convergence
+                int expectedIterations = min(itermax, 1 + estimatedMinorAllelesAtLocus);
+                search = chooseGenotypingSearch(sampleDataLikelihoods,
+                                                expectedIterations,
+                                                parameters.genotypingMaxBandDepth,
+                                                parameters.calculateMarginals,
+                                                parameters.genotypingMaxWork);
+            } else if (parameters.genotypingMaxBandDepth > 0 &&
                 genotypeAlleles.size() > parameters.genotypingMaxBandDepth) {
+                search = GENOTYPING_SEARCH_BANDED;
+            }
+            int adjustedBandwidth = 0;
+            int adjustedBanddepth = 0;
+            if (search == GENOTYPING_SEARCH_BANDED) {
                 adjustedBandwidth = 1;
                 adjustedBanddepth = parameters.genotypingMaxBandDepth;
+            } else if (search == GENOTYPING_SEARCH_APPROXIMATE) {
+                itermax = 1;
             }
+            // report the least thorough search used in any population
+            genotypingSearch = max(genotypingSearch, search);
 
-            GenotypeCombo nullCombo;
+            GenotypeCombo seedCombo; // if left empty, the search seeds from the data likelihood maximum
             SampleDataLikelihoods nullSampleDataLikelihoods;
 
+            if (warmStart) {
+                vector<int> initialPosition;
+                warmStartPosition(initialPosition, sampleDataLikelihoods, previousAlternateCounts, referenceBase);
+                makeComboByDatalLikelihoodRank(seedCombo,
+                                               initialPosition,
+                                               sampleDataLikelihoods,
+                                               nullSampleDataLikelihoods,
+                                               inputAlleleCounts,
+                                               theta,
+                                               parameters.pooledDiscrete,
+                                               parameters.ewensPriors,
+                                               parameters.permute,
+                                               parameters.hwePriors,
+                                               parameters.obsBinomialPriors,
+                                               parameters.alleleBalancePriors,
+                                               parameters.diffusionPriorScalar);
+                // the search only climbs from its seed, so if the data likelihood
+                // maximum, the cold start, already scores better, start from it
+                GenotypeCombo coldCombo;
+                vector<int> coldPosition(sampleDataLikelihoods.size(), 0);
+                makeComboByDatalLikelihoodRank(coldCombo,
+                                               coldPosition,
+                                               sampleDataLikelihoods,
+                                               nullSampleDataLikelihoods,
+                                               inputAlleleCounts,
+                                               theta,
+                                               parameters.pooledDiscrete,
+                                               parameters.ewensPriors,
+                                               parameters.permute,
+                                               parameters.hwePriors,
+                                               parameters.obsBinomialPriors,
+                                               parameters.alleleBalancePriors,
+                                               parameters.diffusionPriorScalar);
+                if (seedCombo.posteriorProb < coldCombo.posteriorProb) {
+                    seedCombo = coldCombo;
+                    ++cold_started_warm_sites;
+                }
+            }
+
             // this is the genotype-likelihood maximum
             if (parameters.reportGenotypeLikelihoodMax) {
                 GenotypeCombo comboKing;
@@ -569,7 +717,7 @@ int main (int argc, char *argv[]) {
             // search much longer for convergence
             convergentGenotypeComboSearch(
                 populationGenotypeCombos,
-                nullCombo,
+                seedCombo,
                 sampleDataLikelihoods, // vary everything
                 sampleDataLikelihoods,
                 nullSampleDataLikelihoods,
@@ -606,11 +754,11 @@ int main (int argc, char *argv[]) {
         // TODO factor out the following blocks as they are repeated from above
 
         // re-get posterior normalizer
-        vector<long double> comboProbs;
+        vector<ModelFloat> comboProbs;
         for (list<GenotypeCombo>::iterator gc = genotypeCombos.begin(); gc != genotypeCombos.end(); ++gc) {
             comboProbs.push_back(gc->posteriorProb);
         }
-        long double posteriorNormalizer = logsumexp_probs(comboProbs);
+        ModelFloat posteriorNormalizer = logsumexp_probs(comboProbs);
 
         // recalculate posterior normalizer
         pVar = 1.0;
@@ -635,6 +783,17 @@ int main (int argc, char *argv[]) {
 
         DEBUG2("best combo: " << bestCombo);
 
+        total_genotyping_iterations += genotypingTotalIterations;
+        if (parameters.genotypingWarmStartWindow > 0) {
+            previousAlternateCounts.clear();
+            for (GenotypeCombo::iterator s = bestCombo.begin(); s != bestCombo.end(); ++s) {
+                Genotype* genotype = (*s)->genotype;
+                previousAlternateCounts[(*s)->name] = genotype->ploidy - genotype->alleleCount(referenceBase);
+            }
+            previousSequenceName = parser->currentSequenceName;
+            previousPosition = parser->currentPosition;
+        }
+
         // odds ratio between the first and second-best combinations
         if (genotypeCombos.size() > 1) {
             bestComboOddsRatio = genotypeCombos.front().posteriorProb - (++genotypeCombos.begin())->posteriorProb;
@@ -657,7 +816,7 @@ int main (int argc, char *argv[]) {
 
         map<string, int> repeats;
         if (parameters.showReferenceRepeats) {
-            repeats = parser->repeatCounts(parser->currentSequencePosition(), parser->currentSequence, 12);
+            repeats = parser->referenceRepeatCounts(parser->currentPosition);
         }
 
         vector<Allele> alts;
@@ -704,6 +863,7 @@ int main (int argc, char *argv[]) {
                 alts,
                 repeats,
                 genotypingTotalIterations,
+                genotypingSearchName(genotypingSearch),
                 parser->sampleList,
                 coverage,
                 bestCombo,
@@ -735,7 +895,10 @@ int main (int argc, char *argv[]) {
 
     DEBUG("total sites: " << total_sites << endl
           << "processed sites: " << processed_sites << endl
-          << "ratio: " << (float) processed_sites / (float) total_sites);
+          << "ratio: " << (float) processed_sites / (float) total_sites << endl
+          << "genotyping iterations: " << total_genotyping_iterations << endl
+          << "warm-started sites: " << warm_started_sites << endl
+          << "warm seeds replaced by the cold start: " << cold_started_warm_sites);
 
     delete parser;
 
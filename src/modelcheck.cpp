@@ -0,0 +1,721 @@
+// differential checks of the model's fast paths, and of the repeat index,
+// against the generic code they stand in for.  each check evaluates both on
+// the same random inputs and requires identical results, or results equal to
+// rounding where the fast path reorders the arithmetic.
+//
+// usage: modelcheck [iterations [seed]]
+// prints a line per check and exits non-zero if any result differs
+
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <list>
+#include <unistd.h>
+
+#include "DataLikelihood.h"
+#include "Genotype.h"
+#include "PooledFrequency.h"
+#include "RepeatIndex.h"
+#include "multichoose.h"
+#include "convert.h"
+
+using namespace std;
+
+// a random pick from [0, n)
+int randomInt(int n) {
+    return rand() % n;
+}
+
+// an observation of base in a read of the given read group, strand and
+// base and mapping qualities
+Allele* newObservation(const string& base, string& readGroup, bool strand,
+                       int quality, int mapQuality) {
+    static string referenceName = "chr";
+    static string sampleName = "sample";
+    static string readName = "read";
+    static string technology = "tech";
+    static long int position = 0;
+    static char referenceBase = 'A';
+    Allele* obs = new Allele(ALLELE_SNP, referenceName, position, &position, &referenceBase,
+                             1, 0, 0, 0, base, sampleName, readName,
+                             readGroup, technology, strand,
+                             quality, "", mapQuality,
+                             false, false, false, "1X", NULL, 0, 100);
+    obs->currentBase = base;
+    return obs;
+}
+
+// a sample with depth random observations of the bases of genotypeAlleles
+// and of one base outside them, drawn from few enough qualities and read
+// groups that many observations share them.  if partials, about a fifth of
+// the observations are partial, each supporting a random subset of
+// genotypeAlleles.  the observations are appended to owned.
+void randomSample(Sample& sample,
+                  vector<Allele>& genotypeAlleles,
+                  int depth,
+                  bool partials,
+                  vector<Allele*>& owned) {
+
+    static string readGroups[] = { "rg1", "rg2" };
+
+    for (int i = 0; i < depth; ++i) {
+        int b = randomInt(genotypeAlleles.size() + 1);
+        string base = (b < (int) genotypeAlleles.size()) ? genotypeAlleles[b].currentBase : "N";
+        Allele* obs = newObservation(base, readGroups[randomInt(2)], randomInt(2),
+                                     5 + 5 * randomInt(6), 20 + 20 * randomInt(3));
+        owned.push_back(obs);
+        if (partials && randomInt(5) == 0) {
+            set<Allele*>& supports = sample.reversePartials[obs];
+            for (vector<Allele>::iterator a = genotypeAlleles.begin(); a != genotypeAlleles.end(); ++a) {
+                if (randomInt(2)) {
+                    supports.insert(&*a);
+                }
+            }
+            if (supports.empty()) {
+                supports.insert(&genotypeAlleles[randomInt(genotypeAlleles.size())]);
+            }
+            sample.partialSupport[base].push_back(obs);
+            sample.supportedAlleles.insert(base);
+        } else {
+            sample[base].push_back(obs);
+        }
+    }
+
+    sample.setSupportedAlleles();
+
+}
+
+// the default GLs as they were computed before observations were grouped into
+// classes, one observation at a time, in the order of the sample
+ModelFloat perObservationProbObservedAllelesGivenGenotype(Sample& sample,
+                                                          Genotype& genotype,
+                                                          double dependenceFactor,
+                                                          vector<Allele>& genotypeAlleles,
+                                                          Contamination& contaminations) {
+
+    double countIn = 0;
+    ModelFloat probObsGivenGt = 0;
+    vector<Allele*> emptyA;
+    vector<Allele*> emptyB;
+    for (set<string>::iterator c = sample.supportedAlleles.begin();
+         c != sample.supportedAlleles.end(); ++c) {
+
+        vector<Allele*>* alleles = &emptyA;
+        Sample::iterator si = sample.find(*c);
+        if (si != sample.end()) alleles = &si->second;
+
+        vector<Allele*>* partials = &emptyB;
+        map<string, vector<Allele*> >::iterator pi = sample.partialSupport.find(*c);
+        if (pi != sample.partialSupport.end()) partials = &pi->second;
+
+        bool onPartials = false;
+        vector<Allele*>::iterator a = alleles->begin();
+        bool hasPartials = !partials->empty();
+        for ( ; (!hasPartials && a != alleles->end()) || a != partials->end(); ++a) {
+            if (a == alleles->end()) {
+                if (hasPartials) {
+                    a = partials->begin();
+                    onPartials = true;
+                } else {
+                    break;
+                }
+            }
+            Allele& obs = **a;
+            ModelFloat probi = 0;
+            ContaminationEstimate& contamination = contaminations.of(obs.readGroupID);
+            double scale = 1;
+            ModelFloat qual = (1 - exp(obs.lnquality)) * (1 - exp(obs.lnmapQuality));
+            if (onPartials) {
+                map<Allele*, set<Allele*> >::iterator r = sample.reversePartials.find(*a);
+                if (r != sample.reversePartials.end()) {
+                    scale = (double)1/(double)r->second.size();
+                }
+            }
+            bool isInGenotype = false;
+            for (vector<Allele>::iterator b = genotypeAlleles.begin(); b != genotypeAlleles.end(); ++b) {
+                Allele& allele = *b;
+                const string& base = b->currentBase;
+                ModelFloat q;
+                if (obs.currentBase == base
+                    || (onPartials && sample.observationSupports(*a, &*b))) {
+                    isInGenotype = true;
+                    q = qual;
+                } else {
+                    q = 1 - qual;
+                }
+                if (onPartials) {
+                    q *= scale;
+                }
+                double asampl = genotype.alleleSamplingProb(base);
+                if (asampl == 0) {
+                    asampl = contamination.probRefGivenHomAlt;
+                } else if (asampl == 1) {
+                    asampl = 1 - contamination.probRefGivenHomAlt;
+                } else {
+                    double scale = asampl / 0.5;
+                    if (allele.isReference()) {
+                        asampl = scale * contamination.probRefGivenHet;
+                    } else {
+                        asampl = 1 - (scale * contamination.probRefGivenHet);
+                    }
+                }
+                probi += asampl * q;
+            }
+            if (isInGenotype) {
+                countIn += scale;
+            }
+            if (probi > 0) {
+                probObsGivenGt += log(min(probi, (ModelFloat) 1.0));
+            }
+        }
+    }
+
+    if (countIn > 1) {
+        probObsGivenGt *= (1 + (countIn - 1) * dependenceFactor) / countIn;
+    }
+    return isinf(probObsGivenGt) ? 0 : probObsGivenGt;
+
+}
+
+// compares probObservedAllelesGivenGenotypes, which dispatches to the
+// fixed-ploidy kernels, with probObservedAllelesGivenGenotype, the generic
+// per-genotype calculation, for a random subset of the genotypes of ploidy
+// over genotypeAlleles.  returns the number of genotypes which differ.  both
+// weight the terms of each observation class by its count, so they need only
+// agree with the per-observation sums to rounding; those which do not are
+// counted in unmatched.
+int compareGenotypeLikelihoods(int ploidy,
+                               vector<Allele>& genotypeAlleles,
+                               Contamination& contaminations,
+                               bool partials,
+                               long int& compared,
+                               int& unmatched) {
+
+    vector<Genotype> genotypes = allPossibleGenotypes(ploidy, genotypeAlleles);
+    vector<Genotype*> genotypePtrs;
+    for (vector<Genotype>::iterator g = genotypes.begin(); g != genotypes.end(); ++g) {
+        if (randomInt(5) || genotypePtrs.empty()) {
+            genotypePtrs.push_back(&*g);
+        }
+    }
+
+    Sample sample;
+    vector<Allele*> owned;
+    randomSample(sample, genotypeAlleles, randomInt(60), partials, owned);
+
+    double dependenceFactor = randomInt(2) ? 0.9 : 0.3;
+    Bias observationBias;
+    map<string, double> freqs;
+
+    vector<pair<Genotype*, ModelFloat> > fast
+        = probObservedAllelesGivenGenotypes(sample, genotypePtrs, dependenceFactor, false,
+                                            observationBias, false, genotypeAlleles,
+                                            contaminations, freqs);
+
+    ObservationClasses classes;
+    observationClasses(sample, contaminations, classes);
+
+    int differences = 0;
+    for (int i = 0; i < (int) genotypePtrs.size(); ++i) {
+        ModelFloat generic
+            = probObservedAllelesGivenGenotype(sample, *genotypePtrs[i], dependenceFactor, false,
+                                               observationBias, false, genotypeAlleles,
+                                               contaminations, freqs, classes);
+        ModelFloat perObservation
+            = perObservationProbObservedAllelesGivenGenotype(sample, *genotypePtrs[i], dependenceFactor,
+                                                             genotypeAlleles, contaminations);
+        ++compared;
+        if (fast[i].first != genotypePtrs[i] || fast[i].second != generic) {
+            ++differences;
+            cerr << "ploidy " << ploidy << ", " << genotypeAlleles.size() << " alleles, genotype "
+                 << *genotypePtrs[i] << ": " << fast[i].second << " != " << generic << endl;
+        }
+        if (fabs(generic - perObservation) > 1e-9 * max((ModelFloat) 1, fabs(perObservation))) {
+            ++unmatched;
+            cerr << "ploidy " << ploidy << ", " << genotypeAlleles.size() << " alleles, genotype "
+                 << *genotypePtrs[i] << ": " << generic << " != " << perObservation
+                 << " summed per observation" << endl;
+        }
+    }
+
+    for (vector<Allele*>::iterator o = owned.begin(); o != owned.end(); ++o) {
+        delete *o;
+    }
+
+    return differences;
+
+}
+
+// genotype alleles: the reference, then alternates from bases
+vector<Allele> randomGenotypeAlleles(int count) {
+    static const char* bases[] = { "A", "T", "G", "C", "TT", "AG", "GA" };
+    vector<Allele> alleles;
+    for (int i = 0; i < count; ++i) {
+        alleles.push_back(genotypeAllele(i == 0 ? ALLELE_REFERENCE : ALLELE_SNP, bases[i], 1, "1X", 1, 0));
+    }
+    random_shuffle(alleles.begin(), alleles.end());
+    return alleles;
+}
+
+// the biallelic diploid case, which most called sites are
+int checkBiallelicDiploid(int iterations, Contamination& contaminations) {
+    int differences = 0;
+    int unmatched = 0;
+    long int compared = 0;
+    for (int i = 0; i < iterations; ++i) {
+        vector<Allele> genotypeAlleles = randomGenotypeAlleles(2);
+        differences += compareGenotypeLikelihoods(2, genotypeAlleles, contaminations, randomInt(2), compared, unmatched);
+    }
+    cout << "biallelic diploid GLs: " << compared << " compared, " << differences << " differ, "
+         << unmatched << " off the per-observation sums" << endl;
+    return differences + unmatched;
+}
+
+// every ploidy with a fixed-size kernel, and one above, over up to one more
+// allele than the kernels take.  the cases outside the kernels must fall back
+// to the generic calculation.
+int checkPloidyKernels(int iterations, Contamination& contaminations) {
+    int differences = 0;
+    int unmatched = 0;
+    int misdispatched = 0;
+    long int compared = 0;
+    for (int ploidy = 1; ploidy <= 5; ++ploidy) {
+        for (int alleleCount = 1; alleleCount <= MAX_KERNEL_ALLELES + 1; ++alleleCount) {
+            for (int i = 0; i < iterations / 10; ++i) {
+                vector<Allele> genotypeAlleles = randomGenotypeAlleles(alleleCount);
+                vector<Genotype> genotypes = allPossibleGenotypes(ploidy, genotypeAlleles);
+                vector<Genotype*> genotypePtrs;
+                for (vector<Genotype>::iterator g = genotypes.begin(); g != genotypes.end(); ++g) {
+                    genotypePtrs.push_back(&*g);
+                }
+                int expected = (ploidy <= 4 && alleleCount <= MAX_KERNEL_ALLELES) ? ploidy : 0;
+                if (kernelPloidy(genotypePtrs, genotypeAlleles) != expected) {
+                    ++misdispatched;
+                }
+                differences += compareGenotypeLikelihoods(ploidy, genotypeAlleles, contaminations, randomInt(2), compared, unmatched);
+            }
+        }
+    }
+    cout << "ploidy 1-5 GLs over 1-" << MAX_KERNEL_ALLELES + 1 << " alleles: " << compared << " compared, "
+         << differences << " differ, " << unmatched << " off the per-observation sums, "
+         << misdispatched << " sent to the wrong kernel" << endl;
+    return differences + unmatched + misdispatched;
+}
+
+// genotypes built from cached templates against those built from the alleles
+// directly, and the number of templates a cache holds once more than
+// GENOTYPE_TEMPLATE_CACHE_SIZE have been asked for.  sets too large to cache
+// must be declined, so that genotypes are built from the alleles directly.
+// permutationsln is summed in allele index order from templates and in sorted
+// order otherwise, so it need only agree to rounding.
+int checkGenotypeTemplates(int iterations) {
+    int differences = 0;
+    long int compared = 0;
+    int shapes[][2] = { { 1, 1 }, { 2, 2 }, { 2, 7 }, { 3, 4 }, { 6, 3 }, { 12, 5 } };
+    for (int k = 0; k < sizeof(shapes) / sizeof(shapes[0]); ++k) {
+        int ploidy = shapes[k][0];
+        int alleleCount = shapes[k][1];
+        for (int i = 0; i < iterations / 100 + 1; ++i) {
+            vector<Allele> genotypeAlleles = randomGenotypeAlleles(alleleCount);
+            vector<Genotype> templated = allPossibleGenotypes(ploidy, genotypeAlleles);
+            vector<vector<Allele> > combos = multichoose(ploidy, genotypeAlleles);
+            if (templated.size() != combos.size()) {
+                ++differences;
+                continue;
+            }
+            for (int j = 0; j < combos.size(); ++j) {
+                Genotype direct(combos[j]);
+                Genotype& g = templated[j];
+                if (g.str() != direct.str() || g.alleles != direct.alleles
+                    || g.alleleCounts != direct.alleleCounts || g.ploidy != direct.ploidy
+                    || g.homozygous != direct.homozygous
+                    || fabs(g.permutationsln - direct.permutationsln) > 1e-9 * max((ModelFloat) 1, fabs(direct.permutationsln))) {
+                    ++differences;
+                }
+                ++compared;
+            }
+        }
+    }
+    GenotypeTemplateCache cache;
+    int overfull = 0;
+    if (cache.templates(40, 5) != NULL) { // 135751 genotypes
+        ++overfull;
+    }
+    for (int ploidy = 1; ploidy <= 100; ++ploidy) {
+        for (int alleleCount = 1; alleleCount <= 4; ++alleleCount) {
+            cache.templates(ploidy, alleleCount);
+            long int held = 0;
+            for (GenotypeTemplateCache::iterator t = cache.begin(); t != cache.end(); ++t) {
+                held += t->second.size();
+            }
+            if (held > GENOTYPE_TEMPLATE_CACHE_SIZE) {
+                ++overfull;
+            }
+        }
+    }
+    cout << "templated genotypes: " << compared << " compared, " << differences << " differ, "
+         << overfull << " times over the cache size" << endl;
+    return differences + overfull;
+}
+
+// --genotype-count-band over random samples at ploidy 12.  the bounded
+// genotypes must be exactly the homozygous ones and those within the bounds,
+// fewer than all of them, and a sample without observations must not be
+// given bounds.
+int checkGenotypeCountBands(int iterations) {
+    int differences = 0;
+    long int compared = 0;
+    int ploidy = 12;
+    for (int i = 0; i < iterations / 10 + 1; ++i) {
+        vector<Allele> genotypeAlleles = randomGenotypeAlleles(2 + randomInt(3));
+        vector<Genotype> genotypes = allPossibleGenotypes(ploidy, genotypeAlleles);
+        Sample sample;
+        vector<Allele*> owned;
+        randomSample(sample, genotypeAlleles, 40 + randomInt(40), false, owned);
+        vector<pair<int, int> > bounds;
+        bool observed = observedGenotypeCountBounds(bounds, sample, ploidy, genotypeAlleles, 2);
+        int depth = sample.observationCount();
+        for (vector<Allele*>::iterator o = owned.begin(); o != owned.end(); ++o) {
+            delete *o;
+        }
+        if (!observed) {
+            ++differences;
+            continue;
+        }
+        vector<Genotype> bounded = boundedGenotypes(ploidy, genotypeAlleles, bounds);
+        set<string> expected;
+        for (vector<Genotype>::iterator g = genotypes.begin(); g != genotypes.end(); ++g) {
+            if (g->homozygous || withinGenotypeCountBounds(*g, genotypeAlleles, bounds)) {
+                expected.insert(g->str());
+            }
+        }
+        set<string> generated;
+        for (vector<Genotype>::iterator g = bounded.begin(); g != bounded.end(); ++g) {
+            generated.insert(g->str());
+        }
+        if (generated != expected || bounded.size() != generated.size()
+            || bounded.size() >= genotypes.size()) {
+            ++differences;
+            cerr << genotypeAlleles.size() << " alleles at depth " << depth << ": "
+                 << bounded.size() << " bounded genotypes of " << genotypes.size()
+                 << ", " << expected.size() << " expected" << endl;
+        }
+        ++compared;
+    }
+    Sample empty;
+    vector<pair<int, int> > bounds;
+    vector<Allele> genotypeAlleles = randomGenotypeAlleles(3);
+    if (observedGenotypeCountBounds(bounds, empty, ploidy, genotypeAlleles, 2) || !bounds.empty()) {
+        ++differences;
+    }
+    cout << "genotype count bands: " << compared << " compared, " << differences << " differ" << endl;
+    return differences;
+}
+
+// the pooled frequency EM on pools of known mixtures, observed at a single
+// quality, where the maximum likelihood frequencies are known in closed form:
+// with error e among K alleles, f_j = (p_j - e / (K - 1)) / (1 - e K / (K - 1))
+// for observed proportions p_j, clamped to [0, 1] at two alleles.  the
+// monomorphic probability of a pure reference pool must be about 1/2, as the
+// reference and the estimate fit it equally, and that of a mixed pool about 0.
+int checkPooledFrequencies(void) {
+    int differences = 0;
+    int compared = 0;
+    int mixtures[][3] = { { 70, 30, 0 }, { 95, 5, 0 }, { 50, 30, 20 }, { 10, 45, 45 }, { 100, 0, 0 } };
+    string readGroup = "rg1";
+    map<string, PooledFrequencyEstimate> mixed;
+    for (int m = 0; m < sizeof(mixtures) / sizeof(mixtures[0]); ++m) {
+        int K = mixtures[m][2] > 0 ? 3 : 2;
+        vector<Allele> genotypeAlleles = randomGenotypeAlleles(K);
+        Sample sample;
+        vector<Allele*> owned;
+        int depth = 0;
+        for (int j = 0; j < K; ++j) {
+            for (int i = 0; i < mixtures[m][j]; ++i) {
+                Allele* obs = newObservation(genotypeAlleles[j].currentBase, readGroup, i % 2, 30, 60);
+                sample[obs->currentBase].push_back(obs);
+                owned.push_back(obs);
+            }
+            depth += mixtures[m][j];
+        }
+        sample.setSupportedAlleles();
+
+        PooledFrequencyEstimate estimate;
+        estimatePooledFrequencies(estimate, sample, genotypeAlleles, 0, false, 1000, 1e-12);
+        ModelFloat e = phred2float(30);
+        ModelFloat mismatch = e / (K - 1);
+        ModelFloat loglikelihood = 0;
+        ModelFloat referenceLoglikelihood = 0;
+        for (int j = 0; j < K; ++j) {
+            ModelFloat p = (ModelFloat) mixtures[m][j] / depth;
+            ModelFloat f = min((ModelFloat) 1, max((ModelFloat) 0, (p - mismatch) / (1 - e - mismatch)));
+            if (p > 0) {
+                loglikelihood += mixtures[m][j] * log(f * (1 - e) + (1 - f) * mismatch);
+                referenceLoglikelihood += mixtures[m][j] * log(j == 0 ? 1 - e : mismatch);
+            }
+            ++compared;
+            // a frequency on the boundary is only approached
+            if (fabs(estimate.frequencies[j] - f) > (f > 0 ? 1e-9 : 1e-3)) {
+                ++differences;
+                cerr << "mixture " << m << ", allele " << j << ": frequency "
+                     << estimate.frequencies[j] << " != " << f << endl;
+            }
+        }
+        ++compared;
+        if (estimate.observations != depth
+            || fabs(estimate.loglikelihood - loglikelihood) > 1e-6
+            || fabs(estimate.referenceLoglikelihood - referenceLoglikelihood) > 1e-9) {
+            ++differences;
+            cerr << "mixture " << m << ": likelihoods " << estimate.loglikelihood << ", "
+                 << estimate.referenceLoglikelihood << " != " << loglikelihood << ", "
+                 << referenceLoglikelihood << endl;
+        }
+
+        map<string, PooledFrequencyEstimate> single;
+        single["pool"] = estimate;
+        ModelFloat pMonomorphicln = pooledMonomorphicProbln(single);
+        bool pure = mixtures[m][0] == depth;
+        ++compared;
+        if (pure ? fabs(pMonomorphicln - log(0.5)) > 1e-3 : pMonomorphicln > log(1e-6)) {
+            ++differences;
+            cerr << "mixture " << m << ": monomorphic probability " << exp(pMonomorphicln) << endl;
+        }
+        if (!pure) {
+            mixed["pool" + convert(m)] = estimate;
+        }
+
+        for (vector<Allele*>::iterator o = owned.begin(); o != owned.end(); ++o) {
+            delete *o;
+        }
+    }
+    // the evidence of the mixed pools adds up
+    ModelFloat ratio = 0;
+    for (map<string, PooledFrequencyEstimate>::iterator e = mixed.begin(); e != mixed.end(); ++e) {
+        ratio += e->second.loglikelihood - e->second.referenceLoglikelihood;
+    }
+    ++compared;
+    if (fabs(pooledMonomorphicProbln(mixed) + ratio) > 1e-9 * ratio) {
+        ++differences;
+    }
+    cout << "pooled frequencies: " << compared << " compared, " << differences << " differ" << endl;
+    return differences;
+}
+
+// the best neighbour of the comboKing, found both by scoring each neighbour
+// in place (keepCombos false) and by scoring a copy of the king per
+// neighbour (keepCombos true).  returns 1 if the two differ.  the neighbours
+// are scored from sums adjusted as genotypes are swapped, so each kept one is
+// also rescored from scratch; those whose posterior has drifted from that by
+// more than rounding are counted in drifted.
+int compareComboSearches(GenotypeCombo& comboKing,
+                         SampleDataLikelihoods& sampleDataLikelihoods,
+                         Samples& samples,
+                         bool banded,
+                         GenotypeCombo& best,
+                         int& drifted) {
+
+    SampleDataLikelihoods invariantSampleDataLikelihoods;
+    map<string, int> priorACs;
+    list<GenotypeCombo> combos[2];
+    for (int keepCombos = 0; keepCombos < 2; ++keepCombos) {
+        if (banded) {
+            bandedGenotypeCombinations(combos[keepCombos], comboKing, sampleDataLikelihoods,
+                                       invariantSampleDataLikelihoods, samples, priorACs, 2, 2,
+                                       0.001, false, true, true, true, true, true, 1, keepCombos);
+        } else {
+            allLocalGenotypeCombinations(combos[keepCombos], comboKing, sampleDataLikelihoods,
+                                         samples, priorACs,
+                                         0.001, false, true, true, true, true, true, 1, keepCombos);
+        }
+    }
+
+    for (list<GenotypeCombo>::iterator c = combos[1].begin(); c != combos[1].end(); ++c) {
+        GenotypeCombo fresh;
+        for (GenotypeCombo::iterator sdl = c->begin(); sdl != c->end(); ++sdl) {
+            fresh.push_back(*sdl);
+            fresh.probObsGivenGenotypes += (*sdl)->prob;
+        }
+        fresh.init(true);
+        fresh.calculatePosteriorProbability(0.001, false, true, true, true, true, true, 1);
+        if (fabs(fresh.posteriorProb - c->posteriorProb) > 1e-9 * max((ModelFloat) 1, fabs(fresh.posteriorProb))) {
+            cerr << (banded ? "banded" : "local") << " search: " << *c << " " << c->posteriorProb
+                 << " rescored as " << fresh.posteriorProb << endl;
+            ++drifted;
+        }
+    }
+
+    GenotypeCombo& inPlace = combos[0].front();
+    GenotypeCombo& copied = combos[1].front();
+    best = inPlace;
+    if (inPlace.posteriorProb != copied.posteriorProb
+        || inPlace.priorProb != copied.priorProb
+        || inPlace.probObsGivenGenotypes != copied.probObsGivenGenotypes
+        || !(inPlace == copied)) {
+        cerr << (banded ? "banded" : "local") << " search: " << inPlace << " " << inPlace.posteriorProb
+             << " != " << copied << " " << copied.posteriorProb << endl;
+        return 1;
+    }
+    return 0;
+
+}
+
+// the genotyping search over random sites of up to 12 samples with every
+// prior enabled.  every other site is biallelic diploid, the common case.
+// each site is searched for a few rounds from the data likelihood maximum, as
+// convergentGenotypeComboSearch does, so that later rounds start from kings
+// holding swapped genotypes.
+int checkComboSearches(int iterations, Contamination& contaminations) {
+    int differences = 0;
+    int drifted = 0;
+    long int compared = 0;
+    for (int i = 0; i < iterations / 10; ++i) {
+        bool biallelicDiploid = i % 2 == 0;
+        int ploidy = biallelicDiploid ? 2 : 1 + randomInt(3);
+        vector<Allele> genotypeAlleles = randomGenotypeAlleles(biallelicDiploid ? 2 : 2 + randomInt(2));
+        vector<Genotype> genotypes = allPossibleGenotypes(ploidy, genotypeAlleles);
+        Samples samples;
+        SampleDataLikelihoods sampleDataLikelihoods;
+        vector<Allele*> owned;
+        int sampleCount = 1 + randomInt(12);
+        for (int j = 0; j < sampleCount; ++j) {
+            string name = "sample" + convert(j);
+            Sample& sample = samples[name];
+            randomSample(sample, genotypeAlleles, randomInt(30), false, owned);
+            vector<SampleDataLikelihood> sdls;
+            for (vector<Genotype>::iterator g = genotypes.begin(); g != genotypes.end(); ++g) {
+                sdls.push_back(SampleDataLikelihood(name, &sample, &*g, -20.0 * rand() / RAND_MAX, 0));
+            }
+            sort(sdls.begin(), sdls.end(), SampleDataLikelihoodCompare());
+            for (int r = 0; r < (int) sdls.size(); ++r) {
+                sdls[r].rank = r;
+            }
+            sampleDataLikelihoods.push_back(sdls);
+        }
+
+        for (int banded = 0; banded < 2; ++banded) {
+            GenotypeCombo comboKing;
+            vector<int> initialPosition(sampleDataLikelihoods.size(), 0);
+            SampleDataLikelihoods invariantSampleDataLikelihoods;
+            map<string, int> priorACs;
+            makeComboByDatalLikelihoodRank(comboKing, initialPosition, sampleDataLikelihoods,
+                                           invariantSampleDataLikelihoods, priorACs,
+                                           0.001, false, true, true, true, true, true, 1);
+            for (int round = 0; round < 3; ++round) {
+                GenotypeCombo best;
+                differences += compareComboSearches(comboKing, sampleDataLikelihoods, samples, banded, best, drifted);
+                ++compared;
+                comboKing = best;
+            }
+        }
+
+        for (vector<Allele*>::iterator o = owned.begin(); o != owned.end(); ++o) {
+            delete *o;
+        }
+    }
+    cout << "genotyping search rounds: " << compared << " compared, " << differences << " differ, "
+         << drifted << " combos drift from rescoring" << endl;
+    return differences + drifted;
+}
+
+// a random reference of about 100 bp per iteration, with tandem repeats of
+// every period up to 12, a repeat longer than REPEAT_INDEX_LONG_TRACT, and
+// runs of N and of other IUPAC codes
+string randomReference(int iterations) {
+    static const char* bases = "ACGT";
+    string sequence;
+    int length = 100 * iterations;
+    while ((int) sequence.size() < length) {
+        int r = randomInt(100);
+        if (r < 3) {
+            string unit;
+            for (int i = 1 + randomInt(12); i > 0; --i) {
+                unit += bases[randomInt(4)];
+            }
+            for (int i = 2 + randomInt(8); i > 0; --i) {
+                sequence += unit;
+            }
+        } else if (r == 3 && randomInt(50) == 0) {
+            sequence += string(1 + randomInt(200), 'N');
+        } else if (r == 4 && randomInt(50) == 0) {
+            sequence += (randomInt(2) ? "ANANANAN" : "RYRYRYRY");
+        } else {
+            sequence += bases[randomInt(4)];
+        }
+    }
+    sequence += string(REPEAT_INDEX_LONG_TRACT + 1, bases[randomInt(4)]);
+    for (int i = 0; i < 200; ++i) {
+        sequence += bases[randomInt(4)];
+    }
+    return sequence;
+}
+
+// the repeat index's counts against those from scanning the reference, at
+// every position at which AlleleParser::repeatAnnotation would use the index
+int checkRepeatIndex(int iterations) {
+    string sequence = randomReference(iterations);
+    vector<RepeatTract> tracts;
+    findRepeatTracts(sequence, 12, 1, tracts);
+
+    char filename[] = "/tmp/modelcheck.XXXXXX";
+    int fd = mkstemp(filename);
+    if (fd < 0) {
+        cerr << "could not create a temporary repeat index" << endl;
+        return 1;
+    }
+    close(fd);
+    RepeatIndexWriter writer;
+    writer.open(filename, 12, 1);
+    writer.write("chr", tracts);
+    writer.close();
+    RepeatIndex index;
+    bool opened = index.open(filename);
+    unlink(filename);
+    if (!opened) {
+        cerr << "could not open the temporary repeat index" << endl;
+        return 1;
+    }
+
+    int differences = 0;
+    long int compared = 0;
+    for (long int position = 0; position + 12 <= (long int) sequence.size(); ++position) {
+        string units = sequence.substr(position, 12);
+        if (units.find_first_not_of("ACGT") != string::npos) {
+            continue;
+        }
+        map<string, int> counts;
+        map<string, long int> rightBoundaries;
+        index.repeatsAt("chr", position, units, counts, rightBoundaries);
+        if (nonRedundantRepeatCounts(counts)
+            != nonRedundantRepeatCounts(sequenceRepeatCounts(position, sequence, 12))) {
+            ++differences;
+        }
+        ++compared;
+    }
+    cout << "repeat index positions: " << compared << " compared, " << differences << " differ" << endl;
+    return differences;
+}
+
+int main(int argc, char** argv) {
+
+    int iterations = (argc > 1) ? atoi(argv[1]) : 1000;
+    srand((argc > 2) ? atoi(argv[2]) : 1);
+
+    Contamination contaminations(0.45, 0.02);
+    contaminations["rg2"] = ContaminationEstimate(0.6, 0.05);
+
+    int differences = 0;
+    differences += checkBiallelicDiploid(iterations, contaminations);
+    differences += checkPloidyKernels(iterations, contaminations);
+    differences += checkGenotypeTemplates(iterations);
+    differences += checkGenotypeCountBands(iterations);
+    differences += checkPooledFrequencies();
+    differences += checkComboSearches(iterations, contaminations);
+    differences += checkRepeatIndex(iterations);
+
+    return differences == 0 ? 0 : 1;
+
+}
@@ -0,0 +1,132 @@
+#include <iostream>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "Fasta.h"
+#include "Utility.h"
+#include "RepeatIndex.h"
+
+using namespace std;
+
+void printUsage(char** argv) {
+    cerr << "usage: " << argv[0] << " [options] -f reference.fa -o reference.fa.fbri" << endl
+         << endl
+         << "Scans each sequence in the reference once for tandem repeats and homopolymers," << endl
+         << "writing an indexed track of them (unit, copies, span, entropy) for use with" << endl
+         << "freebayes --repeat-index." << endl
+         << endl
+         << "arguments:" << endl
+         << "      -f --fasta-reference FILE   FASTA reference file to scan (required)" << endl
+         << "      -o --output FILE       Write the index to FILE (required)" << endl
+         << "      -p --max-period N      Find repeats with units of up to N bp (default: 12)" << endl
+         << "      -m --min-length N      Omit repeats covering fewer than N bp.  freebayes needs" << endl
+         << "                             N no larger than its --min-repeat-size (default: 5)" << endl;
+}
+
+int main(int argc, char** argv) {
+
+    int c;
+
+    FastaReference reference;
+    bool has_ref = false;
+    string outputFile;
+    int maxPeriod = 12;
+    int minLength = 5;
+
+    if (argc < 2) {
+        printUsage(argv);
+        exit(1);
+    }
+
+    while (true) {
+        static struct option long_options[] =
+        {
+            {"help", no_argument, 0, 'h'},
+            {"fasta-reference", required_argument, 0, 'f'},
+            {"output", required_argument, 0, 'o'},
+            {"max-period", required_argument, 0, 'p'},
+            {"min-length", required_argument, 0, 'm'},
+            {0, 0, 0, 0}
+        };
+
+        int option_index = 0;
+
+        c = getopt_long (argc, argv, "hf:o:p:m:",
+                         long_options, &option_index);
+
+        /* Detect the end of the options. */
+        if (c == -1)
+            break;
+
+        switch (c) {
+
+            case 'f':
+                reference.open(optarg); // will exit on open failure
+                has_ref = true;
+                break;
+
+            case 'o':
+                outputFile = optarg;
+                break;
+
+            case 'p':
+                maxPeriod = atoi(optarg);
+                break;
+
+            case 'm':
+                minLength = atoi(optarg);
+                break;
+
+            case 'h':
+                printUsage(argv);
+                exit(0);
+                break;
+
+            case '?':
+                printUsage(argv);
+                exit(1);
+                break;
+
+              default:
+                abort();
+                break;
+        }
+    }
+
+    if (!has_ref) {
+        cerr << "no FASTA reference provided, cannot find repeats" << endl;
+        exit(1);
+    }
+
+    if (outputFile.empty()) {
+        cerr << "no output file provided" << endl;
+        exit(1);
+    }
+
+    // periods are stored in a byte
+    if (maxPeriod < 1 || maxPeriod > 255) {
+        cerr << "--max-period must be between 1 and 255" << endl;
+        exit(1);
+    }
+
+    RepeatIndexWriter writer;
+    if (!writer.open(outputFile, maxPeriod, minLength)) {
+        cerr << "could not open " << outputFile << " for writing" << endl;
+        exit(1);
+    }
+
+    vector<string>& sequenceNames = reference.index->sequenceNames;
+    for (vector<string>::iterator s = sequenceNames.begin(); s != sequenceNames.end(); ++s) {
+        string sequence = uppercase(reference.getSequence(*s));
+        vector<RepeatTract> tracts;
+        findRepeatTracts(sequence, maxPeriod, minLength, tracts);
+        writer.write(*s, tracts);
+    }
+
+    writer.close();
+
+    return 0;
+
+}